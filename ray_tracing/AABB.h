@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Ray.h"
+#include <algorithm>
+#include <limits>
+
+/*
+ * Axis Aligned Bounding Box
+ * keeps the min/max corners of a volume, used by the acceleration structures
+ */
+class AABB {
+public:
+	// empty box, extending it with anything results in that thing
+	AABB():
+		min(std::numeric_limits<float>::infinity()),
+		max(-std::numeric_limits<float>::infinity())
+	{}
+
+	AABB(const glm::vec3 &min, const glm::vec3 &max):
+		min(min),
+		max(max)
+	{}
+
+	/*
+	 * grow box to contain a point or another box
+	 */
+	void Extend(const glm::vec3 &p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	void Extend(const AABB &box) {
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	/*
+	 * shrink box to its overlap with another, empty if they do not overlap
+	 */
+	void Clip(const AABB &box) {
+		min = glm::max(min, box.min);
+		max = glm::min(max, box.max);
+	}
+
+	bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+	glm::vec3 Centroid() const { return (min + max) * .5f; }
+	glm::vec3 Extent() const { return max - min; }
+
+	/*
+	 * surface area, the cost metric of the SAH
+	 */
+	float SurfaceArea() const {
+		if (isEmpty()) return 0.f;
+		glm::vec3 d = max - min;
+		return 2.f * (d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	/*
+	 * index of the widest axis (0 = x, 1 = y, 2 = z)
+	 */
+	int LongestAxis() const {
+		glm::vec3 d = max - min;
+		if (d.x > d.y && d.x > d.z) return 0;
+		return d.y > d.z ? 1 : 2;
+	}
+
+	/*
+	 * Ray-Box intersection (slab test)
+	 * invDir is the precomputed reciprocal of the ray direction,
+	 * tnear returns the entry time if the box is hit before tmax
+	 */
+	bool Intersect(const Ray &ray, const glm::vec3 &invDir, float tmax, float &tnear) const {
+		float t0 = 0.f, t1 = tmax;
+		for (int a = 0; a < 3; a++) {
+			float tA = (min[a] - ray.origin[a]) * invDir[a];
+			float tB = (max[a] - ray.origin[a]) * invDir[a];
+			if (tA > tB) std::swap(tA, tB);
+			// written so that a NaN (flat box, parallel ray) leaves the interval untouched
+			t0 = tA > t0 ? tA : t0;
+			t1 = tB < t1 ? tB : t1;
+			if (t0 > t1) return false;
+		}
+		tnear = t0;
+		return true;
+	}
+
+	glm::vec3 min;
+	glm::vec3 max;
+};
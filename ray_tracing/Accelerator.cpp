@@ -0,0 +1,50 @@
+#include "Accelerator.h"
+
+RayMask Accelerator::IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const {
+	RayMask hits = 0;
+	for (int i = 0; i < packet.count; i++)
+		if (Intersect(packet.rays[i], infos[i], MAX))
+			hits |= 1u << i;
+	return hits;
+}
+
+RayMask Accelerator::OccludedPacket(const RayPacket &packet, const float *MAX) const {
+	RayMask occluded = 0;
+	for (int i = 0; i < packet.count; i++)
+		if (Occluded(packet.rays[i], MAX[i]))
+			occluded |= 1u << i;
+	return occluded;
+}
+
+void ObjectList::Build(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	blocks.clear();
+	std::vector<PrimitiveRef> refs(primitives.size());
+	for (int i = 0; i < primitives.size(); i++)
+		refs[i] = primitives[i];
+	if (!refs.empty())
+		PackBlocks(primitives, &refs[0], (int)refs.size(), blocks);
+}
+
+/*
+ * Runs through all objects and check if intersects with current ray
+ * one block of the same type at a time
+ */
+bool ObjectList::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	bool flag = false;
+	for (unsigned int i = 0; i < blocks.size(); i++)
+		if (IntersectBlock(*primitives, blocks[i], ray, info, MAX))
+			flag = true;
+
+	return flag;
+}
+
+/*
+ * Runs through the objects until the first one blocking the ray
+ */
+bool ObjectList::Occluded(const Ray &ray, float MAX) const {
+	for (unsigned int i = 0; i < blocks.size(); i++)
+		if (OccludedBlock(*primitives, blocks[i], ray, MAX))
+			return true;
+	return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "PrimitiveList.h"
+#include "SimdKernels.h"
+#include <vector>
+
+/*
+ * Accelerator class
+ * base for the structures answering "which object does this ray hit first"
+ */
+class Accelerator {
+public:
+	virtual ~Accelerator() {}
+	// the list is referenced, not copied, and has to outlive the structure
+	virtual void Build(const PrimitiveList &primitives) = 0;
+	/*
+	 * brings the structure up to date after primitives of the list it was built over moved
+	 * (same primitives, new places). by default it is built again
+	 */
+	virtual void Refit(const PrimitiveList &primitives) { Build(primitives); }
+	/*
+	 * expected cost of a ray query as estimated by the SAH, tells when a refit structure is worth
+	 * building again. 0 for structures that keep no such estimate (their Refit builds them again)
+	 */
+	virtual float getSAHCost() const { return 0.f; }
+	/*
+	 * closest hit along the ray, MAX is the furthest distance an intersection is accepted at
+	 * (same meaning as in Object::Intersect)
+	 */
+	virtual bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const = 0;
+	/*
+	 * closest hit of a ray leaving an earlier hit of this structure, cell is that hit's info.cell.
+	 * structures that can start the search near the ray's origin do so, by default it is Intersect
+	 */
+	virtual bool IntersectFrom(const Ray &ray, int /*cell*/, IntersectInfo &info, float MAX) const { return Intersect(ray, info, MAX); }
+	/*
+	 * any hit closer than MAX, used for shadow rays where only a yes/no answer is needed
+	 */
+	virtual bool Occluded(const Ray &ray, float MAX) const = 0;
+	/*
+	 * closest hit for every ray of a packet, infos holds one entry per ray.
+	 * returns the rays that hit something; by default the rays are traced one by one
+	 */
+	virtual RayMask IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const;
+	/*
+	 * occlusion for every ray of a packet, MAX holds the distance limit of every ray.
+	 * returns the rays that are blocked
+	 */
+	virtual RayMask OccludedPacket(const RayPacket &packet, const float *MAX) const;
+	virtual const char *getName() const = 0;
+};
+
+/*
+ * ObjectList
+ * no acceleration, tests the ray against every object (a SIMD block at a time)
+ */
+class ObjectList : public Accelerator {
+public:
+	ObjectList(): primitives(NULL) {}
+	void Build(const PrimitiveList &primitives);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	bool Occluded(const Ray &ray, float MAX) const;
+	const char *getName() const { return "list"; }
+private:
+	const PrimitiveList *primitives;
+	Buffer<PrimitiveBlock> blocks;
+};
+
+/*
+ * converts a distance along the ray to the ray parameter (time)
+ */
+inline float DistanceToTime(const Ray &ray, float distance) {
+	if (distance == std::numeric_limits<float>::infinity()) return distance;
+	return distance / glm::length(ray.direction);
+}
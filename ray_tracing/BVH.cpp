@@ -0,0 +1,276 @@
+#include "BVH.h"
+
+BVH::BVH(int maxLeafSize, ThreadPool *pool):
+	maxLeafSize(maxLeafSize),
+	pool(pool),
+	primitives(NULL)
+{}
+
+struct BuildItemsJob {
+	const PrimitiveList *primitives;
+	BVHBuildItem *items;
+};
+
+static void build_items_job(int begin, int end, void *arg) {
+	BuildItemsJob &job = *(BuildItemsJob*)arg;
+	for (int i = begin; i < end; i++) {
+		job.items[i].bounds = job.primitives->getBounds((*job.primitives)[i]);
+		job.items[i].centroid = job.items[i].bounds.Centroid();
+		job.items[i].index = i;
+	}
+}
+
+static AABB clip_item(int index, const AABB &box, void *arg) {
+	const PrimitiveList &primitives = *(const PrimitiveList*)arg;
+	return primitives.getClippedBounds(primitives[index], box);
+}
+
+void BVH::Build(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	nodes.clear();
+	blocks.clear();
+	if (primitives.empty()) return;
+
+	std::vector<BVHBuildItem> items(primitives.size());
+	BuildItemsJob job = { &primitives, &items[0] };
+	if (pool)
+		pool->ParallelFor(primitives.size(), 16384, build_items_job, &job);
+	else
+		build_items_job(0, primitives.size(), &job);
+
+	BuildBVH(items, maxLeafSize, nodes, pool, clip_item, (void*)&primitives);
+
+	// pack the leaves, in node order so that the ranges stay contiguous
+	std::vector<PrimitiveRef> refs(items.size());
+	for (unsigned int i = 0; i < items.size(); i++)
+		refs[i] = primitives[items[i].index];
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		if (!nodes[i].isLeaf()) continue;
+		int first = (int)blocks.size();
+		PackBlocks(primitives, &refs[nodes[i].offset], nodes[i].count, blocks);
+		nodes[i].offset = first;
+		nodes[i].count = (int)blocks.size() - first;
+	}
+	// the buffer grows by doubling, give back what the leaves did not use
+	blocks.shrink_to_fit();
+}
+
+void BVH::Refit(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	// children always come after their parent, so walking backwards visits them first
+	for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+		BVHNode &node = nodes[i];
+		AABB bounds;
+		if (node.isLeaf())
+			for (int b = node.offset; b < node.offset + node.count; b++) {
+				UpdateBlock(primitives, blocks[b]);
+				for (int lane = 0; lane < blocks[b].count; lane++)
+					bounds.Extend(primitives.getBounds(blocks[b].refs[lane]));
+			}
+		else {
+			bounds = nodes[i + 1].bounds;
+			bounds.Extend(nodes[node.offset].bounds);
+		}
+		node.bounds = bounds;
+	}
+}
+
+/*
+ * Front-to-back traversal
+ * the nearer child is visited first and nodes entered after the closest hit so far are skipped
+ */
+bool BVH::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float limit = DistanceToTime(ray, MAX);
+
+	struct StackEntry {
+		int node;
+		float tnear;
+	} stack[BVH_MAX_DEPTH];
+	int sp = 0;
+
+	float tnear;
+	if (!nodes[0].bounds.Intersect(ray, invDir, std::min(info.time, limit), tnear))
+		return false;
+	stack[sp].node = 0;
+	stack[sp++].tnear = tnear;
+
+	bool flag = false;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		// a closer hit was found after this node was pushed
+		if (entry.tnear > info.time) continue;
+
+		const BVHNode &node = nodes[entry.node];
+		if (node.isLeaf()) {
+			for (int i = node.offset; i < node.offset + node.count; i++)
+				if (IntersectBlock(*primitives, blocks[i], ray, info, MAX))
+					flag = true;
+			continue;
+		}
+
+		float tmax = std::min(info.time, limit);
+		int near = entry.node + 1, far = node.offset;
+		float tNear, tFar;
+		bool hitNear = nodes[near].bounds.Intersect(ray, invDir, tmax, tNear);
+		bool hitFar = nodes[far].bounds.Intersect(ray, invDir, tmax, tFar);
+		if (hitNear && hitFar && tFar < tNear) {
+			std::swap(near, far);
+			std::swap(tNear, tFar);
+		}
+		if (hitFar) {
+			stack[sp].node = far;
+			stack[sp++].tnear = tFar;
+		}
+		if (hitNear) {
+			stack[sp].node = near;
+			stack[sp++].tnear = tNear;
+		}
+	}
+	return flag;
+}
+
+/*
+ * Any-hit traversal
+ * no ordering of the children, stops at the first object found within MAX
+ */
+bool BVH::Occluded(const Ray &ray, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float limit = DistanceToTime(ray, MAX);
+
+	int stack[BVH_MAX_DEPTH];
+	int sp = 0;
+	stack[sp++] = 0;
+
+	while (sp > 0) {
+		int index = stack[--sp];
+		const BVHNode &node = nodes[index];
+		float tnear;
+		if (!node.bounds.Intersect(ray, invDir, limit, tnear)) continue;
+
+		if (node.isLeaf()) {
+			for (int i = node.offset; i < node.offset + node.count; i++)
+				if (OccludedBlock(*primitives, blocks[i], ray, MAX))
+					return true;
+			continue;
+		}
+		stack[sp++] = node.offset;
+		stack[sp++] = index + 1;
+	}
+	return false;
+}
+
+/*
+ * Packet traversal
+ * every node is tested against the rays that reached its parent, nodes entered after
+ * the closest hit of every remaining ray are skipped. children are ordered along the first active ray
+ */
+RayMask BVH::IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const {
+	if (nodes.empty()) return 0;
+
+	float limit[PACKET_SIZE], tmax[PACKET_SIZE];
+	for (int i = 0; i < packet.count; i++)
+		limit[i] = DistanceToTime(packet.rays[i], MAX);
+
+	struct StackEntry {
+		int node;
+		RayMask active;
+	} stack[BVH_MAX_DEPTH];
+	int sp = 0;
+	stack[sp].node = 0;
+	stack[sp++].active = packet.getMask();
+
+	RayMask hits = 0;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		const BVHNode &node = nodes[entry.node];
+
+		// rays that found a closer hit since the node was pushed drop out here
+		for (int i = 0; i < packet.count; i++)
+			tmax[i] = std::min(infos[i].time, limit[i]);
+		RayMask active = IntersectBoxPacket(node.bounds, packet, entry.active, tmax);
+		if (!active) continue;
+
+		if (node.isLeaf()) {
+			for (int r = 0; r < packet.count; r++) {
+				if (!(active & (1u << r))) continue;
+				for (int i = node.offset; i < node.offset + node.count; i++)
+					if (IntersectBlock(*primitives, blocks[i], packet.rays[r], infos[r], MAX))
+						hits |= 1u << r;
+			}
+			continue;
+		}
+
+		int near = entry.node + 1, far = node.offset;
+		int first = 0;
+		while (!(active & (1u << first))) first++;
+		if (glm::dot(nodes[far].bounds.Centroid() - nodes[near].bounds.Centroid(), packet.rays[first].direction) < 0.f)
+			std::swap(near, far);
+		stack[sp].node = far;
+		stack[sp++].active = active;
+		stack[sp].node = near;
+		stack[sp++].active = active;
+	}
+	return hits;
+}
+
+/*
+ * Packet any-hit traversal
+ * rays leave the packet as soon as they are blocked, stops when all of them are
+ */
+RayMask BVH::OccludedPacket(const RayPacket &packet, const float *MAX) const {
+	if (nodes.empty()) return 0;
+
+	float limit[PACKET_SIZE];
+	for (int i = 0; i < packet.count; i++)
+		limit[i] = DistanceToTime(packet.rays[i], MAX[i]);
+
+	struct StackEntry {
+		int node;
+		RayMask active;
+	} stack[BVH_MAX_DEPTH];
+	int sp = 0;
+	stack[sp].node = 0;
+	stack[sp++].active = packet.getMask();
+
+	RayMask occluded = 0;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		const BVHNode &node = nodes[entry.node];
+		RayMask active = IntersectBoxPacket(node.bounds, packet, entry.active & ~occluded, limit);
+		if (!active) continue;
+
+		if (node.isLeaf()) {
+			for (int r = 0; r < packet.count; r++) {
+				if (!(active & (1u << r))) continue;
+				for (int i = node.offset; i < node.offset + node.count; i++)
+					if (OccludedBlock(*primitives, blocks[i], packet.rays[r], MAX[r])) {
+						occluded |= 1u << r;
+						break;
+					}
+			}
+			if (occluded == packet.getMask()) break;
+			continue;
+		}
+		stack[sp].node = node.offset;
+		stack[sp++].active = active;
+		stack[sp].node = entry.node + 1;
+		stack[sp++].active = active;
+	}
+	return occluded;
+}
+
+float BVH::getSAHCost() const {
+	if (nodes.empty()) return 0.f;
+	float rootArea = nodes[0].bounds.SurfaceArea();
+	float cost = 0.f;
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		float p = nodes[i].bounds.SurfaceArea() / rootArea;
+		cost += p * (nodes[i].isLeaf() ? SAH_BLOCK_COST * nodes[i].count : SAH_TRAVERSAL_COST);
+	}
+	return cost;
+}
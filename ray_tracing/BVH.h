@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Accelerator.h"
+#include "BVHBuilder.h"
+
+/*
+ * Bounding Volume Hierarchy
+ * top-down build with the binned surface area heuristic (see BuildBVH), on several threads when given a pool,
+ * front-to-back traversal that skips nodes further than the closest hit so far,
+ * and an any-hit traversal for occlusion queries, for single rays and for packets
+ * (a node is tested against the whole packet and skipped when none of its rays hit it).
+ * leaves keep their primitives packed in SIMD blocks, the SAH charges leaves per block.
+ * for moving primitives the tree can be refit instead of built again
+ */
+class BVH : public Accelerator {
+public:
+	// with a pool the builds run on its threads (see BuildBVH)
+	BVH(int maxLeafSize = SIMD_BLOCK_SIZE, ThreadPool *pool = NULL);
+	void Build(const PrimitiveList &primitives);
+	/*
+	 * keeps the tree and recomputes the boxes bottom-up (and the geometry in the blocks),
+	 * linear in the number of nodes. the tree gets worse as the primitives move away from where
+	 * it was built, getSAHCost tells when building it again pays off
+	 */
+	void Refit(const PrimitiveList &primitives);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	bool Occluded(const Ray &ray, float MAX) const;
+	RayMask IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const;
+	RayMask OccludedPacket(const RayPacket &packet, const float *MAX) const;
+	const char *getName() const { return "bvh"; }
+
+	// pool of the next builds, NULL to build on the calling thread
+	void setThreadPool(ThreadPool *pool) { this->pool = pool; }
+
+	int getNodeCount() const { return (int)nodes.size(); }
+	// box of the root, empty if there are no primitives
+	AABB getBounds() const { return nodes.empty() ? AABB() : nodes[0].bounds; }
+	// bytes held by the nodes and the blocks
+	size_t getMemoryUsage() const { return getNodeMemoryUsage() + blocks.capacity() * sizeof(PrimitiveBlock); }
+	// bytes held by the nodes alone
+	size_t getNodeMemoryUsage() const { return nodes.capacity() * sizeof(BVHNode); }
+	/*
+	 * expected cost of a ray query as estimated by the SAH, used to judge tree quality
+	 */
+	float getSAHCost() const;
+
+private:
+	friend class SceneCache;
+
+	int maxLeafSize;
+	ThreadPool *pool;
+	Buffer<BVHNode> nodes;
+	const PrimitiveList *primitives;
+	// each leaf covers a contiguous range of blocks
+	Buffer<PrimitiveBlock> blocks;
+};
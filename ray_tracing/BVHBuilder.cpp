@@ -0,0 +1,1396 @@
+#include "BVHBuilder.h"
+#include <algorithm>
+
+// ranges up to this many items get the full sweep over sorted centroids, larger ones are binned
+static const int SAH_SWEEP_MAX = 32;
+// bins per axis for the larger ranges
+static const int SAH_BIN_COUNT = 32;
+// items per job when one range is bounded or binned by several threads
+static const int PARALLEL_GRAIN = 16384;
+// smallest subtree handed to a job of its own
+static const int PARALLEL_SUBTREE_MIN = 4096;
+
+/*
+ * cost of a leaf holding count objects, which get packed in ceil(count / SIMD_BLOCK_SIZE) blocks
+ */
+static inline float LeafCost(int count) {
+	return SAH_BLOCK_COST * ((count + SIMD_BLOCK_SIZE - 1) / SIMD_BLOCK_SIZE);
+}
+
+/*
+ * orders build items along one axis
+ */
+struct CentroidCompare {
+	int axis;
+	CentroidCompare(int axis): axis(axis) {}
+	bool operator()(const BVHBuildItem &a, const BVHBuildItem &b) const { return a.centroid[axis] < b.centroid[axis]; }
+};
+
+#pragma region Bins
+/*
+ * maps centroids to bins, slices of equal width across the centroid box of a range
+ */
+struct BinMapping {
+	glm::vec3 min;
+	// bins per unit along each axis, 0 for axes where all the centroids are equal
+	glm::vec3 scale;
+
+	BinMapping(const AABB &centroids): min(centroids.min) {
+		glm::vec3 extent = centroids.Extent();
+		for (int a = 0; a < 3; a++)
+			scale[a] = extent[a] > 0.f ? SAH_BIN_COUNT / extent[a] : 0.f;
+	}
+
+	int Bin(const glm::vec3 &centroid, int axis) const {
+		int bin = (int)((centroid[axis] - min[axis]) * scale[axis]);
+		return std::min(std::max(bin, 0), SAH_BIN_COUNT - 1);
+	}
+};
+
+struct SAHBin {
+	AABB bounds;
+	int count;
+	SAHBin(): count(0) {}
+};
+
+/*
+ * the bins of a range along all three axes
+ */
+struct SAHBins {
+	SAHBin bins[3][SAH_BIN_COUNT];
+
+	void Add(const BVHBuildItem &item, const BinMapping &mapping) {
+		for (int a = 0; a < 3; a++) {
+			SAHBin &bin = bins[a][mapping.Bin(item.centroid, a)];
+			bin.bounds.Extend(item.bounds);
+			bin.count++;
+		}
+	}
+
+	void Merge(const SAHBins &other) {
+		for (int a = 0; a < 3; a++)
+			for (int b = 0; b < SAH_BIN_COUNT; b++) {
+				bins[a][b].bounds.Extend(other.bins[a][b].bounds);
+				bins[a][b].count += other.bins[a][b].count;
+			}
+	}
+};
+
+/*
+ * true for the items left of a split between two bins
+ */
+struct BinLess {
+	const BinMapping &mapping;
+	int axis, bin;
+	BinLess(const BinMapping &mapping, int axis, int bin): mapping(mapping), axis(axis), bin(bin) {}
+	bool operator()(const BVHBuildItem &item) const { return mapping.Bin(item.centroid, axis) < bin; }
+};
+
+/*
+ * state of the jobs bounding or binning one range, every job fills in the entry of its chunk
+ */
+struct RangeJob {
+	const BVHBuildItem *items;
+	const BinMapping *mapping;
+	std::vector<AABB> bounds;
+	std::vector<AABB> centroids;
+	std::vector<SAHBins> bins;
+};
+
+static void bound_range_job(int begin, int end, void *arg) {
+	RangeJob &job = *(RangeJob*)arg;
+	AABB bounds, centroids;
+	for (int i = begin; i < end; i++) {
+		bounds.Extend(job.items[i].bounds);
+		centroids.Extend(job.items[i].centroid);
+	}
+	job.bounds[begin / PARALLEL_GRAIN] = bounds;
+	job.centroids[begin / PARALLEL_GRAIN] = centroids;
+}
+
+static void bin_range_job(int begin, int end, void *arg) {
+	RangeJob &job = *(RangeJob*)arg;
+	SAHBins &bins = job.bins[begin / PARALLEL_GRAIN];
+	for (int i = begin; i < end; i++)
+		bins.Add(job.items[i], *job.mapping);
+}
+#pragma endregion
+
+/*
+ * Binned SAH Builder
+ * the top of the tree is split on the calling thread with every range bounded and binned by all
+ * the workers; once the ranges are small enough for one job each, the subtrees below are built
+ * by the workers at the same time and stitched into the depth first order at the end.
+ * without a pool the whole tree is built as one subtree
+ */
+class BinnedBuilder {
+public:
+	BinnedBuilder(std::vector<BVHBuildItem> &items, int maxLeafSize, ThreadPool *pool);
+	void Build(Buffer<BVHNode> &nodes);
+
+private:
+	/*
+	 * node of the top of the tree, built before the subtrees
+	 */
+	struct TopNode {
+		AABB bounds;
+		int start, end, depth;
+		// children, -1 for leaves and subtrees
+		int left, right;
+		// index in subtrees, -1 if built here
+		int subtree;
+	};
+
+	static void subtree_job(int begin, int end, void *arg);
+
+	void ComputeBounds(int start, int end, bool parallel, AABB &bounds, AABB &centroids);
+	/*
+	 * picks the split of [start, end) and partitions the items for it,
+	 * returns the first item of the right child or -1 to make a leaf
+	 */
+	int Split(int start, int end, int depth, const AABB &bounds, const AABB &centroids, bool parallel);
+	// the subtree of [start, end) in depth first order, returns the index of its root
+	int BuildSubtree(Buffer<BVHNode> &nodes, int start, int end, int depth);
+	int BuildTop(int start, int end, int depth);
+	// appends a top node and everything below it to the final array
+	void Emit(int index, Buffer<BVHNode> &nodes);
+
+	std::vector<BVHBuildItem> &items;
+	int maxLeafSize;
+	ThreadPool *pool;
+	// ranges up to this size become subtrees
+	int subtreeSize;
+	std::vector<TopNode> top;
+	// top node of every subtree, and its nodes once built
+	std::vector<int> subtrees;
+	std::vector<Buffer<BVHNode> > subtreeNodes;
+};
+
+BinnedBuilder::BinnedBuilder(std::vector<BVHBuildItem> &items, int maxLeafSize, ThreadPool *pool):
+	items(items),
+	maxLeafSize(maxLeafSize),
+	pool(pool)
+{
+	int count = (int)items.size();
+	subtreeSize = count;
+	// a few subtrees per thread, so that uneven ones even out
+	if (pool && pool->getThreadCount() > 1)
+		subtreeSize = std::max(PARALLEL_SUBTREE_MIN, count / (8 * pool->getThreadCount()));
+}
+
+void BinnedBuilder::Build(Buffer<BVHNode> &nodes) {
+	nodes.reserve(2 * items.size());
+	if (subtreeSize >= (int)items.size())
+		BuildSubtree(nodes, 0, (int)items.size(), 0);
+	else {
+		BuildTop(0, (int)items.size(), 0);
+		subtreeNodes.resize(subtrees.size());
+		pool->ParallelFor((int)subtrees.size(), 1, subtree_job, this);
+		Emit(0, nodes);
+	}
+	// the reserve above is an upper bound, give back what the tree did not use
+	nodes.shrink_to_fit();
+}
+
+void BinnedBuilder::subtree_job(int begin, int end, void *arg) {
+	BinnedBuilder &builder = *(BinnedBuilder*)arg;
+	for (int s = begin; s < end; s++) {
+		const TopNode &node = builder.top[builder.subtrees[s]];
+		builder.subtreeNodes[s].reserve(2 * (node.end - node.start));
+		builder.BuildSubtree(builder.subtreeNodes[s], node.start, node.end, node.depth);
+	}
+}
+
+void BinnedBuilder::ComputeBounds(int start, int end, bool parallel, AABB &bounds, AABB &centroids) {
+	bounds = centroids = AABB();
+	int count = end - start;
+	if (!parallel || count <= PARALLEL_GRAIN) {
+		for (int i = start; i < end; i++) {
+			bounds.Extend(items[i].bounds);
+			centroids.Extend(items[i].centroid);
+		}
+		return;
+	}
+
+	RangeJob job;
+	job.items = &items[start];
+	int chunks = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+	job.bounds.resize(chunks);
+	job.centroids.resize(chunks);
+	pool->ParallelFor(count, PARALLEL_GRAIN, bound_range_job, &job);
+	for (int c = 0; c < chunks; c++) {
+		bounds.Extend(job.bounds[c]);
+		centroids.Extend(job.centroids[c]);
+	}
+}
+
+int BinnedBuilder::Split(int start, int end, int depth, const AABB &bounds, const AABB &centroids, bool parallel) {
+	int count = end - start;
+	if (count <= 1 || depth >= BVH_MAX_DEPTH - 1)
+		return -1;
+	float leafCost = LeafCost(count);
+	float parentArea = bounds.SurfaceArea();
+	float bestCost = std::numeric_limits<float>::infinity();
+	int bestAxis = -1, bestSplit = -1;
+
+	/*
+	 * Full sweep: every position between sorted centroids
+	 */
+	if (count <= SAH_SWEEP_MAX) {
+		// areas of the right hand side boxes for every split position
+		float rightArea[SAH_SWEEP_MAX];
+		for (int axis = 0; axis < 3; axis++) {
+			std::sort(items.begin() + start, items.begin() + end, CentroidCompare(axis));
+
+			AABB right;
+			for (int i = count - 1; i > 0; i--) {
+				right.Extend(items[start + i].bounds);
+				rightArea[i] = right.SurfaceArea();
+			}
+
+			// sweep from the left, split i puts items [0, i) to the left child
+			AABB left;
+			for (int i = 1; i < count; i++) {
+				left.Extend(items[start + i - 1].bounds);
+				float cost = SAH_TRAVERSAL_COST +
+					(left.SurfaceArea() * LeafCost(i) + rightArea[i] * LeafCost(count - i)) / parentArea;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		// stop when splitting does not pay off, unless the leaf would be too big
+		if (bestAxis < 0 || (bestCost >= leafCost && count <= maxLeafSize))
+			return -1;
+		if (bestAxis != 2)
+			std::sort(items.begin() + start, items.begin() + end, CentroidCompare(bestAxis));
+		return start + bestSplit;
+	}
+	/**/
+
+	/*
+	 * Binned: the boundaries between SAH_BIN_COUNT slices of the centroid box
+	 */
+	BinMapping mapping(centroids);
+	SAHBins bins;
+	if (parallel && count > PARALLEL_GRAIN) {
+		RangeJob job;
+		job.items = &items[start];
+		job.mapping = &mapping;
+		job.bins.resize((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+		pool->ParallelFor(count, PARALLEL_GRAIN, bin_range_job, &job);
+		for (unsigned int c = 0; c < job.bins.size(); c++)
+			bins.Merge(job.bins[c]);
+	}
+	else
+		for (int i = start; i < end; i++)
+			bins.Add(items[i], mapping);
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (mapping.scale[axis] == 0.f) continue;
+		const SAHBin *axisBins = bins.bins[axis];
+
+		float rightArea[SAH_BIN_COUNT];
+		int rightCount[SAH_BIN_COUNT];
+		AABB right;
+		int inRight = 0;
+		for (int b = SAH_BIN_COUNT - 1; b > 0; b--) {
+			right.Extend(axisBins[b].bounds);
+			inRight += axisBins[b].count;
+			rightArea[b] = right.SurfaceArea();
+			rightCount[b] = inRight;
+		}
+
+		// split b puts bins [0, b) to the left child
+		AABB left;
+		int inLeft = 0;
+		for (int b = 1; b < SAH_BIN_COUNT; b++) {
+			left.Extend(axisBins[b - 1].bounds);
+			inLeft += axisBins[b - 1].count;
+			if (inLeft == 0 || rightCount[b] == 0) continue;
+			float cost = SAH_TRAVERSAL_COST +
+				(left.SurfaceArea() * LeafCost(inLeft) + rightArea[b] * LeafCost(rightCount[b])) / parentArea;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	if (bestAxis < 0) {
+		// every centroid in the same spot, halve the range if it does not fit in a leaf
+		if (count <= maxLeafSize) return -1;
+		return start + count / 2;
+	}
+	if (bestCost >= leafCost && count <= maxLeafSize)
+		return -1;
+	return (int)(std::partition(items.begin() + start, items.begin() + end, BinLess(mapping, bestAxis, bestSplit)) - items.begin());
+	/**/
+}
+
+int BinnedBuilder::BuildSubtree(Buffer<BVHNode> &nodes, int start, int end, int depth) {
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+
+	AABB bounds, centroids;
+	ComputeBounds(start, end, false, bounds, centroids);
+	nodes[nodeIndex].bounds = bounds;
+
+	int mid = Split(start, end, depth, bounds, centroids, false);
+	if (mid < 0) {
+		nodes[nodeIndex].offset = start;
+		nodes[nodeIndex].count = end - start;
+		return nodeIndex;
+	}
+
+	BuildSubtree(nodes, start, mid, depth + 1);
+	int right = BuildSubtree(nodes, mid, end, depth + 1);
+	nodes[nodeIndex].offset = right;
+	nodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+int BinnedBuilder::BuildTop(int start, int end, int depth) {
+	int index = (int)top.size();
+	TopNode node;
+	node.start = start;
+	node.end = end;
+	node.depth = depth;
+	node.left = node.right = node.subtree = -1;
+	top.push_back(node);
+
+	if (end - start <= subtreeSize) {
+		top[index].subtree = (int)subtrees.size();
+		subtrees.push_back(index);
+		return index;
+	}
+
+	AABB bounds, centroids;
+	ComputeBounds(start, end, true, bounds, centroids);
+	top[index].bounds = bounds;
+	int mid = Split(start, end, depth, bounds, centroids, true);
+	if (mid < 0)
+		return index;
+	int left = BuildTop(start, mid, depth + 1);
+	int right = BuildTop(mid, end, depth + 1);
+	top[index].left = left;
+	top[index].right = right;
+	return index;
+}
+
+void BinnedBuilder::Emit(int index, Buffer<BVHNode> &nodes) {
+	const TopNode &node = top[index];
+	if (node.subtree >= 0) {
+		// the right child indices move by where the subtree lands, the leaves point to items already
+		const Buffer<BVHNode> &built = subtreeNodes[node.subtree];
+		int base = (int)nodes.size();
+		for (unsigned int i = 0; i < built.size(); i++) {
+			nodes.push_back(built[i]);
+			if (!built[i].isLeaf())
+				nodes.back().offset += base;
+		}
+		return;
+	}
+
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	nodes[nodeIndex].bounds = node.bounds;
+	if (node.left < 0) {
+		nodes[nodeIndex].offset = node.start;
+		nodes[nodeIndex].count = node.end - node.start;
+		return;
+	}
+	Emit(node.left, nodes);
+	nodes[nodeIndex].offset = (int)nodes.size();
+	nodes[nodeIndex].count = 0;
+	Emit(node.right, nodes);
+}
+
+/*
+ * runs the job over count items in chunks of PARALLEL_GRAIN, on the pool if there is one.
+ * the chunks are the same either way, so are the results
+ */
+static void run_chunks(ThreadPool *pool, int count, ThreadPool::RangeTask task, void *arg) {
+	if (pool)
+		pool->ParallelFor(count, PARALLEL_GRAIN, task, arg);
+	else
+		for (int begin = 0; begin < count; begin += PARALLEL_GRAIN)
+			task(begin, std::min(begin + PARALLEL_GRAIN, count), arg);
+}
+
+#pragma region Radix Sort
+// bits sorted by every pass
+static const int RADIX_BITS = 8;
+static const int RADIX_SIZE = 1 << RADIX_BITS;
+
+/*
+ * state of the passes, the jobs handle chunks of PARALLEL_GRAIN keys
+ */
+struct RadixJob {
+	SortKey *keys, *sorted;
+	// digit of the current pass
+	int shift;
+	// RADIX_SIZE counts per chunk, then the position of its first key of every digit
+	std::vector<int> counts;
+};
+
+static void radix_count_job(int begin, int end, void *arg) {
+	RadixJob &job = *(RadixJob*)arg;
+	int *counts = &job.counts[begin / PARALLEL_GRAIN * RADIX_SIZE];
+	for (int i = begin; i < end; i++)
+		counts[(job.keys[i].key >> job.shift) & (RADIX_SIZE - 1)]++;
+}
+
+static void radix_scatter_job(int begin, int end, void *arg) {
+	RadixJob &job = *(RadixJob*)arg;
+	int *next = &job.counts[begin / PARALLEL_GRAIN * RADIX_SIZE];
+	for (int i = begin; i < end; i++)
+		job.sorted[next[(job.keys[i].key >> job.shift) & (RADIX_SIZE - 1)]++] = job.keys[i];
+}
+
+void RadixSort(SortKey *keys, SortKey *temp, int count, int bits, ThreadPool *pool) {
+	int chunks = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+	RadixJob job;
+	job.keys = keys;
+	job.sorted = temp;
+	for (job.shift = 0; job.shift < bits; job.shift += RADIX_BITS) {
+		job.counts.assign(chunks * RADIX_SIZE, 0);
+		run_chunks(pool, count, radix_count_job, &job);
+		// keys go by digit, then by chunk, which keeps the sort stable
+		int position = 0;
+		for (int digit = 0; digit < RADIX_SIZE; digit++)
+			for (int c = 0; c < chunks; c++) {
+				int n = job.counts[c * RADIX_SIZE + digit];
+				job.counts[c * RADIX_SIZE + digit] = position;
+				position += n;
+			}
+		run_chunks(pool, count, radix_scatter_job, &job);
+		std::swap(job.keys, job.sorted);
+	}
+	// an odd number of passes left them in temp
+	if (job.keys != keys)
+		std::copy(job.keys, job.keys + count, keys);
+}
+#pragma endregion
+
+#pragma region Morton Builder
+// bits of every axis in the Morton codes, 3 * 10 fit in 32 bits
+static const int MORTON_BITS = 10;
+
+/*
+ * spreads the low 10 bits of v out to every third bit
+ */
+static inline unsigned int ExpandBits(unsigned int v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+/*
+ * state of the jobs computing the codes and gathering the items in their order
+ */
+struct MortonJob {
+	const BVHBuildItem *items;
+	BVHBuildItem *sortedItems;
+	SortKey *keys;
+	// maps the centroid box to [0, 2^MORTON_BITS)
+	glm::vec3 min, scale;
+};
+
+static void morton_code_job(int begin, int end, void *arg) {
+	MortonJob &job = *(MortonJob*)arg;
+	const float maxCell = (float)((1 << MORTON_BITS) - 1);
+	for (int i = begin; i < end; i++) {
+		glm::vec3 cell = (job.items[i].centroid - job.min) * job.scale;
+		unsigned int code = 0;
+		for (int a = 0; a < 3; a++)
+			code |= ExpandBits((unsigned int)std::min(std::max(cell[a], 0.f), maxCell)) << (2 - a);
+		job.keys[i].key = code;
+		job.keys[i].item = i;
+	}
+}
+
+static void gather_items_job(int begin, int end, void *arg) {
+	MortonJob &job = *(MortonJob*)arg;
+	for (int i = begin; i < end; i++)
+		job.sortedItems[i] = job.items[job.keys[i].item];
+}
+
+
+/*
+ * true for the codes left of the highest bit where a range differs
+ */
+struct BitClear {
+	unsigned int bit;
+	BitClear(unsigned int bit): bit(bit) {}
+	bool operator()(unsigned int code) const { return (code & bit) == 0; }
+};
+
+/*
+ * Linear BVH
+ * the items are sorted along a Morton curve through their centroids by a stable LSD radix sort,
+ * every pass counting and scattering the keys of a chunk per job. sorted that way any range
+ * of items shares the leading bits of its codes, so a range is split where the next bit turns on
+ * and the nodes come out depth first without looking at the boxes
+ */
+class MortonBuilder {
+public:
+	MortonBuilder(std::vector<BVHBuildItem> &items, int maxLeafSize, ThreadPool *pool):
+		items(items), maxLeafSize(maxLeafSize), pool(pool) {}
+	void Build(Buffer<BVHNode> &nodes);
+
+private:
+	void Sort();
+	int BuildNode(Buffer<BVHNode> &nodes, int start, int end, int depth);
+
+	std::vector<BVHBuildItem> &items;
+	int maxLeafSize;
+	ThreadPool *pool;
+	// code of every item, in item order once sorted
+	std::vector<unsigned int> codes;
+};
+
+void MortonBuilder::Build(Buffer<BVHNode> &nodes) {
+	Sort();
+	nodes.reserve(2 * items.size());
+	BuildNode(nodes, 0, (int)items.size(), 0);
+	nodes.shrink_to_fit();
+}
+
+void MortonBuilder::Sort() {
+	int count = (int)items.size();
+	int chunks = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+
+	// centroid box, by the same jobs as the SAH builder
+	RangeJob range;
+	range.items = &items[0];
+	range.bounds.resize(chunks);
+	range.centroids.resize(chunks);
+	run_chunks(pool, count, bound_range_job, &range);
+	AABB centroids;
+	for (int c = 0; c < chunks; c++)
+		centroids.Extend(range.centroids[c]);
+
+	std::vector<SortKey> keys(count), temp(count);
+	MortonJob job;
+	job.items = &items[0];
+	job.keys = &keys[0];
+	job.min = centroids.min;
+	glm::vec3 extent = centroids.Extent();
+	for (int a = 0; a < 3; a++)
+		job.scale[a] = extent[a] > 0.f ? (1 << MORTON_BITS) / extent[a] : 0.f;
+	run_chunks(pool, count, morton_code_job, &job);
+	RadixSort(&keys[0], &temp[0], count, 3 * MORTON_BITS, pool);
+
+	std::vector<BVHBuildItem> sortedItems(count);
+	job.sortedItems = &sortedItems[0];
+	run_chunks(pool, count, gather_items_job, &job);
+	items.swap(sortedItems);
+	codes.resize(count);
+	for (int i = 0; i < count; i++)
+		codes[i] = keys[i].key;
+}
+
+int MortonBuilder::BuildNode(Buffer<BVHNode> &nodes, int start, int end, int depth) {
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+
+	if (end - start <= maxLeafSize || depth >= BVH_MAX_DEPTH - 1) {
+		AABB bounds;
+		for (int i = start; i < end; i++)
+			bounds.Extend(items[i].bounds);
+		nodes[nodeIndex].bounds = bounds;
+		nodes[nodeIndex].offset = start;
+		nodes[nodeIndex].count = end - start;
+		return nodeIndex;
+	}
+
+	int mid;
+	unsigned int differ = codes[start] ^ codes[end - 1];
+	if (differ == 0)
+		// items in the same cell, halve the range
+		mid = start + (end - start) / 2;
+	else {
+		// keep the highest differing bit, the range is sorted on it below its common prefix
+		while (differ & (differ - 1))
+			differ &= differ - 1;
+		mid = (int)(std::partition_point(codes.begin() + start, codes.begin() + end, BitClear(differ)) - codes.begin());
+	}
+
+	BuildNode(nodes, start, mid, depth + 1);
+	int right = BuildNode(nodes, mid, end, depth + 1);
+	nodes[nodeIndex].bounds = nodes[nodeIndex + 1].bounds;
+	nodes[nodeIndex].bounds.Extend(nodes[right].bounds);
+	nodes[nodeIndex].offset = right;
+	nodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+#pragma endregion
+
+#pragma region Treelet Restructuring
+// leaves of a treelet, the search over its shapes grows with 3^TREELET_SIZE
+static const int TREELET_SIZE = 5;
+// the LBVH under the treelets stops at leaves this small, the pass collapses them again where the SAH says so
+static const int TREELET_LEAF_SIZE = 4;
+
+/*
+ * Treelet Optimizer
+ * after Karras and Aila, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies":
+ * going up from the leaves, every node and the subtrees below it are taken as a treelet of up to 5 leaves
+ * (opening the largest ones first) and rebuilt in the shape of least SAH cost, found by dynamic programming
+ * over every subset of the leaves. a subset small enough for one leaf may also be collapsed into one.
+ * nodes only change inside the subtree of the node being rebuilt, so the subtrees below the top
+ * are handled by the pool's jobs at the same time, before the top
+ */
+class TreeletOptimizer {
+public:
+	TreeletOptimizer(std::vector<BVHBuildItem> &items, int maxLeafSize, ThreadPool *pool);
+	void Optimize(Buffer<BVHNode> &nodes);
+
+private:
+	struct Node {
+		AABB bounds;
+		float area;
+		// SAH cost of the subtree, scaled by the root's area
+		float cost;
+		// children, -1 for the leaves of the tree
+		int left, right;
+		// leaves: first item, every node: items below
+		int start, count;
+		// the items below end up in one leaf
+		bool collapse;
+	};
+
+	/*
+	 * best shapes of all the subsets of a treelet's leaves, indexed by bit mask
+	 */
+	struct Treelet {
+		int leaves[TREELET_SIZE];
+		// nodes above the leaves, the treelet root first; they are reused for the new shape
+		int inner[TREELET_SIZE - 1];
+		AABB bounds[1 << TREELET_SIZE];
+		float cost[1 << TREELET_SIZE];
+		int count[1 << TREELET_SIZE];
+		// left half of the best partition
+		unsigned char split[1 << TREELET_SIZE];
+		bool collapse[1 << TREELET_SIZE];
+	};
+
+	static void subtree_job(int begin, int end, void *arg);
+
+	float LeafCost(const Node &node) const { return node.area * ::LeafCost(node.count); }
+	void Restructure(int index);
+	// rebuilds the nodes of a subset from the table, returns its root
+	int Rebuild(const Treelet &treelet, int set, int &used);
+	// collects the subtree roots of the jobs and the nodes above them
+	void Schedule(int index);
+	void Emit(int index, int depth, Buffer<BVHNode> &nodes, std::vector<BVHBuildItem> &sorted);
+	void Gather(int index, std::vector<BVHBuildItem> &sorted);
+
+	std::vector<BVHBuildItem> &items;
+	int maxLeafSize;
+	ThreadPool *pool;
+	int subtreeSize;
+	// areas are relative to the root's, so that the costs stay in range
+	float areaScale;
+	std::vector<Node> tree;
+	// number of nodes in every subtree of the input, which stores them from the subtree root on
+	std::vector<int> sizes;
+	std::vector<int> subtrees, top;
+};
+
+TreeletOptimizer::TreeletOptimizer(std::vector<BVHBuildItem> &items, int maxLeafSize, ThreadPool *pool):
+	items(items),
+	maxLeafSize(maxLeafSize),
+	pool(pool)
+{
+	int count = (int)items.size();
+	subtreeSize = count;
+	if (pool && pool->getThreadCount() > 1)
+		subtreeSize = std::max(PARALLEL_SUBTREE_MIN, count / (8 * pool->getThreadCount()));
+}
+
+void TreeletOptimizer::Optimize(Buffer<BVHNode> &nodes) {
+	int count = (int)nodes.size();
+	tree.resize(count);
+	sizes.resize(count);
+	float rootArea = nodes[0].bounds.SurfaceArea();
+	areaScale = rootArea > 0.f ? 1.f / rootArea : 1.f;
+	// children come after their parents
+	for (int i = count - 1; i >= 0; i--) {
+		Node &node = tree[i];
+		node.bounds = nodes[i].bounds;
+		node.area = nodes[i].bounds.SurfaceArea() * areaScale;
+		node.collapse = false;
+		if (nodes[i].isLeaf()) {
+			node.left = node.right = -1;
+			node.start = nodes[i].offset;
+			node.count = nodes[i].count;
+			node.cost = LeafCost(node);
+			sizes[i] = 1;
+		}
+		else {
+			node.left = i + 1;
+			node.right = nodes[i].offset;
+			node.start = -1;
+			node.count = tree[node.left].count + tree[node.right].count;
+			node.cost = node.area * SAH_TRAVERSAL_COST + tree[node.left].cost + tree[node.right].cost;
+			sizes[i] = 1 + sizes[node.left] + sizes[node.right];
+		}
+	}
+
+	if (subtreeSize >= (int)items.size())
+		for (int i = count - 1; i >= 0; i--)
+			Restructure(i);
+	else {
+		Schedule(0);
+		pool->ParallelFor((int)subtrees.size(), 1, subtree_job, this);
+		// the top in reverse depth first order, which reaches every node after the nodes below it
+		for (int t = (int)top.size() - 1; t >= 0; t--)
+			Restructure(top[t]);
+	}
+
+	std::vector<BVHBuildItem> sorted;
+	sorted.reserve(items.size());
+	nodes.clear();
+	nodes.reserve(count);
+	Emit(0, 0, nodes, sorted);
+	nodes.shrink_to_fit();
+	items.swap(sorted);
+}
+
+void TreeletOptimizer::Schedule(int index) {
+	const Node &node = tree[index];
+	if (node.count <= subtreeSize) {
+		subtrees.push_back(index);
+		return;
+	}
+	top.push_back(index);
+	if (node.left >= 0) {
+		Schedule(node.left);
+		Schedule(node.right);
+	}
+}
+
+void TreeletOptimizer::subtree_job(int begin, int end, void *arg) {
+	TreeletOptimizer &optimizer = *(TreeletOptimizer*)arg;
+	for (int s = begin; s < end; s++) {
+		int root = optimizer.subtrees[s];
+		for (int i = root + optimizer.sizes[root] - 1; i >= root; i--)
+			optimizer.Restructure(i);
+	}
+}
+
+void TreeletOptimizer::Restructure(int index) {
+	Node &root = tree[index];
+	if (root.left < 0) return;
+	// the nodes below may have been rebuilt since
+	root.cost = root.area * SAH_TRAVERSAL_COST + tree[root.left].cost + tree[root.right].cost;
+
+	Treelet treelet;
+	int leafCount = 2, innerCount = 1;
+	treelet.leaves[0] = root.left;
+	treelet.leaves[1] = root.right;
+	treelet.inner[0] = index;
+	// open the largest leaves, they are the ones the shape matters most for
+	while (leafCount < TREELET_SIZE) {
+		int largest = -1;
+		for (int k = 0; k < leafCount; k++) {
+			const Node &leaf = tree[treelet.leaves[k]];
+			if (leaf.left >= 0 && (largest < 0 || leaf.area > tree[treelet.leaves[largest]].area))
+				largest = k;
+		}
+		if (largest < 0) break;
+		int open = treelet.leaves[largest];
+		treelet.inner[innerCount++] = open;
+		treelet.leaves[largest] = tree[open].left;
+		treelet.leaves[leafCount++] = tree[open].right;
+	}
+
+	// subsets in increasing order come after all of their own subsets
+	int all = (1 << leafCount) - 1;
+	for (int set = 1; set <= all; set++) {
+		int low = set & -set;
+		if (set == low) {
+			int k = 0;
+			while ((1 << k) != low) k++;
+			const Node &leaf = tree[treelet.leaves[k]];
+			treelet.bounds[set] = leaf.bounds;
+			treelet.cost[set] = leaf.cost;
+			treelet.count[set] = leaf.count;
+			continue;
+		}
+		treelet.bounds[set] = treelet.bounds[set ^ low];
+		treelet.bounds[set].Extend(treelet.bounds[low]);
+		treelet.count[set] = treelet.count[set ^ low] + treelet.count[low];
+		float area = treelet.bounds[set].SurfaceArea() * areaScale;
+
+		// every partition once, with the lowest leaf on the left
+		float best = std::numeric_limits<float>::infinity();
+		int bestSplit = low;
+		for (int part = (set - 1) & set; part; part = (part - 1) & set) {
+			if (!(part & low)) continue;
+			float cost = treelet.cost[part] + treelet.cost[set ^ part];
+			if (cost < best) {
+				best = cost;
+				bestSplit = part;
+			}
+		}
+		treelet.split[set] = (unsigned char)bestSplit;
+		treelet.cost[set] = area * SAH_TRAVERSAL_COST + best;
+		treelet.collapse[set] = false;
+		if (treelet.count[set] <= maxLeafSize) {
+			float leafCost = area * ::LeafCost(treelet.count[set]);
+			if (leafCost <= treelet.cost[set]) {
+				treelet.cost[set] = leafCost;
+				treelet.collapse[set] = true;
+			}
+		}
+	}
+
+	// keep the current shape unless the new one is cheaper
+	if (treelet.cost[all] >= root.cost) return;
+	int used = 0;
+	Rebuild(treelet, all, used);
+}
+
+int TreeletOptimizer::Rebuild(const Treelet &treelet, int set, int &used) {
+	int low = set & -set;
+	if (set == low) {
+		int k = 0;
+		while ((1 << k) != low) k++;
+		return treelet.leaves[k];
+	}
+	int index = treelet.inner[used++];
+	int left = Rebuild(treelet, treelet.split[set], used);
+	int right = Rebuild(treelet, set ^ treelet.split[set], used);
+	Node &node = tree[index];
+	node.bounds = treelet.bounds[set];
+	node.area = node.bounds.SurfaceArea() * areaScale;
+	node.cost = treelet.cost[set];
+	node.left = left;
+	node.right = right;
+	node.start = -1;
+	node.count = treelet.count[set];
+	node.collapse = treelet.collapse[set];
+	return index;
+}
+
+void TreeletOptimizer::Emit(int index, int depth, Buffer<BVHNode> &nodes, std::vector<BVHBuildItem> &sorted) {
+	const Node &node = tree[index];
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	nodes[nodeIndex].bounds = node.bounds;
+	// rebuilt treelets can be deeper than the tree was, what goes past the traversal stack becomes a leaf
+	if (node.left < 0 || node.collapse || depth >= BVH_MAX_DEPTH - 1) {
+		int first = (int)sorted.size();
+		Gather(index, sorted);
+		nodes[nodeIndex].offset = first;
+		nodes[nodeIndex].count = (int)sorted.size() - first;
+		return;
+	}
+	Emit(node.left, depth + 1, nodes, sorted);
+	nodes[nodeIndex].offset = (int)nodes.size();
+	nodes[nodeIndex].count = 0;
+	Emit(node.right, depth + 1, nodes, sorted);
+}
+
+void TreeletOptimizer::Gather(int index, std::vector<BVHBuildItem> &sorted) {
+	const Node &node = tree[index];
+	if (node.left < 0) {
+		sorted.insert(sorted.end(), items.begin() + node.start, items.begin() + node.start + node.count);
+		return;
+	}
+	Gather(node.left, sorted);
+	Gather(node.right, sorted);
+}
+#pragma endregion
+
+#pragma region Spatial Split Builder
+// bins per axis for the spatial splits, the planes between them are the candidates
+static const int SPATIAL_BIN_COUNT = 16;
+// spatial splits are only tried where the children of the best object split overlap by more than
+// this fraction of the root's area, elsewhere they would rarely win
+static const float SPATIAL_OVERLAP_MIN = 1e-5f;
+// references the spatial splits may add, as a fraction of the items
+static const float SPATIAL_DUPLICATION_BUDGET = 0.25f;
+
+AABB ClipPolygon(const glm::vec3 *vertices, int count, const AABB &box) {
+	// every plane adds at most one vertex
+	glm::vec3 polygon[2][16];
+	int n = std::min(count, 10);
+	for (int i = 0; i < n; i++)
+		polygon[0][i] = vertices[i];
+
+	// Sutherland-Hodgman, against the min and max plane of every axis
+	int current = 0;
+	for (int plane = 0; plane < 6 && n > 0; plane++) {
+		int axis = plane % 3;
+		bool isMax = plane >= 3;
+		float position = isMax ? box.max[axis] : box.min[axis];
+		const glm::vec3 *in = polygon[current];
+		// most planes of a box around part of the polygon cut nothing
+		int inside = 0;
+		for (int i = 0; i < n; i++)
+			inside += isMax ? in[i][axis] <= position : in[i][axis] >= position;
+		if (inside == n) continue;
+		glm::vec3 *out = polygon[1 - current];
+		int outCount = 0;
+		for (int i = 0; i < n; i++) {
+			const glm::vec3 &p = in[(i + n - 1) % n], &q = in[i];
+			bool pInside = isMax ? p[axis] <= position : p[axis] >= position;
+			bool qInside = isMax ? q[axis] <= position : q[axis] >= position;
+			if (pInside != qInside) {
+				glm::vec3 cut = p + (q - p) * ((position - p[axis]) / (q[axis] - p[axis]));
+				cut[axis] = position;
+				out[outCount++] = cut;
+			}
+			if (qInside)
+				out[outCount++] = q;
+		}
+		n = outCount;
+		current = 1 - current;
+	}
+
+	AABB bounds;
+	for (int i = 0; i < n; i++)
+		bounds.Extend(polygon[current][i]);
+	if (bounds.isEmpty())
+		return bounds;
+	bounds.min -= glm::vec3(1e-4f);
+	bounds.max += glm::vec3(1e-4f);
+	bounds.Clip(box);
+	return bounds;
+}
+
+/*
+ * Spatial Split BVH (SBVH, Stich et al.)
+ * every node picks the cheaper of the best object split (as in the binned builder) and, where the two
+ * sides of that one overlap, the best of SPATIAL_BIN_COUNT planes across the node's box. a spatial split
+ * sends the references straddling its plane to both sides, each with the part of its bounds on that side,
+ * unless keeping one whole on one side is cheaper. every node has its own list of references, which are
+ * gathered in leaf order at the end
+ */
+class SpatialSplitBuilder {
+public:
+	SpatialSplitBuilder(std::vector<BVHBuildItem> &items, int maxLeafSize, BVHClipFunction clip, void *clipArg);
+	void Build(Buffer<BVHNode> &nodes);
+
+private:
+	struct SpatialBin {
+		AABB bounds;
+		// references starting and ending in the bin
+		int entries, exits;
+		SpatialBin(): entries(0), exits(0) {}
+	};
+
+	/*
+	 * best split found for a node, cost is infinity when there is none
+	 */
+	struct Split {
+		float cost;
+		int axis;
+		// object splits: index of the first item on the right after sorting (sweep) or bin (binned),
+		// spatial splits: first bin on the right
+		int position;
+		bool sweep;
+		AABB left, right;
+		Split(): cost(std::numeric_limits<float>::infinity()), axis(-1), position(-1), sweep(false) {}
+	};
+
+	int BuildNode(Buffer<BVHNode> &nodes, std::vector<BVHBuildItem> &refs, int depth);
+	void FindObjectSplit(std::vector<BVHBuildItem> &refs, const AABB &centroids, float parentArea, Split &split);
+	void FindSpatialSplit(const std::vector<BVHBuildItem> &refs, const AABB &bounds, float parentArea, Split &split);
+	// divide refs for a split, false if one side would be empty
+	bool PartitionObjects(std::vector<BVHBuildItem> &refs, const AABB &centroids, const Split &split,
+		std::vector<BVHBuildItem> &left, std::vector<BVHBuildItem> &right);
+	bool PartitionSpatial(const std::vector<BVHBuildItem> &refs, const AABB &bounds, const Split &split,
+		std::vector<BVHBuildItem> &left, std::vector<BVHBuildItem> &right);
+	// the part of a reference inside box (within its bounds)
+	AABB Clip(const BVHBuildItem &ref, const AABB &box) const;
+	// the bins a reference spans along axis
+	void BinRange(const BVHBuildItem &ref, const AABB &bounds, int axis, int &first, int &last) const;
+
+	std::vector<BVHBuildItem> &items;
+	int maxLeafSize;
+	BVHClipFunction clip;
+	void *clipArg;
+	float rootArea;
+	// references the spatial splits may still add
+	int budget;
+	// the references of the leaves, in node order
+	std::vector<BVHBuildItem> sorted;
+};
+
+SpatialSplitBuilder::SpatialSplitBuilder(std::vector<BVHBuildItem> &items, int maxLeafSize, BVHClipFunction clip, void *clipArg):
+	items(items),
+	maxLeafSize(maxLeafSize),
+	clip(clip),
+	clipArg(clipArg),
+	rootArea(0.f),
+	budget((int)(items.size() * SPATIAL_DUPLICATION_BUDGET))
+{}
+
+void SpatialSplitBuilder::Build(Buffer<BVHNode> &nodes) {
+	AABB bounds;
+	for (unsigned int i = 0; i < items.size(); i++)
+		bounds.Extend(items[i].bounds);
+	rootArea = bounds.SurfaceArea();
+
+	nodes.reserve(2 * (items.size() + budget));
+	sorted.reserve(items.size() + budget);
+	std::vector<BVHBuildItem> refs(items);
+	BuildNode(nodes, refs, 0);
+	items.swap(sorted);
+	nodes.shrink_to_fit();
+}
+
+AABB SpatialSplitBuilder::Clip(const BVHBuildItem &ref, const AABB &box) const {
+	AABB part = ref.bounds;
+	part.Clip(box);
+	if (!clip || part.isEmpty())
+		return part;
+	return clip(ref.index, part, clipArg);
+}
+
+void SpatialSplitBuilder::BinRange(const BVHBuildItem &ref, const AABB &bounds, int axis, int &first, int &last) const {
+	float scale = SPATIAL_BIN_COUNT / (bounds.max[axis] - bounds.min[axis]);
+	first = std::min(std::max((int)((ref.bounds.min[axis] - bounds.min[axis]) * scale), 0), SPATIAL_BIN_COUNT - 1);
+	last = std::min(std::max((int)((ref.bounds.max[axis] - bounds.min[axis]) * scale), first), SPATIAL_BIN_COUNT - 1);
+}
+
+int SpatialSplitBuilder::BuildNode(Buffer<BVHNode> &nodes, std::vector<BVHBuildItem> &refs, int depth) {
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(BVHNode());
+
+	int count = (int)refs.size();
+	AABB bounds, centroids;
+	for (int i = 0; i < count; i++) {
+		bounds.Extend(refs[i].bounds);
+		centroids.Extend(refs[i].centroid);
+	}
+	nodes[nodeIndex].bounds = bounds;
+
+	std::vector<BVHBuildItem> left, right;
+	bool split = false;
+	if (count > 1 && depth < BVH_MAX_DEPTH - 1) {
+		float parentArea = bounds.SurfaceArea();
+		Split object, spatial;
+		FindObjectSplit(refs, centroids, parentArea, object);
+		// spatial splits only pay off where the object split's children overlap
+		AABB overlap = object.left;
+		overlap.Clip(object.right);
+		if (budget > 0 && (object.axis < 0 || overlap.SurfaceArea() > SPATIAL_OVERLAP_MIN * rootArea))
+			FindSpatialSplit(refs, bounds, parentArea, spatial);
+
+		// stop when splitting does not pay off, unless the leaf would be too big
+		float leafCost = LeafCost(count);
+		bool mustSplit = count > maxLeafSize;
+		if (spatial.cost < object.cost && (spatial.cost < leafCost || mustSplit))
+			split = PartitionSpatial(refs, bounds, spatial, left, right);
+		if (!split && object.axis >= 0 && (object.cost < leafCost || mustSplit))
+			split = PartitionObjects(refs, centroids, object, left, right);
+		if (!split && mustSplit) {
+			// every centroid in the same spot, halve the references
+			left.assign(refs.begin(), refs.begin() + count / 2);
+			right.assign(refs.begin() + count / 2, refs.end());
+			split = true;
+		}
+	}
+
+	if (!split) {
+		nodes[nodeIndex].offset = (int)sorted.size();
+		nodes[nodeIndex].count = count;
+		sorted.insert(sorted.end(), refs.begin(), refs.end());
+		return nodeIndex;
+	}
+
+	// the children's references replace these
+	std::vector<BVHBuildItem>().swap(refs);
+	BuildNode(nodes, left, depth + 1);
+	int rightIndex = BuildNode(nodes, right, depth + 1);
+	nodes[nodeIndex].offset = rightIndex;
+	nodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+void SpatialSplitBuilder::FindObjectSplit(std::vector<BVHBuildItem> &refs, const AABB &centroids, float parentArea, Split &split) {
+	int count = (int)refs.size();
+
+	/*
+	 * Full sweep, as BinnedBuilder::Split
+	 */
+	if (count <= SAH_SWEEP_MAX) {
+		float rightArea[SAH_SWEEP_MAX];
+		for (int axis = 0; axis < 3; axis++) {
+			std::sort(refs.begin(), refs.end(), CentroidCompare(axis));
+
+			AABB right;
+			for (int i = count - 1; i > 0; i--) {
+				right.Extend(refs[i].bounds);
+				rightArea[i] = right.SurfaceArea();
+			}
+
+			AABB left;
+			for (int i = 1; i < count; i++) {
+				left.Extend(refs[i - 1].bounds);
+				float cost = SAH_TRAVERSAL_COST +
+					(left.SurfaceArea() * LeafCost(i) + rightArea[i] * LeafCost(count - i)) / parentArea;
+				if (cost < split.cost) {
+					split.cost = cost;
+					split.axis = axis;
+					split.position = i;
+				}
+			}
+		}
+		split.sweep = true;
+		if (split.axis >= 0) {
+			if (split.axis != 2)
+				std::sort(refs.begin(), refs.end(), CentroidCompare(split.axis));
+			// the boxes of its two sides, for the overlap
+			for (int i = 0; i < count; i++)
+				(i < split.position ? split.left : split.right).Extend(refs[i].bounds);
+		}
+		return;
+	}
+	/**/
+
+	/*
+	 * Binned
+	 */
+	BinMapping mapping(centroids);
+	SAHBins bins;
+	for (int i = 0; i < count; i++)
+		bins.Add(refs[i], mapping);
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (mapping.scale[axis] == 0.f) continue;
+		const SAHBin *axisBins = bins.bins[axis];
+
+		AABB rightBounds[SAH_BIN_COUNT];
+		int rightCount[SAH_BIN_COUNT];
+		AABB right;
+		int inRight = 0;
+		for (int b = SAH_BIN_COUNT - 1; b > 0; b--) {
+			right.Extend(axisBins[b].bounds);
+			inRight += axisBins[b].count;
+			rightBounds[b] = right;
+			rightCount[b] = inRight;
+		}
+
+		AABB left;
+		int inLeft = 0;
+		for (int b = 1; b < SAH_BIN_COUNT; b++) {
+			left.Extend(axisBins[b - 1].bounds);
+			inLeft += axisBins[b - 1].count;
+			if (inLeft == 0 || rightCount[b] == 0) continue;
+			float cost = SAH_TRAVERSAL_COST +
+				(left.SurfaceArea() * LeafCost(inLeft) + rightBounds[b].SurfaceArea() * LeafCost(rightCount[b])) / parentArea;
+			if (cost < split.cost) {
+				split.cost = cost;
+				split.axis = axis;
+				split.position = b;
+				split.left = left;
+				split.right = rightBounds[b];
+			}
+		}
+	}
+	/**/
+}
+
+void SpatialSplitBuilder::FindSpatialSplit(const std::vector<BVHBuildItem> &refs, const AABB &bounds, float parentArea, Split &split) {
+	int count = (int)refs.size();
+	glm::vec3 extent = bounds.Extent();
+	for (int axis = 0; axis < 3; axis++) {
+		if (!(extent[axis] > 0.f)) continue;
+		float width = extent[axis] / SPATIAL_BIN_COUNT;
+
+		// every reference is clipped to the slab of each bin it spans
+		SpatialBin bins[SPATIAL_BIN_COUNT];
+		for (int i = 0; i < count; i++) {
+			int first, last;
+			BinRange(refs[i], bounds, axis, first, last);
+			bins[first].entries++;
+			bins[last].exits++;
+			if (first == last) {
+				bins[first].bounds.Extend(refs[i].bounds);
+				continue;
+			}
+			for (int b = first; b <= last; b++) {
+				AABB slab = bounds;
+				if (b > first) slab.min[axis] = bounds.min[axis] + b * width;
+				if (b < last) slab.max[axis] = bounds.min[axis] + (b + 1) * width;
+				bins[b].bounds.Extend(Clip(refs[i], slab));
+			}
+		}
+
+		AABB rightBounds[SPATIAL_BIN_COUNT];
+		int rightCount[SPATIAL_BIN_COUNT];
+		AABB right;
+		int inRight = 0;
+		for (int b = SPATIAL_BIN_COUNT - 1; b > 0; b--) {
+			right.Extend(bins[b].bounds);
+			inRight += bins[b].exits;
+			rightBounds[b] = right;
+			rightCount[b] = inRight;
+		}
+
+		// plane b is the boundary between bins b - 1 and b
+		AABB left;
+		int inLeft = 0;
+		for (int b = 1; b < SPATIAL_BIN_COUNT; b++) {
+			left.Extend(bins[b - 1].bounds);
+			inLeft += bins[b - 1].entries;
+			int duplicates = inLeft + rightCount[b] - count;
+			if (inLeft == 0 || rightCount[b] == 0 || duplicates > budget) continue;
+			float cost = SAH_TRAVERSAL_COST +
+				(left.SurfaceArea() * LeafCost(inLeft) + rightBounds[b].SurfaceArea() * LeafCost(rightCount[b])) / parentArea;
+			if (cost < split.cost) {
+				split.cost = cost;
+				split.axis = axis;
+				split.position = b;
+				split.left = left;
+				split.right = rightBounds[b];
+			}
+		}
+	}
+}
+
+bool SpatialSplitBuilder::PartitionObjects(std::vector<BVHBuildItem> &refs, const AABB &centroids, const Split &split,
+	std::vector<BVHBuildItem> &left, std::vector<BVHBuildItem> &right) {
+	std::vector<BVHBuildItem>::iterator mid;
+	if (split.sweep) {
+		// FindObjectSplit left them sorted along the split's axis
+		mid = refs.begin() + split.position;
+	}
+	else {
+		BinMapping mapping(centroids);
+		mid = std::partition(refs.begin(), refs.end(), BinLess(mapping, split.axis, split.position));
+	}
+	if (mid == refs.begin() || mid == refs.end())
+		return false;
+	left.assign(refs.begin(), mid);
+	right.assign(mid, refs.end());
+	return true;
+}
+
+bool SpatialSplitBuilder::PartitionSpatial(const std::vector<BVHBuildItem> &refs, const AABB &bounds, const Split &split,
+	std::vector<BVHBuildItem> &left, std::vector<BVHBuildItem> &right) {
+	int axis = split.axis;
+	float plane = bounds.min[axis] + split.position * (bounds.Extent()[axis] / SPATIAL_BIN_COUNT);
+	AABB leftBounds = split.left, rightBounds = split.right;
+	int inLeft = 0, inRight = 0;
+	for (unsigned int i = 0; i < refs.size(); i++) {
+		int first, last;
+		BinRange(refs[i], bounds, axis, first, last);
+		if (first < split.position) inLeft++;
+		if (last >= split.position) inRight++;
+	}
+
+	left.reserve(inLeft);
+	right.reserve(inRight);
+	for (unsigned int i = 0; i < refs.size(); i++) {
+		const BVHBuildItem &ref = refs[i];
+		int first, last;
+		BinRange(ref, bounds, axis, first, last);
+		if (last < split.position) {
+			left.push_back(ref);
+			continue;
+		}
+		if (first >= split.position) {
+			right.push_back(ref);
+			continue;
+		}
+
+		// keeping the reference whole on one side may be cheaper than cutting it
+		AABB wholeLeft = leftBounds, wholeRight = rightBounds;
+		wholeLeft.Extend(ref.bounds);
+		wholeRight.Extend(ref.bounds);
+		float cutCost = leftBounds.SurfaceArea() * inLeft + rightBounds.SurfaceArea() * inRight;
+		float leftCost = wholeLeft.SurfaceArea() * inLeft + rightBounds.SurfaceArea() * (inRight - 1);
+		float rightCost = leftBounds.SurfaceArea() * (inLeft - 1) + wholeRight.SurfaceArea() * inRight;
+		if (leftCost < cutCost && leftCost <= rightCost) {
+			left.push_back(ref);
+			leftBounds = wholeLeft;
+			inRight--;
+			continue;
+		}
+		if (rightCost < cutCost) {
+			right.push_back(ref);
+			rightBounds = wholeRight;
+			inLeft--;
+			continue;
+		}
+
+		AABB leftSlab = bounds, rightSlab = bounds;
+		leftSlab.max[axis] = plane;
+		rightSlab.min[axis] = plane;
+		BVHBuildItem part = ref;
+		part.bounds = Clip(ref, leftSlab);
+		if (!part.bounds.isEmpty()) {
+			part.centroid = part.bounds.Centroid();
+			left.push_back(part);
+		}
+		part.bounds = Clip(ref, rightSlab);
+		if (!part.bounds.isEmpty()) {
+			part.centroid = part.bounds.Centroid();
+			right.push_back(part);
+		}
+	}
+
+	if (left.empty() || right.empty()) {
+		left.clear();
+		right.clear();
+		return false;
+	}
+	budget -= std::max(0, (int)(left.size() + right.size() - refs.size()));
+	return true;
+}
+#pragma endregion
+
+static BVHBuildMethod build_method = BVH_BUILD_SAH;
+
+void SetBVHBuildMethod(BVHBuildMethod method) {
+	build_method = method;
+}
+
+BVHBuildMethod getBVHBuildMethod() {
+	return build_method;
+}
+
+const char *BVHBuildMethodName(BVHBuildMethod method) {
+	switch (method) {
+	case BVH_BUILD_LBVH: return "lbvh";
+	case BVH_BUILD_LBVH_TREELETS: return "lbvh-treelets";
+	case BVH_BUILD_SBVH: return "sbvh";
+	default: return "sah";
+	}
+}
+
+void BuildBVH(std::vector<BVHBuildItem> &items, int maxLeafSize, Buffer<BVHNode> &nodes, ThreadPool *pool,
+	BVHClipFunction clip, void *clipArg) {
+	nodes.clear();
+	if (items.empty()) return;
+	if (build_method == BVH_BUILD_SBVH) {
+		SpatialSplitBuilder builder(items, maxLeafSize, clip, clipArg);
+		builder.Build(nodes);
+		return;
+	}
+	if (build_method == BVH_BUILD_SAH) {
+		BinnedBuilder builder(items, maxLeafSize, pool);
+		builder.Build(nodes);
+		return;
+	}
+	MortonBuilder builder(items, build_method == BVH_BUILD_LBVH_TREELETS ? std::min(maxLeafSize, TREELET_LEAF_SIZE) : maxLeafSize, pool);
+	builder.Build(nodes);
+	if (build_method == BVH_BUILD_LBVH_TREELETS) {
+		TreeletOptimizer optimizer(items, maxLeafSize, pool);
+		optimizer.Optimize(nodes);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "AABB.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// traversal stack size, also the maximum depth the builder produces
+#define BVH_MAX_DEPTH 64
+
+// relative costs of visiting a node and testing a block of objects, as used by the SAH
+// (a block costs a bit more than a single object but far less than testing its objects one by one)
+const float SAH_TRAVERSAL_COST = 1.f;
+const float SAH_BLOCK_COST = 3.f;
+
+/*
+ * Flattened BVH node
+ * nodes are stored depth first, so the left child of an interior node is always the next node
+ */
+struct BVHNode {
+	AABB bounds;
+	// leaf: index of first primitive block, interior: index of right child
+	int offset;
+	// number of primitive blocks in leaf, 0 for interior nodes
+	int count;
+
+	bool isLeaf() const { return count > 0; }
+};
+
+/*
+ * object info cached during build
+ */
+struct BVHBuildItem {
+	AABB bounds;
+	glm::vec3 centroid;
+	int index;
+};
+
+/*
+ * Ways of building the hierarchy, picked at runtime for every BVH built afterwards
+ */
+enum BVHBuildMethod {
+	// binned surface area heuristic, the best trees
+	BVH_BUILD_SAH = 0,
+	// linear BVH over Morton codes of the centroids, several times faster to build but slower to trace
+	BVH_BUILD_LBVH = 1,
+	// linear BVH whose small subtrees (treelets) are then rearranged for the best SAH cost
+	BVH_BUILD_LBVH_TREELETS = 2,
+	// SAH with spatial splits, which cut long objects in two where their boxes would overlap
+	BVH_BUILD_SBVH = 3
+};
+
+/*
+ * bounds of the part of object index (as in BVHBuildItem) inside box, used by the spatial splits
+ * to cut the objects' references. the result has to lie within box, arg is passed through from BuildBVH
+ */
+typedef AABB (*BVHClipFunction)(int index, const AABB &box, void *arg);
+
+/*
+ * bounds of the part of a flat convex polygon (up to 4 vertices) inside box, padded as Triangle::getBounds
+ * and clipped to box
+ */
+AABB ClipPolygon(const glm::vec3 *vertices, int count, const AABB &box);
+
+/*
+ * key and the index of what it stands for
+ */
+struct SortKey {
+	unsigned int key;
+	int item;
+};
+
+/*
+ * stable LSD radix sort of count keys on their low bits, 8 per pass, temp has room for count keys.
+ * with a pool every pass counts and scatters chunks of the keys in parallel, with the same result.
+ * shared by the LBVH and the grids
+ */
+void RadixSort(SortKey *keys, SortKey *temp, int count, int bits, ThreadPool *pool = NULL);
+
+void SetBVHBuildMethod(BVHBuildMethod method);
+BVHBuildMethod getBVHBuildMethod();
+const char *BVHBuildMethodName(BVHBuildMethod method);
+
+/*
+ * builds the hierarchy with the selected method (SAH unless set otherwise), shared by the scene BVH and the meshes.
+ * SAH: top-down build with the surface area heuristic.
+ * large ranges are split at the best of 32 centroid bins per axis, small ones by a full sweep
+ * over the sorted centroids. with a pool the large ranges are bounded and binned by all its threads
+ * and the subtrees below them built in parallel; the tree is the same with or without it.
+ * LBVH: the items are sorted by the Morton codes of their centroids (a radix sort, in parallel with a pool)
+ * and every range split where its codes first differ, leaves hold up to maxLeafSize items;
+ * the treelets pass then rebuilds every node's treelet of up to 5 subtrees in its cheapest shape.
+ * SBVH: as SAH, and where the children of a split would overlap a lot a split plane through the objects
+ * is tried as well. the objects it cuts are referenced from both sides with the bounds clip gives for each
+ * part (the box itself without a clip function), until the references have grown by a quarter.
+ * built on the calling thread.
+ * the pool must be NULL when called from one of the pool's own tasks.
+ * the items are reordered so that every leaf covers items [offset, offset + count),
+ * the caller then packs them and points the leaves to its own storage. only spatial splits add
+ * items, copies of the cut objects' items with smaller bounds
+ */
+void BuildBVH(std::vector<BVHBuildItem> &items, int maxLeafSize, Buffer<BVHNode> &nodes, ThreadPool *pool = NULL,
+	BVHClipFunction clip = NULL, void *clipArg = NULL);
@@ -0,0 +1,1036 @@
+#include "Benchmark.h"
+#include "Accelerator.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Grid.h"
+#include "KdTree.h"
+#include "SimdKernels.h"
+#include "Timer.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+/*
+ * Small deterministic generator so that runs are comparable across platforms
+ */
+class Random {
+public:
+	Random(unsigned int seed): state(seed) {}
+	// uniform in [0, 1)
+	float Next() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.f / 16777216.f);
+	}
+	float Range(float a, float b) { return a + (b - a) * Next(); }
+	glm::vec3 Point(float a, float b) { return glm::vec3(Range(a, b), Range(a, b), Range(a, b)); }
+private:
+	unsigned int state;
+};
+
+void random_scene(PrimitiveList &primitives, int count, MaterialID material, unsigned int seed) {
+	Random random(seed);
+	for (int i = 0; i < count; i++) {
+		glm::vec3 p = random.Point(-20.f, 20.f);
+		switch (i % 3) {
+		case 0:
+			primitives.Add(Sphere(p, random.Range(.05f, .3f), material));
+			break;
+		case 1:
+			primitives.Add(Triangle(p, p + random.Point(-.5f, .5f), p + random.Point(-.5f, .5f), material));
+			break;
+		default: {
+			// parallelogram spanned by two random edges
+			glm::vec3 u = random.Point(-.4f, .4f), v = random.Point(-.4f, .4f);
+			primitives.Add(Plane(p, p + u, p + u + v, p + v, material));
+			break;
+		}
+		}
+	}
+}
+
+/*
+ * Traces rays from outside the cube towards random points inside it,
+ * returns the average time per ray in nanoseconds
+ */
+static double time_rays(const Accelerator &accelerator, int numRays) {
+	Random random(7);
+	Timer timer;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin(random.Range(-30.f, 30.f), random.Range(-30.f, 30.f), -60.f);
+		Ray ray(origin, glm::normalize(random.Point(-20.f, 20.f) - origin));
+		IntersectInfo info;
+		accelerator.Intersect(ray, info, std::numeric_limits<float>::infinity());
+	}
+	return timer.Seconds() * 1e9 / numRays;
+}
+
+/*
+ * Shadow rays crossing the cube from one face to the opposite one,
+ * answered either as a closest-hit query or as an occlusion query.
+ * returns the average time per ray in nanoseconds
+ */
+static double time_shadow_rays(const Accelerator &accelerator, int numRays, bool occlusion, int &blocked) {
+	Random random(11);
+	blocked = 0;
+	Timer timer;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin(random.Range(-20.f, 20.f), random.Range(-20.f, 20.f), -20.f);
+		glm::vec3 light(random.Range(-20.f, 20.f), random.Range(-20.f, 20.f), 20.f);
+		Ray ray(origin, light - origin);
+		float distance = glm::length(light - origin);
+		if (occlusion) {
+			if (accelerator.Occluded(ray, distance))
+				blocked++;
+		}
+		else {
+			IntersectInfo info;
+			if (accelerator.Intersect(ray, info, distance))
+				blocked++;
+		}
+	}
+	return timer.Seconds() * 1e9 / numRays;
+}
+
+void benchmark_scaling(int max_objects) {
+	// geometry only, nothing is shaded
+	MaterialID material = 0;
+	std::ostringstream shadows;
+	std::cout << std::fixed << std::setw(10) << "objects" << std::setw(12) << "build ms"
+		<< std::setw(16) << "list ns/ray" << std::setw(16) << "bvh ns/ray" << std::setw(10) << "speedup" << std::endl;
+	shadows << std::fixed << std::setw(10) << "objects" << std::setw(10) << "blocked"
+		<< std::setw(16) << "list closest" << std::setw(12) << "list any"
+		<< std::setw(16) << "bvh closest" << std::setw(12) << "bvh any" << std::endl;
+
+	for (int count = 125; count <= max_objects; count *= 4) {
+		PrimitiveList primitives;
+		random_scene(primitives, count, material);
+
+		ObjectList list;
+		list.Build(primitives);
+		BVH bvh;
+		Timer timer;
+		bvh.Build(primitives);
+		double build = timer.Milliseconds();
+
+		// keep the linear run to a bounded number of object tests
+		int listRays = std::max(100, std::min(20000, 100000000 / count));
+		double listTime = time_rays(list, listRays);
+		double bvhTime = time_rays(bvh, 20000);
+
+		std::cout << std::setw(10) << count << std::setw(12) << std::setprecision(2) << build
+			<< std::setw(16) << std::setprecision(0) << listTime << std::setw(16) << bvhTime
+			<< std::setw(9) << std::setprecision(1) << listTime / bvhTime << "x" << std::endl;
+
+		// shadow rays, closest hit against early exit
+		int blocked;
+		double listClosest = time_shadow_rays(list, listRays, false, blocked);
+		double listAny = time_shadow_rays(list, listRays, true, blocked);
+		double bvhClosest = time_shadow_rays(bvh, 20000, false, blocked);
+		double bvhAny = time_shadow_rays(bvh, 20000, true, blocked);
+		shadows << std::setw(10) << count << std::setw(9) << std::setprecision(0) << 100.0 * blocked / 20000 << "%"
+			<< std::setw(16) << listClosest << std::setw(12) << listAny
+			<< std::setw(16) << bvhClosest << std::setw(12) << bvhAny << std::endl;
+	}
+
+	std::cout << std::endl << "shadow rays (ns/ray)" << std::endl << shadows.str();
+}
+
+#pragma region Intersection Kernels
+/*
+ * Previous triangle test, kept as the reference for benchmark_intersection:
+ * hit the plane first, then compare the triangle area with the areas (Heron's formula)
+ * of the three triangles the point splits it into
+ */
+static float legacy_TriangleArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) {
+	float a = glm::length(p2 - p1);
+	float b = glm::length(p3 - p2);
+	float c = glm::length(p3 - p1);
+	float s = (a + b + c) / 2;
+	return sqrt(s*(s - a)*(s - b)*(s - c));
+}
+
+static bool legacy_checkPointInArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec3 p) {
+	float area = legacy_TriangleArea(p1, p2, p3);
+	float area_diff = std::abs(area - (legacy_TriangleArea(p1, p2, p) + legacy_TriangleArea(p1, p, p3) + legacy_TriangleArea(p, p2, p3)));
+	return area_diff <= area * 0.01;
+}
+
+/*
+ * triangle (3 vertices) or plane (4 vertices) with the data the old objects precomputed
+ */
+struct LegacyShape {
+	glm::vec3 vertices[4];
+	int count;
+	glm::vec3 normal;
+	glm::vec3 centroid;
+	float radius;
+
+	LegacyShape(const glm::vec3 *v, int count): count(count), centroid(0.f), radius(0.f) {
+		for (int i = 0; i < count; i++) {
+			vertices[i] = v[i];
+			centroid += v[i] / (float)count;
+		}
+		normal = glm::normalize(glm::cross(v[1] - v[0], v[2] - v[0]));
+		for (int i = 0; i < count; i++)
+			radius = std::max(radius, glm::length(v[i] - centroid));
+	}
+
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+		if (glm::dot(ray.direction, normal) == 0.f) return false;
+		float t = glm::dot((vertices[0] - ray.origin), normal) / glm::dot(ray.direction, normal);
+		glm::vec3 point = ray(t);
+		if (t < 0.0f || glm::length(point - ray.origin) > MAX) return false;
+		if (glm::distance(centroid, point) > radius) return false;
+
+		bool inside = legacy_checkPointInArea(vertices[0], vertices[1], vertices[2], point);
+		if (!inside && count == 4)
+			inside = legacy_checkPointInArea(vertices[0], vertices[2], vertices[3], point);
+		if (!inside || t >= info.time) return false;
+
+		info.time = t;
+		info.hitPoint = point;
+		info.normal = normal;
+		return true;
+	}
+};
+
+void benchmark_intersection() {
+	const int numShapes = 1000, numRays = 2000;
+	// geometry only, nothing is shaded
+	MaterialID material = 0;
+	Random random(3);
+
+	// unit sized shapes around the origin, rays aimed at the same region so about half of the tests hit
+	std::vector<LegacyShape> legacy[2];
+	PrimitiveList shapes[2];
+	for (int i = 0; i < numShapes; i++) {
+		glm::vec3 p = random.Point(-.5f, .5f);
+		glm::vec3 u = random.Point(-1.f, 1.f), v = random.Point(-1.f, 1.f);
+		glm::vec3 triangle[3] = { p, p + u, p + v };
+		glm::vec3 quad[4] = { p, p + u, p + u + v, p + v };
+		legacy[0].push_back(LegacyShape(triangle, 3));
+		shapes[0].Add(Triangle(triangle[0], triangle[1], triangle[2], material));
+		legacy[1].push_back(LegacyShape(quad, 4));
+		shapes[1].Add(Plane(quad[0], quad[1], quad[2], quad[3], material));
+	}
+	std::vector<Ray> rays;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin = random.Point(-5.f, 5.f);
+		rays.push_back(Ray(origin, glm::normalize(random.Point(-.5f, .5f) - origin)));
+	}
+
+	const char *names[2] = { "triangle", "plane" };
+	const float inf = std::numeric_limits<float>::infinity();
+	std::cout << std::fixed << std::setw(10) << "kernel" << std::setw(16) << "area ns/test"
+		<< std::setw(16) << "MT ns/test" << std::setw(10) << "speedup" << std::setw(10) << "hits" << std::setw(12) << "mismatch" << std::endl;
+
+	for (int k = 0; k < 2; k++) {
+		int legacyHits = 0, hits = 0, mismatch = 0;
+
+		Timer timer;
+		for (int r = 0; r < numRays; r++)
+			for (int i = 0; i < numShapes; i++) {
+				IntersectInfo info;
+				if (legacy[k][i].Intersect(rays[r], info, inf))
+					legacyHits++;
+			}
+		double legacyTime = timer.Seconds() * 1e9 / ((double)numRays * numShapes);
+
+		timer.Reset();
+		for (int r = 0; r < numRays; r++)
+			for (int i = 0; i < numShapes; i++) {
+				IntersectInfo info;
+				if (shapes[k].Intersect(shapes[k][i], rays[r], info, inf))
+					hits++;
+			}
+		double time = timer.Seconds() * 1e9 / ((double)numRays * numShapes);
+
+		// the area test accepts points up to 1% outside, count the disagreements
+		for (int r = 0; r < numRays; r += 10)
+			for (int i = 0; i < numShapes; i++) {
+				IntersectInfo a, b;
+				if (legacy[k][i].Intersect(rays[r], a, inf) != shapes[k].Intersect(shapes[k][i], rays[r], b, inf))
+					mismatch++;
+			}
+
+		std::cout << std::setw(10) << names[k] << std::setw(16) << std::setprecision(1) << legacyTime
+			<< std::setw(16) << time << std::setw(9) << legacyTime / time << "x"
+			<< std::setw(10) << hits << std::setw(12) << mismatch << std::endl;
+	}
+}
+#pragma endregion
+
+#pragma region SIMD Kernels
+/*
+ * closest hit of every ray against the blocks, returns the time per object test in nanoseconds
+ */
+static double time_blocks(const PrimitiveList &shapes, const Buffer<PrimitiveBlock> &blocks, const std::vector<Ray> &rays, std::vector<float> &times) {
+	const float inf = std::numeric_limits<float>::infinity();
+	Timer timer;
+	for (unsigned int r = 0; r < rays.size(); r++) {
+		IntersectInfo info;
+		for (unsigned int b = 0; b < blocks.size(); b++)
+			IntersectBlock(shapes, blocks[b], rays[r], info, inf);
+		times[r] = info.time;
+	}
+	return timer.Seconds() * 1e9 / ((double)rays.size() * shapes.size());
+}
+
+void benchmark_simd() {
+	const int numShapes = 1024, numRays = 2000;
+	// geometry only, nothing is shaded
+	MaterialID material = 0;
+	Random random(5);
+
+	// same setup as benchmark_intersection, one list per block kind
+	PrimitiveList shapes[3];
+	for (int i = 0; i < numShapes; i++) {
+		glm::vec3 p = random.Point(-.5f, .5f);
+		glm::vec3 u = random.Point(-1.f, 1.f), v = random.Point(-1.f, 1.f);
+		shapes[0].Add(Sphere(p, random.Range(.05f, .3f), material));
+		shapes[1].Add(Triangle(p, p + u, p + v, material));
+		shapes[2].Add(Plane(p, p + u, p + u + v, p + v, material));
+	}
+	std::vector<Ray> rays;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin = random.Point(-5.f, 5.f);
+		rays.push_back(Ray(origin, glm::normalize(random.Point(-.5f, .5f) - origin)));
+	}
+
+	SimdLevel previous = getSimdLevel(), best = DetectSimdLevel();
+	const char *names[3] = { "sphere", "triangle", "plane" };
+	const float inf = std::numeric_limits<float>::infinity();
+	std::cout << "cpu supports " << SimdLevelName(best) << ", ns per object test" << std::endl;
+	std::cout << std::fixed << std::setw(10) << "kernel" << std::setw(12) << "single";
+	for (int level = SIMD_SCALAR; level <= best; level++)
+		std::cout << std::setw(12) << SimdLevelName((SimdLevel)level);
+	std::cout << std::setw(10) << "speedup" << std::setw(12) << "mismatch" << std::endl;
+
+	for (int k = 0; k < 3; k++) {
+		// one object at a time, the reference for both time and result
+		std::vector<float> reference(numRays), times(numRays);
+		Timer timer;
+		for (int r = 0; r < numRays; r++) {
+			IntersectInfo info;
+			for (int i = 0; i < numShapes; i++)
+				shapes[k].Intersect(shapes[k][i], rays[r], info, inf);
+			reference[r] = info.time;
+		}
+		double single = timer.Seconds() * 1e9 / ((double)numRays * numShapes);
+		std::cout << std::setw(10) << names[k] << std::setw(12) << std::setprecision(2) << single;
+
+		std::vector<PrimitiveRef> refs;
+		for (int i = 0; i < numShapes; i++)
+			refs.push_back(shapes[k][i]);
+		Buffer<PrimitiveBlock> blocks;
+		PackBlocks(shapes[k], &refs[0], numShapes, blocks);
+
+		double time = single;
+		int mismatch = 0;
+		for (int level = SIMD_SCALAR; level <= best; level++) {
+			SetSimdLevel((SimdLevel)level);
+			time = time_blocks(shapes[k], blocks, rays, times);
+			for (int r = 0; r < numRays; r++)
+				if (times[r] != reference[r])
+					mismatch++;
+			std::cout << std::setw(12) << time;
+		}
+		std::cout << std::setw(9) << std::setprecision(1) << single / time << "x" << std::setw(12) << mismatch << std::endl;
+	}
+	SetSimdLevel(previous);
+}
+#pragma endregion
+
+#pragma region Primary Rays
+void benchmark_camera(Camera camera) {
+	camera.Update();
+	int width = camera.width, height = camera.height;
+	const int frames = 5;
+
+	// previous approach, two unprojections with the inverted matrices per pixel
+	glm::mat4 viewMatrix = glm::lookAt(camera.position, camera.target, camera.up);
+	glm::mat4 projMatrix = glm::perspective(camera.fov, (float)width / (float)height, 1.0f, 10000.0f);
+	std::vector<Ray> reference;
+	glm::vec3 sum(0.f);
+
+	Timer timer;
+	for (int f = 0; f < frames; f++)
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				float pixelX = 2 * ((x + 0.5f) / width) - 1;
+				float pixelY = -2 * ((y + 0.5f) / height) + 1;
+
+				glm::vec4 worldNear = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, -1, 1);
+				glm::vec4 worldFar = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, 1, 1);
+
+				glm::vec3 worldNearPos = glm::vec3(worldNear.x, worldNear.y, worldNear.z) / worldNear.w;
+				glm::vec3 worldFarPos = glm::vec3(worldFar.x, worldFar.y, worldFar.z) / worldFar.w;
+
+				Ray ray(worldNearPos, glm::normalize(glm::vec3(worldFarPos - worldNearPos)));
+				sum += ray.direction;
+				if (f == 0) reference.push_back(ray);
+			}
+	double unprojectTime = timer.Seconds() * 1e9 / ((double)frames * width * height);
+
+	// camera, stepping along each row
+	float maxError = 0.f;
+	timer.Reset();
+	for (int f = 0; f < frames; f++)
+		for (int y = 0; y < height; y++) {
+			glm::vec3 direction = camera.PixelDirection(0, y);
+			for (int x = 0; x < width; x++, direction += camera.stepX) {
+				Ray ray = camera.GenerateRay(direction);
+				sum += ray.direction;
+				if (f == 0) {
+					const Ray &r = reference[x + y * width];
+					maxError = std::max(maxError, glm::length(ray.direction - r.direction));
+				}
+			}
+		}
+	double cameraTime = timer.Seconds() * 1e9 / ((double)frames * width * height);
+
+	std::cout << std::fixed << width << "x" << height << " primary rays" << std::endl
+		<< std::setw(12) << "unproject" << std::setw(10) << std::setprecision(1) << unprojectTime << " ns/ray" << std::endl
+		<< std::setw(12) << "camera" << std::setw(10) << cameraTime << " ns/ray" << std::endl
+		<< std::setw(12) << "speedup" << std::setw(10) << unprojectTime / cameraTime << "x" << std::endl
+		<< std::setw(12) << "max error" << std::setw(10) << std::scientific << std::setprecision(2) << maxError
+		<< " (checksum " << sum.x + sum.y + sum.z << ")" << std::endl;
+}
+#pragma endregion
+
+#pragma region Ray Packets
+void benchmark_packets(int count) {
+	const int size = 512;
+	const float inf = std::numeric_limits<float>::infinity();
+	// geometry only, nothing is shaded
+	MaterialID material = 0;
+	PrimitiveList primitives;
+	random_scene(primitives, count, material);
+	BVH bvh;
+	bvh.Build(primitives);
+
+	Camera camera(glm::vec3(0.f, 0.f, -60.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f), 45.f, size, size);
+	glm::vec3 light(30.f, 40.f, -50.f);
+
+	// primary rays one by one, their hits are the reference for the packets
+	std::vector<IntersectInfo> reference(size * size);
+	Timer timer;
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+			bvh.Intersect(camera.GenerateRay(x, y), reference[x + y * size], inf);
+	double singleTime = timer.Seconds() * 1e9 / (size * size);
+
+	// shadow rays from every hit towards the light
+	std::vector<Ray> shadowRays;
+	std::vector<float> distances;
+	for (int i = 0; i < size * size; i++)
+		if (reference[i].time != inf) {
+			glm::vec3 origin = reference[i].hitPoint + reference[i].normal * .01f;
+			shadowRays.push_back(Ray(origin, light - origin));
+			distances.push_back(glm::length(light - origin));
+		}
+	int numShadow = (int)shadowRays.size() / PACKET_SIZE * PACKET_SIZE;
+	std::vector<bool> occluded(numShadow);
+	timer.Reset();
+	for (int i = 0; i < numShadow; i++)
+		occluded[i] = bvh.Occluded(shadowRays[i], distances[i]);
+	double singleShadowTime = timer.Seconds() * 1e9 / std::max(1, numShadow);
+
+	// the same rays in packets of neighbouring pixels
+	int mismatch = 0;
+	RayPacket packet;
+	IntersectInfo infos[PACKET_SIZE];
+	timer.Reset();
+	for (int y0 = 0; y0 < size; y0 += PACKET_WIDTH)
+		for (int x0 = 0; x0 < size; x0 += PACKET_WIDTH) {
+			packet.Clear();
+			for (int y = y0; y < y0 + PACKET_WIDTH; y++)
+				for (int x = x0; x < x0 + PACKET_WIDTH; x++)
+					infos[packet.Add(camera.GenerateRay(x, y))] = IntersectInfo();
+			bvh.IntersectPacket(packet, infos, inf);
+			for (int i = 0; i < PACKET_SIZE; i++)
+				if (infos[i].time != reference[x0 + i % PACKET_WIDTH + (y0 + i / PACKET_WIDTH) * size].time)
+					mismatch++;
+		}
+	double packetTime = timer.Seconds() * 1e9 / (size * size);
+
+	// shadow rays keep the order of the pixels they start from, so consecutive rays are coherent too
+	int shadowMismatch = 0, blocked = 0;
+	timer.Reset();
+	for (int first = 0; first < numShadow; first += PACKET_SIZE) {
+		packet.Clear();
+		for (int i = first; i < first + PACKET_SIZE; i++)
+			packet.Add(shadowRays[i]);
+		RayMask mask = bvh.OccludedPacket(packet, &distances[first]);
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			bool blocked_i = (mask & (1u << i)) != 0;
+			if (blocked_i != occluded[first + i])
+				shadowMismatch++;
+			if (blocked_i) blocked++;
+		}
+	}
+	double packetShadowTime = timer.Seconds() * 1e9 / std::max(1, numShadow);
+
+	std::cout << std::fixed << count << " objects, " << size << "x" << size << " primary rays, "
+		<< PACKET_WIDTH << "x" << PACKET_WIDTH << " packets" << std::endl
+		<< std::setw(10) << "rays" << std::setw(12) << "count" << std::setw(16) << "single ns/ray"
+		<< std::setw(16) << "packet ns/ray" << std::setw(10) << "speedup" << std::setw(12) << "mismatch" << std::endl;
+	std::cout << std::setw(10) << "primary" << std::setw(12) << size * size << std::setw(16) << std::setprecision(1) << singleTime
+		<< std::setw(16) << packetTime << std::setw(9) << singleTime / packetTime << "x" << std::setw(12) << mismatch << std::endl;
+	std::cout << std::setw(10) << "shadow" << std::setw(12) << numShadow << std::setw(16) << singleShadowTime
+		<< std::setw(16) << packetShadowTime << std::setw(9) << singleShadowTime / packetShadowTime << "x" << std::setw(12) << shadowMismatch
+		<< " (" << std::setprecision(0) << 100.0 * blocked / std::max(1, numShadow) << "% blocked)" << std::endl;
+}
+#pragma endregion
+
+#pragma region Meshes
+/*
+ * sphere of radius 10 made of about count triangles, with smooth normals
+ */
+static void sphere_mesh(TriangleMesh &mesh, int count) {
+	const float PI = 3.14159265f;
+	int rings = std::max(2, (int)sqrt(count / 4.0)), segments = 2 * rings;
+	for (int r = 0; r <= rings; r++) {
+		float theta = PI * r / rings;
+		for (int s = 0; s <= segments; s++) {
+			float phi = 2.f * PI * s / segments;
+			glm::vec3 n(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+			mesh.positions.push_back(n * 10.f);
+			mesh.normals.push_back(n);
+			mesh.uvs.push_back(glm::vec2((float)s / segments, (float)r / rings));
+		}
+	}
+	for (int r = 0; r < rings; r++)
+		for (int s = 0; s < segments; s++) {
+			unsigned int a = r * (segments + 1) + s, b = a + segments + 1;
+			unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+			// the rings at the poles collapse to a point, keep only their non degenerate halves
+			for (int k = r == 0 ? 3 : 0; k < (r == rings - 1 ? 3 : 6); k++)
+				mesh.indices.push_back(quad[k]);
+		}
+}
+
+/*
+ * the sphere as one mesh under the given builder: build time, memory, time per ray and the rays whose
+ * hit differs from times (those of the separate objects)
+ */
+static void measure_mesh(int count, BVHBuildMethod method, const std::vector<Ray> &rays, const std::vector<float> &times,
+	const char *name) {
+	BVHBuildMethod previous = getBVHBuildMethod();
+	SetBVHBuildMethod(method);
+	TriangleMesh mesh(0);
+	sphere_mesh(mesh, count);
+	int triangles = mesh.getTriangleCount();
+	PrimitiveList meshes;
+	Timer timer;
+	meshes.Add(mesh);
+	BVH meshBVH;
+	meshBVH.Build(meshes);
+	double build = timer.Milliseconds();
+	SetBVHBuildMethod(previous);
+	size_t memory = meshes.meshes[0].getMemoryUsage() + meshBVH.getMemoryUsage();
+
+	const float inf = std::numeric_limits<float>::infinity();
+	int mismatch = 0;
+	timer.Reset();
+	for (size_t i = 0; i < rays.size(); i++) {
+		IntersectInfo info;
+		meshBVH.Intersect(rays[i], info, inf);
+		if (fabs(info.time - times[i]) > 1e-4f * times[i])
+			mismatch++;
+	}
+	double time = timer.Seconds() * 1e9 / rays.size();
+	std::cout << std::setw(10) << name << std::setw(12) << std::setprecision(1) << build
+		<< std::setw(14) << (double)memory / triangles << std::setw(12) << time << std::setw(10) << mismatch << std::endl;
+}
+
+void benchmark_mesh(int count) {
+	const int numRays = 20000;
+	MaterialID material = 0;
+	TriangleMesh mesh(material);
+	sphere_mesh(mesh, count);
+	int triangles = mesh.getTriangleCount();
+
+	// the same triangles as separate objects
+	PrimitiveList objects;
+	for (int i = 0; i < triangles; i++)
+		objects.Add(Triangle(mesh.positions[mesh.indices[3 * i]], mesh.positions[mesh.indices[3 * i + 1]],
+			mesh.positions[mesh.indices[3 * i + 2]], material));
+	Timer timer;
+	BVH objectsBVH;
+	objectsBVH.Build(objects);
+	double objectsBuild = timer.Milliseconds();
+	size_t objectsMemory = objects.triangles.capacity() * sizeof(Triangle) + objectsBVH.getMemoryUsage();
+
+	// rays from a surrounding shell towards the inside of the sphere
+	Random random(13);
+	std::vector<Ray> rays;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin = glm::normalize(random.Point(-1.f, 1.f)) * 30.f;
+		rays.push_back(Ray(origin, glm::normalize(random.Point(-8.f, 8.f) - origin)));
+	}
+	const float inf = std::numeric_limits<float>::infinity();
+	std::vector<float> times(numRays);
+
+	timer.Reset();
+	for (int i = 0; i < numRays; i++) {
+		IntersectInfo info;
+		objectsBVH.Intersect(rays[i], info, inf);
+		times[i] = info.time;
+	}
+	double objectsTime = timer.Seconds() * 1e9 / numRays;
+
+	std::cout << std::fixed << triangles << " triangles" << std::endl
+		<< std::setw(10) << "" << std::setw(12) << "build ms" << std::setw(14) << "bytes/tri" << std::setw(12) << "ns/ray"
+		<< std::setw(10) << "mismatch" << std::endl
+		<< std::setw(10) << "objects" << std::setw(12) << std::setprecision(1) << objectsBuild
+		<< std::setw(14) << (double)objectsMemory / triangles << std::setw(12) << objectsTime << std::endl;
+	measure_mesh(count, getBVHBuildMethod(), rays, times, "mesh");
+	// spatial splits list triangles in several leaves, which the mesh then keeps references for
+	measure_mesh(count, BVH_BUILD_SBVH, rays, times, "mesh sbvh");
+}
+
+void benchmark_build(int count, ThreadPool &pool) {
+	MaterialID material = 0;
+	PrimitiveList objects;
+	random_scene(objects, count, material);
+	TriangleMesh mesh(material);
+	sphere_mesh(mesh, count);
+
+	std::cout << std::fixed << count << " objects, " << mesh.getTriangleCount() << " mesh triangles, " << pool.getThreadCount() << " threads" << std::endl
+		<< std::setw(10) << "" << std::setw(12) << "1 thread" << std::setw(12) << "pool" << std::setw(10) << "speedup"
+		<< std::setw(10) << "nodes" << std::setw(10) << "SAH" << std::endl;
+
+	BVH serial, parallel(SIMD_BLOCK_SIZE, &pool);
+	Timer timer;
+	serial.Build(objects);
+	double serialBuild = timer.Milliseconds();
+	timer.Reset();
+	parallel.Build(objects);
+	double parallelBuild = timer.Milliseconds();
+	std::cout << std::setw(10) << "objects" << std::setw(10) << std::setprecision(1) << serialBuild << "ms" << std::setw(10) << parallelBuild << "ms"
+		<< std::setw(9) << serialBuild / parallelBuild << "x" << std::setw(10) << parallel.getNodeCount()
+		<< std::setw(10) << std::setprecision(2) << parallel.getSAHCost() << std::endl;
+	if (serial.getNodeCount() != parallel.getNodeCount() || serial.getSAHCost() != parallel.getSAHCost())
+		std::cout << "the builds differ" << std::endl;
+
+	timer.Reset();
+	mesh.Build();
+	double meshSerial = timer.Milliseconds();
+	timer.Reset();
+	mesh.Build(&pool);
+	double meshParallel = timer.Milliseconds();
+	std::cout << std::setw(10) << "mesh" << std::setw(10) << std::setprecision(1) << meshSerial << "ms" << std::setw(10) << meshParallel << "ms"
+		<< std::setw(9) << meshSerial / meshParallel << "x" << std::endl;
+}
+#pragma endregion
+
+#pragma region Builders
+/*
+ * Rays from a shell around the sphere mesh towards its inside, returns the average time per ray in nanoseconds
+ */
+// times holds the hit time of every ray afterwards
+static double time_sphere_rays(const Accelerator &accelerator, int numRays, std::vector<float> &times) {
+	Random random(13);
+	times.resize(numRays);
+	Timer timer;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 origin = glm::normalize(random.Point(-1.f, 1.f)) * 30.f;
+		Ray ray(origin, glm::normalize(random.Point(-8.f, 8.f) - origin));
+		IntersectInfo info;
+		accelerator.Intersect(ray, info, std::numeric_limits<float>::infinity());
+		times[i] = info.time;
+	}
+	return timer.Seconds() * 1e9 / numRays;
+}
+
+void benchmark_builders(int count, ThreadPool &pool) {
+	const int numRays = 200000;
+	MaterialID material = 0;
+	PrimitiveList objects;
+	random_scene(objects, count, material);
+	TriangleMesh sphere(material);
+	sphere_mesh(sphere, count);
+
+	std::cout << std::fixed << count << " objects, " << sphere.getTriangleCount() << " mesh triangles, " << pool.getThreadCount() << " threads" << std::endl
+		<< std::setw(16) << "" << std::setw(12) << "build ms" << std::setw(10) << "nodes" << std::setw(10) << "SAH"
+		<< std::setw(12) << "ns/ray" << std::setw(12) << "shadow" << std::setw(14) << "mesh build" << std::setw(12) << "ns/ray" << std::endl;
+
+	// hits of the mesh under the SAH build, the other builders (spatial splits too) must find the same
+	std::vector<float> sahTimes, times;
+	BVHBuildMethod previous = getBVHBuildMethod();
+	for (int method = BVH_BUILD_SAH; method <= BVH_BUILD_SBVH; method++) {
+		SetBVHBuildMethod((BVHBuildMethod)method);
+		BVH bvh(SIMD_BLOCK_SIZE, &pool);
+		Timer timer;
+		bvh.Build(objects);
+		double build = timer.Milliseconds();
+		double rayTime = time_rays(bvh, numRays);
+		int blocked;
+		double shadowTime = time_shadow_rays(bvh, numRays, true, blocked);
+
+		TriangleMesh mesh = sphere;
+		timer.Reset();
+		mesh.Build(&pool);
+		double meshBuild = timer.Milliseconds();
+		PrimitiveList meshes;
+		meshes.Add(mesh);
+		BVH meshBVH;
+		meshBVH.Build(meshes);
+		double meshTime = time_sphere_rays(meshBVH, numRays, method == BVH_BUILD_SAH ? sahTimes : times);
+
+		std::cout << std::setw(16) << BVHBuildMethodName((BVHBuildMethod)method) << std::setw(12) << std::setprecision(1) << build
+			<< std::setw(10) << bvh.getNodeCount() << std::setw(10) << std::setprecision(2) << bvh.getSAHCost()
+			<< std::setw(12) << std::setprecision(0) << rayTime << std::setw(12) << shadowTime
+			<< std::setw(14) << std::setprecision(1) << meshBuild << std::setw(12) << std::setprecision(0) << meshTime << std::endl;
+		if (method != BVH_BUILD_SAH) {
+			int mismatch = 0;
+			for (int i = 0; i < numRays; i++)
+				if (fabs(times[i] - sahTimes[i]) > 1e-4f * sahTimes[i])
+					mismatch++;
+			if (mismatch)
+				std::cout << "the mesh hits differ from the SAH build's on " << mismatch << " rays" << std::endl;
+		}
+	}
+	SetBVHBuildMethod(previous);
+}
+#pragma endregion
+
+#pragma region Wide BVH
+void benchmark_wide(int count) {
+	const int numRays = 100000;
+	MaterialID material = 0;
+	PrimitiveList primitives;
+	random_scene(primitives, count, material);
+
+	BVH bvh;
+	BVH4 bvh4;
+	BVH8 bvh8;
+	BVH4Q bvh4q;
+	BVH8Q bvh8q;
+	const int numAccels = 5;
+	Accelerator *accels[numAccels] = { &bvh, &bvh4, &bvh8, &bvh4q, &bvh8q };
+	double build[numAccels];
+	for (int a = 0; a < numAccels; a++) {
+		Timer timer;
+		accels[a]->Build(primitives);
+		build[a] = timer.Milliseconds();
+	}
+	int nodes[numAccels] = { bvh.getNodeCount(), bvh4.getNodeCount(), bvh8.getNodeCount(), bvh4q.getNodeCount(), bvh8q.getNodeCount() };
+	size_t nodeMemory[numAccels] = { bvh.getNodeMemoryUsage(), bvh4.getNodeMemoryUsage(), bvh8.getNodeMemoryUsage(),
+		bvh4q.getNodeMemoryUsage(), bvh8q.getNodeMemoryUsage() };
+	size_t memory[numAccels] = { bvh.getMemoryUsage(), bvh4.getMemoryUsage(), bvh8.getMemoryUsage(),
+		bvh4q.getMemoryUsage(), bvh8q.getMemoryUsage() };
+	float cost[numAccels] = { bvh.getSAHCost(), bvh4.getSAHCost(), bvh8.getSAHCost(), bvh4q.getSAHCost(), bvh8q.getSAHCost() };
+
+	// the wide trees have to find the same hits as the binary one
+	Random random(7);
+	int mismatch = 0;
+	for (int i = 0; i < 10000; i++) {
+		glm::vec3 origin(random.Range(-30.f, 30.f), random.Range(-30.f, 30.f), -60.f);
+		Ray ray(origin, glm::normalize(random.Point(-20.f, 20.f) - origin));
+		IntersectInfo reference;
+		bvh.Intersect(ray, reference, std::numeric_limits<float>::infinity());
+		for (int a = 1; a < numAccels; a++) {
+			IntersectInfo info;
+			accels[a]->Intersect(ray, info, std::numeric_limits<float>::infinity());
+			if (info.time != reference.time) mismatch++;
+		}
+	}
+
+	std::cout << std::fixed << count << " objects, " << SimdLevelName(getSimdLevel()) << " kernels" << std::endl
+		<< std::setw(8) << "" << std::setw(12) << "build ms" << std::setw(10) << "nodes" << std::setw(12) << "node B/obj"
+		<< std::setw(12) << "bytes/obj" << std::setw(10) << "SAH" << std::setw(12) << "ns/ray" << std::setw(12) << "shadow" << std::endl;
+	for (int a = 0; a < numAccels; a++) {
+		// best of three runs, the differences are smaller than the noise of a single one
+		double rayTime = time_rays(*accels[a], numRays), shadowTime = 0.0;
+		for (int run = 0; run < 3; run++) {
+			int blocked;
+			if (run > 0) rayTime = std::min(rayTime, time_rays(*accels[a], numRays));
+			double shadow = time_shadow_rays(*accels[a], numRays, true, blocked);
+			shadowTime = run == 0 ? shadow : std::min(shadowTime, shadow);
+		}
+		std::cout << std::setw(8) << accels[a]->getName() << std::setw(12) << std::setprecision(1) << build[a]
+			<< std::setw(10) << nodes[a] << std::setw(12) << (double)nodeMemory[a] / count << std::setw(12) << (double)memory[a] / count
+			<< std::setw(10) << std::setprecision(2) << cost[a] << std::setw(12) << std::setprecision(0) << rayTime
+			<< std::setw(12) << shadowTime << std::endl;
+	}
+	std::cout << "mismatch " << mismatch << std::endl;
+}
+#pragma endregion
+
+#pragma region Spatial Splits
+/*
+ * building of 4 storeys over 40x40 units: a floor per storey, walls running the whole length of the
+ * building every 4 units along x and z, a few slanted walls, and count small objects as furniture
+ */
+static void building_scene(PrimitiveList &primitives, int count, MaterialID material) {
+	Random random(5);
+	const int storeys = 4;
+	const float height = 3.f;
+	for (int s = 0; s < storeys; s++) {
+		float y = s * height;
+		primitives.Add(Plane(glm::vec3(-20.f, y, -20.f), glm::vec3(20.f, y, -20.f), glm::vec3(20.f, y, 20.f), glm::vec3(-20.f, y, 20.f), material));
+		for (float w = -16.f; w <= 16.f; w += 4.f) {
+			primitives.Add(Plane(glm::vec3(w, y, -20.f), glm::vec3(w, y + height, -20.f), glm::vec3(w, y + height, 20.f), glm::vec3(w, y, 20.f), material));
+			primitives.Add(Plane(glm::vec3(-20.f, y, w), glm::vec3(-20.f, y + height, w), glm::vec3(20.f, y + height, w), glm::vec3(20.f, y, w), material));
+		}
+		for (int k = 0; k < 4; k++) {
+			glm::vec3 a(random.Range(-20.f, 0.f), y, random.Range(-20.f, 20.f));
+			glm::vec3 b(random.Range(0.f, 20.f), y, random.Range(-20.f, 20.f));
+			primitives.Add(Plane(a, a + glm::vec3(0.f, height, 0.f), b + glm::vec3(0.f, height, 0.f), b, material));
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		glm::vec3 p(random.Range(-20.f, 20.f), random.Range(0.f, storeys * height), random.Range(-20.f, 20.f));
+		if (i % 2)
+			primitives.Add(Sphere(p, random.Range(.05f, .2f), material));
+		else
+			primitives.Add(Triangle(p, p + random.Point(-.3f, .3f), p + random.Point(-.3f, .3f), material));
+	}
+}
+
+/*
+ * rays between random points inside the building, closest hit or occlusion,
+ * returns the average time per ray in nanoseconds
+ */
+static double time_building_rays(const Accelerator &accelerator, int numRays, bool occlusion) {
+	Random random(17);
+	Timer timer;
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 from(random.Range(-20.f, 20.f), random.Range(0.f, 12.f), random.Range(-20.f, 20.f));
+		glm::vec3 to(random.Range(-20.f, 20.f), random.Range(0.f, 12.f), random.Range(-20.f, 20.f));
+		Ray ray(from, to - from);
+		if (occlusion)
+			accelerator.Occluded(ray, glm::length(to - from));
+		else {
+			IntersectInfo info;
+			accelerator.Intersect(ray, info, std::numeric_limits<float>::infinity());
+		}
+	}
+	return timer.Seconds() * 1e9 / numRays;
+}
+
+void benchmark_spatial(int count) {
+	const int numRays = 200000;
+	MaterialID material = 0;
+	PrimitiveList primitives;
+	building_scene(primitives, count, material);
+
+	std::cout << std::fixed << primitives.size() << " objects in a building" << std::endl
+		<< std::setw(10) << "" << std::setw(12) << "build ms" << std::setw(10) << "nodes" << std::setw(12) << "bytes/obj"
+		<< std::setw(10) << "SAH" << std::setw(12) << "ns/ray" << std::setw(12) << "shadow" << std::endl;
+
+	BVHBuildMethod previous = getBVHBuildMethod();
+	BVHBuildMethod methods[2] = { BVH_BUILD_SAH, BVH_BUILD_SBVH };
+	BVH reference;
+	for (int m = 0; m < 2; m++) {
+		SetBVHBuildMethod(methods[m]);
+		BVH bvh;
+		Timer timer;
+		bvh.Build(primitives);
+		double build = timer.Milliseconds();
+		// best of three runs
+		double rayTime = 0.0, shadowTime = 0.0;
+		for (int run = 0; run < 3; run++) {
+			double rays = time_building_rays(bvh, numRays, false), shadow = time_building_rays(bvh, numRays, true);
+			rayTime = run == 0 ? rays : std::min(rayTime, rays);
+			shadowTime = run == 0 ? shadow : std::min(shadowTime, shadow);
+		}
+		std::cout << std::setw(10) << BVHBuildMethodName(methods[m]) << std::setw(12) << std::setprecision(1) << build
+			<< std::setw(10) << bvh.getNodeCount() << std::setw(12) << (double)bvh.getMemoryUsage() / primitives.size()
+			<< std::setw(10) << std::setprecision(2) << bvh.getSAHCost() << std::setw(12) << std::setprecision(0) << rayTime
+			<< std::setw(12) << shadowTime << std::endl;
+
+		if (m == 0) {
+			reference.Build(primitives);
+			continue;
+		}
+		// the cut references have to find the same hits
+		Random random(19);
+		int mismatch = 0;
+		for (int i = 0; i < 10000; i++) {
+			glm::vec3 from(random.Range(-20.f, 20.f), random.Range(0.f, 12.f), random.Range(-20.f, 20.f));
+			Ray ray(from, glm::normalize(random.Point(-1.f, 1.f)));
+			IntersectInfo expected, info;
+			reference.Intersect(ray, expected, std::numeric_limits<float>::infinity());
+			bvh.Intersect(ray, info, std::numeric_limits<float>::infinity());
+			if (info.time != expected.time) mismatch++;
+		}
+		std::cout << "mismatch " << mismatch << std::endl;
+	}
+	SetBVHBuildMethod(previous);
+}
+#pragma endregion
+
+#pragma region Grids
+/*
+ * builds the structures over the objects and reports build time, size and ray times,
+ * checking that every one finds the hits of the first
+ */
+static void compare_accelerators(const PrimitiveList &objects, Accelerator **accels, int count, bool building) {
+	const int numRays = 100000;
+	std::cout << std::setw(8) << "" << std::setw(12) << "build ms" << std::setw(12) << "bytes/obj"
+		<< std::setw(12) << "ns/ray" << std::setw(12) << "shadow" << std::setw(10) << "mismatch" << std::endl;
+	for (int a = 0; a < count; a++) {
+		Timer timer;
+		accels[a]->Build(objects);
+		double build = timer.Milliseconds();
+		size_t memory = 0;
+		if (BVH *bvh = dynamic_cast<BVH*>(accels[a])) memory = bvh->getMemoryUsage();
+		else if (BVH8 *bvh8 = dynamic_cast<BVH8*>(accels[a])) memory = bvh8->getMemoryUsage();
+		else if (Grid *grid = dynamic_cast<Grid*>(accels[a])) memory = grid->getMemoryUsage();
+
+		// best of three runs
+		double rayTime = 0.0, shadowTime = 0.0;
+		for (int run = 0; run < 3; run++) {
+			double rays, shadow;
+			if (building) {
+				rays = time_building_rays(*accels[a], numRays, false);
+				shadow = time_building_rays(*accels[a], numRays, true);
+			}
+			else {
+				int blocked;
+				rays = time_rays(*accels[a], numRays);
+				shadow = time_shadow_rays(*accels[a], numRays, true, blocked);
+			}
+			rayTime = run == 0 ? rays : std::min(rayTime, rays);
+			shadowTime = run == 0 ? shadow : std::min(shadowTime, shadow);
+		}
+
+		Random random(23);
+		int mismatch = 0;
+		for (int i = 0; i < 10000 && a > 0; i++) {
+			glm::vec3 from = building ? glm::vec3(random.Range(-20.f, 20.f), random.Range(0.f, 12.f), random.Range(-20.f, 20.f))
+				: glm::vec3(random.Range(-30.f, 30.f), random.Range(-30.f, 30.f), -60.f);
+			Ray ray(from, glm::normalize(random.Point(-20.f, 20.f) - from));
+			IntersectInfo expected, info;
+			accels[0]->Intersect(ray, expected, std::numeric_limits<float>::infinity());
+			accels[a]->Intersect(ray, info, std::numeric_limits<float>::infinity());
+			if (info.time != expected.time) mismatch++;
+		}
+
+		std::cout << std::setw(8) << accels[a]->getName() << std::setw(12) << std::setprecision(1) << build
+			<< std::setw(12) << (double)memory / objects.size() << std::setw(12) << std::setprecision(0) << rayTime
+			<< std::setw(12) << shadowTime << std::setw(10) << mismatch << std::endl;
+	}
+}
+
+void benchmark_grid(int count, ThreadPool &pool) {
+	MaterialID material = 0;
+	BVH bvh(SIMD_BLOCK_SIZE, &pool);
+	BVH8 bvh8(&pool);
+	Grid grid(1, &pool), grid2(2, &pool);
+	Accelerator *accels[4] = { &bvh, &bvh8, &grid, &grid2 };
+
+	PrimitiveList objects;
+	random_scene(objects, count, material);
+	std::cout << std::fixed << count << " random objects, " << pool.getThreadCount() << " threads" << std::endl;
+	compare_accelerators(objects, accels, 4, false);
+
+	PrimitiveList building;
+	building_scene(building, count, material);
+	std::cout << building.size() << " objects in a building" << std::endl;
+	compare_accelerators(building, accels, 4, true);
+}
+#pragma endregion
+
+#pragma region Kd-tree
+/*
+ * rays of the random or building benchmark reflected at their hits, as CastReflection makes them,
+ * with the cell the hits were found in
+ */
+static void reflected_rays(const Accelerator &accelerator, int numRays, bool building, std::vector<Ray> &rays, std::vector<int> &cells) {
+	Random random(29);
+	for (int i = 0; i < numRays; i++) {
+		glm::vec3 from = building ? glm::vec3(random.Range(-20.f, 20.f), random.Range(0.f, 12.f), random.Range(-20.f, 20.f))
+			: glm::vec3(random.Range(-30.f, 30.f), random.Range(-30.f, 30.f), -60.f);
+		Ray ray(from, glm::normalize(random.Point(-20.f, 20.f) - from));
+		IntersectInfo info;
+		if (!accelerator.Intersect(ray, info, std::numeric_limits<float>::infinity())) continue;
+		glm::vec3 direction = ray.direction - info.normal * 2.f * glm::dot(info.normal, ray.direction);
+		rays.push_back(Ray(info.hitPoint + info.normal * .1f, direction));
+		cells.push_back(info.cell);
+	}
+}
+
+// average time per ray in nanoseconds, each ray starting in its cell if cells is given
+static double time_secondary_rays(const Accelerator &accelerator, const std::vector<Ray> &rays, const std::vector<int> *cells) {
+	Timer timer;
+	for (unsigned int i = 0; i < rays.size(); i++) {
+		IntersectInfo info;
+		accelerator.IntersectFrom(rays[i], cells ? (*cells)[i] : -1, info, std::numeric_limits<float>::infinity());
+	}
+	return timer.Seconds() * 1e9 / std::max((int)rays.size(), 1);
+}
+
+static void compare_kdtree(const PrimitiveList &objects, bool building) {
+	const int numRays = 100000;
+	BVH bvh;
+	KdTree kd;
+	Timer timer;
+	bvh.Build(objects);
+	double bvhBuild = timer.Milliseconds();
+	timer.Reset();
+	kd.Build(objects);
+	double kdBuild = timer.Milliseconds();
+
+	std::vector<Ray> rays;
+	std::vector<int> cells;
+	reflected_rays(kd, numRays, building, rays, cells);
+	int mismatch = 0;
+	for (unsigned int i = 0; i < rays.size(); i++) {
+		IntersectInfo expected, info, fromCell;
+		bvh.Intersect(rays[i], expected, std::numeric_limits<float>::infinity());
+		kd.Intersect(rays[i], info, std::numeric_limits<float>::infinity());
+		kd.IntersectFrom(rays[i], cells[i], fromCell, std::numeric_limits<float>::infinity());
+		if (info.time != expected.time || fromCell.time != expected.time) mismatch++;
+	}
+
+	std::cout << std::setw(8) << "" << std::setw(12) << "build ms" << std::setw(10) << "nodes" << std::setw(12) << "bytes/obj"
+		<< std::setw(10) << "ns/ray" << std::setw(10) << "shadow" << std::setw(12) << "reflected" << std::setw(12) << "from cell" << std::endl;
+	Accelerator *accels[2] = { &bvh, &kd };
+	for (int a = 0; a < 2; a++) {
+		// best of three runs
+		double rayTime = 0.0, shadowTime = 0.0, reflectedTime = 0.0, cellTime = 0.0;
+		for (int run = 0; run < 3; run++) {
+			double times[4];
+			if (building) {
+				times[0] = time_building_rays(*accels[a], numRays, false);
+				times[1] = time_building_rays(*accels[a], numRays, true);
+			}
+			else {
+				int blocked;
+				times[0] = time_rays(*accels[a], numRays);
+				times[1] = time_shadow_rays(*accels[a], numRays, true, blocked);
+			}
+			times[2] = time_secondary_rays(*accels[a], rays, NULL);
+			times[3] = time_secondary_rays(*accels[a], rays, &cells);
+			rayTime = run == 0 ? times[0] : std::min(rayTime, times[0]);
+			shadowTime = run == 0 ? times[1] : std::min(shadowTime, times[1]);
+			reflectedTime = run == 0 ? times[2] : std::min(reflectedTime, times[2]);
+			cellTime = run == 0 ? times[3] : std::min(cellTime, times[3]);
+		}
+		bool isKd = accels[a] == &kd;
+		std::cout << std::setw(8) << accels[a]->getName() << std::setw(12) << std::setprecision(1) << (isKd ? kdBuild : bvhBuild)
+			<< std::setw(10) << (isKd ? kd.getNodeCount() : bvh.getNodeCount())
+			<< std::setw(12) << (double)(isKd ? kd.getMemoryUsage() : bvh.getMemoryUsage()) / objects.size()
+			<< std::setprecision(0) << std::setw(10) << rayTime << std::setw(10) << shadowTime
+			<< std::setw(12) << reflectedTime << std::setw(12) << cellTime << std::endl;
+	}
+	std::cout << rays.size() << " reflected rays, " << mismatch << " hits differ from the BVH's" << std::endl;
+}
+
+void benchmark_kdtree(int count) {
+	MaterialID material = 0;
+	PrimitiveList objects;
+	random_scene(objects, count, material);
+	std::cout << std::fixed << count << " random objects" << std::endl;
+	compare_kdtree(objects, false);
+
+	PrimitiveList building;
+	building_scene(building, count, material);
+	std::cout << building.size() << " objects in a building" << std::endl;
+	compare_kdtree(building, true);
+}
+#pragma endregion
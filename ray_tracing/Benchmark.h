@@ -0,0 +1,80 @@
+#pragma once
+
+#include "PrimitiveList.h"
+#include "Camera.h"
+#include "ThreadPool.h"
+#include <vector>
+
+/*
+ * Benchmarks, run from the command line instead of the interactive renderer
+ */
+
+/*
+ * fills the list with count random spheres, triangles and planes inside a 40x40x40 cube
+ */
+void random_scene(PrimitiveList &primitives, int count, MaterialID material, unsigned int seed = 1);
+
+/*
+ * compares the linear object list against the BVH on random scenes of growing size
+ */
+void benchmark_scaling(int max_objects);
+
+/*
+ * compares the ray-triangle/ray-plane kernels against the previous area based tests
+ */
+void benchmark_intersection();
+
+/*
+ * compares the SIMD block kernels at every supported level against testing objects one by one
+ */
+void benchmark_simd();
+
+/*
+ * compares primary ray generation by the camera against unprojecting every pixel
+ */
+void benchmark_camera(Camera camera);
+
+/*
+ * compares primary and shadow rays traced in packets against tracing them one by one
+ */
+void benchmark_packets(int count);
+
+/*
+ * compares a triangle mesh against the same triangles as separate objects (build time, memory, tracing)
+ */
+void benchmark_mesh(int count);
+
+/*
+ * compares BVH builds on the calling thread against builds shared out over the pool,
+ * for count random objects and a mesh of count triangles
+ */
+void benchmark_build(int count, ThreadPool &pool);
+
+/*
+ * compares the BVH build methods on count random objects and a mesh of count triangles:
+ * build time on the pool, tree size and SAH cost, and the time of closest hit and shadow rays through the trees
+ */
+void benchmark_builders(int count, ThreadPool &pool);
+
+/*
+ * compares the binary BVH against the 4 and 8 wide ones on count random objects (build, size, tracing)
+ */
+void benchmark_wide(int count);
+
+/*
+ * compares SAH and SBVH builds on a building of long walls and floors furnished with count small objects
+ * (build time, size, SAH cost, tracing)
+ */
+void benchmark_spatial(int count);
+
+/*
+ * compares the uniform and two level grids with the binary and 8 wide BVHs, all built on the pool,
+ * on count random objects and on the furnished building (build time, memory, tracing)
+ */
+void benchmark_grid(int count, ThreadPool &pool);
+
+/*
+ * compares the kd-tree with the binary BVH on count random objects and on the furnished building
+ * (build, size, tracing), reflected rays traced from the root and from the cell of the hit they leave
+ */
+void benchmark_kdtree(int count);
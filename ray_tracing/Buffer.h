@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Buffer
+ * array with the interface of std::vector that either owns its elements or refers to elements
+ * kept elsewhere (a memory-mapped scene cache), so that loaded structures are used in place.
+ * reads and writes of elements go through a plain pointer either way; anything that changes the
+ * size first copies a referenced array into owned storage.
+ * copies of an owning buffer own a copy of the elements, copies of a reference refer to the same memory
+ */
+template <class T>
+class Buffer {
+public:
+	Buffer(): items(NULL), count(0) {}
+	Buffer(const Buffer &buffer): items(NULL), count(0) { *this = buffer; }
+
+	Buffer &operator=(const Buffer &buffer) {
+		if (this == &buffer) return *this;
+		if (buffer.isReference()) {
+			std::vector<T>().swap(storage);
+			items = buffer.items;
+			count = buffer.count;
+		}
+		else {
+			storage = buffer.storage;
+			Sync();
+		}
+		return *this;
+	}
+
+	/*
+	 * refers to count elements at data without copying them, the memory has to outlive the buffer
+	 */
+	void Reference(T *data, size_t count) {
+		std::vector<T>().swap(storage);
+		items = count ? data : NULL;
+		this->count = count;
+	}
+	bool isReference() const { return count > 0 && storage.empty(); }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	// elements held in owned storage, referenced memory does not count
+	size_t capacity() const { return storage.capacity(); }
+
+	T &operator[](size_t i) { return items[i]; }
+	const T &operator[](size_t i) const { return items[i]; }
+	T *data() { return items; }
+	const T *data() const { return items; }
+	T *begin() { return items; }
+	const T *begin() const { return items; }
+	T *end() { return items + count; }
+	const T *end() const { return items + count; }
+	T &back() { return items[count - 1]; }
+	const T &back() const { return items[count - 1]; }
+
+	void push_back(const T &item) {
+		Own();
+		storage.push_back(item);
+		Sync();
+	}
+	void reserve(size_t n) {
+		Own();
+		storage.reserve(n);
+		Sync();
+	}
+	void resize(size_t n) {
+		Own();
+		storage.resize(n);
+		Sync();
+	}
+	void resize(size_t n, const T &item) {
+		Own();
+		storage.resize(n, item);
+		Sync();
+	}
+	void clear() {
+		storage.clear();
+		Sync();
+	}
+	void shrink_to_fit() {
+		Own();
+		std::vector<T>(storage).swap(storage);
+		Sync();
+	}
+	void swap(Buffer &buffer) {
+		storage.swap(buffer.storage);
+		std::swap(items, buffer.items);
+		std::swap(count, buffer.count);
+	}
+
+private:
+	// copies referenced elements into the storage
+	void Own() {
+		if (isReference()) storage.assign(items, items + count);
+	}
+	void Sync() {
+		items = storage.empty() ? NULL : &storage[0];
+		count = storage.size();
+	}
+
+	std::vector<T> storage;
+	T *items;
+	size_t count;
+};
@@ -0,0 +1,31 @@
+#include "Camera.h"
+
+Camera::Camera(glm::vec3 position, glm::vec3 target, glm::vec3 up, float fov, int width, int height):
+	position(position),
+	target(target),
+	up(up),
+	fov(fov),
+	width(width),
+	height(height)
+{
+	Update();
+}
+
+/*
+ * Same image plane as glm::lookAt + glm::perspective: pixel centres at
+ * ((x + .5) / width * 2 - 1, 1 - (y + .5) / height * 2) scaled by the half fov tangent
+ */
+void Camera::Update() {
+	glm::vec3 forward = glm::normalize(target - position);
+	glm::vec3 right = glm::normalize(glm::cross(forward, up));
+	glm::vec3 cameraUp = glm::cross(right, forward);
+
+	float tanHalf = tan(glm::radians(fov) / 2.f);
+	float aspect = (float)width / (float)height;
+	glm::vec3 halfRight = right * (tanHalf * aspect);
+	glm::vec3 halfUp = cameraUp * tanHalf;
+
+	stepX = halfRight * (2.f / width);
+	stepY = -halfUp * (2.f / height);
+	pixel00 = forward - halfRight + halfUp + (stepX + stepY) * .5f;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Ray.h"
+
+/*
+ * Pinhole Camera
+ * keeps position, target, vertical field of view and image resolution.
+ * Update() precomputes the image plane once, so primary rays are built by stepping
+ * across it instead of unprojecting every pixel
+ */
+class Camera {
+public:
+	Camera(glm::vec3 position, glm::vec3 target, glm::vec3 up, float fov, int width, int height);
+
+	// recomputes the image plane, call after changing any of the members below
+	void Update();
+
+	/*
+	 * direction (not normalised) through the centre of pixel (x, y), row 0 at the top;
+	 * neighbouring pixels are one stepX / stepY away
+	 */
+	glm::vec3 PixelDirection(int x, int y) const { return pixel00 + stepX * (float)x + stepY * (float)y; }
+	/*
+	 * primary ray for a pixel direction, it starts on the near plane (at distance 1)
+	 */
+	Ray GenerateRay(const glm::vec3 &direction) const { return Ray(position + direction, glm::normalize(direction)); }
+	Ray GenerateRay(int x, int y) const { return GenerateRay(PixelDirection(x, y)); }
+
+	glm::vec3 position;
+	glm::vec3 target;
+	glm::vec3 up;
+	// vertical field of view in degrees
+	float fov;
+	int width;
+	int height;
+
+	// image plane at distance 1 in front of the camera
+	glm::vec3 pixel00;
+	glm::vec3 stepX;
+	glm::vec3 stepY;
+};
@@ -0,0 +1,424 @@
+#include "Grid.h"
+#include "BVHBuilder.h"
+#include <cmath>
+#include <cstring>
+
+// cells per object of the uniform grid and of the grids inside top level cells
+static const float GRID_DENSITY = 2.f;
+// cells per object of the top level of the two level grid
+static const float GRID_TOP_DENSITY = 1.f / 32.f;
+// top level cells holding more objects get a grid of their own
+static const int GRID_CELL_MAX = 8;
+// cells along one axis at most
+static const int GRID_MAX_RES = 1024;
+// (cell, object) pairs of one level at most, finer levels are coarsened until their pairs fit
+static const long long GRID_PAIR_MAX = 1 << 28;
+// objects or pairs per job of the build
+static const int GRID_GRAIN = 16384;
+// entries of the mailbox, a power of two
+static const int GRID_MAILBOX_SIZE = 64;
+
+/*
+ * objects already tested against the ray, a small hash table on the stack of every query so that
+ * threads share nothing. a collision only costs a repeated test
+ */
+struct Mailbox {
+	int objects[GRID_MAILBOX_SIZE];
+	Mailbox() { memset(objects, 0xff, sizeof(objects)); }
+	// true if the object was tested before, marks it as tested otherwise
+	bool Seen(int object) {
+		int &slot = objects[object & (GRID_MAILBOX_SIZE - 1)];
+		if (slot == object) return true;
+		slot = object;
+		return false;
+	}
+};
+
+/*
+ * state of one ray through the grid
+ */
+struct Grid::Query {
+	// closest hit so far, NULL for occlusion queries
+	IntersectInfo *info;
+	float MAX;
+	bool hit;
+	Mailbox mailbox;
+};
+
+Grid::Grid(int levels, ThreadPool *pool):
+	levels(levels),
+	pool(pool),
+	primitives(NULL)
+{
+	memset(top.res, 0, sizeof(top.res));
+}
+
+#pragma region Build
+/*
+ * runs the job over count items in chunks of GRID_GRAIN, on the pool if there is one.
+ * the chunks are the same either way, so are the results
+ */
+static void run_grid_chunks(ThreadPool *pool, int count, ThreadPool::RangeTask task, void *arg) {
+	if (pool)
+		pool->ParallelFor(count, GRID_GRAIN, task, arg);
+	else
+		for (int begin = 0; begin < count; begin += GRID_GRAIN)
+			task(begin, std::min(begin + GRID_GRAIN, count), arg);
+}
+
+struct GridBoundsJob {
+	const PrimitiveList *primitives;
+	AABB *boxes;
+	// box of every chunk
+	std::vector<AABB> bounds;
+};
+
+static void grid_bounds_job(int begin, int end, void *arg) {
+	GridBoundsJob &job = *(GridBoundsJob*)arg;
+	AABB bounds;
+	for (int i = begin; i < end; i++) {
+		job.boxes[i] = job.primitives->getBounds((*job.primitives)[i]);
+		bounds.Extend(job.boxes[i]);
+	}
+	job.bounds[begin / GRID_GRAIN] = bounds;
+}
+
+/*
+ * state of the jobs filling one level: the objects' cell ranges are counted, written out as
+ * (cell, object) pairs, sorted by cell, and the cells pointed to their runs of pairs
+ */
+struct GridLevelJob {
+	const Grid::Level *level;
+	const AABB *boxes;
+	// NULL for all the objects in order
+	const int *objects;
+	// pairs of every chunk, then the first pair of the chunk
+	std::vector<long long> chunkPairs;
+	SortKey *pairs;
+	long long pairCount;
+	int *cells;
+	int *cellObjects;
+};
+
+// cell of a coordinate along one axis, clamped to the level (a NaN gives the first one)
+static inline int cell_of(const Grid::Level &level, float x, int axis) {
+	float cell = (x - level.bounds.min[axis]) * level.invCellSize[axis];
+	if (!(cell > 0.f)) return 0;
+	return cell < (float)level.res[axis] ? std::min((int)cell, level.res[axis] - 1) : level.res[axis] - 1;
+}
+
+// the cells a box overlaps along each axis
+static inline void cell_range(const Grid::Level &level, const AABB &box, int lo[3], int hi[3]) {
+	for (int a = 0; a < 3; a++) {
+		lo[a] = cell_of(level, box.min[a], a);
+		hi[a] = std::max(cell_of(level, box.max[a], a), lo[a]);
+	}
+}
+
+static void grid_count_job(int begin, int end, void *arg) {
+	GridLevelJob &job = *(GridLevelJob*)arg;
+	long long pairs = 0;
+	for (int i = begin; i < end; i++) {
+		int lo[3], hi[3];
+		cell_range(*job.level, job.boxes[job.objects ? job.objects[i] : i], lo, hi);
+		pairs += (long long)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+	}
+	job.chunkPairs[begin / GRID_GRAIN] = pairs;
+}
+
+static void grid_pairs_job(int begin, int end, void *arg) {
+	GridLevelJob &job = *(GridLevelJob*)arg;
+	const Grid::Level &level = *job.level;
+	SortKey *pair = job.pairs + job.chunkPairs[begin / GRID_GRAIN];
+	for (int i = begin; i < end; i++) {
+		int object = job.objects ? job.objects[i] : i;
+		int lo[3], hi[3];
+		cell_range(level, job.boxes[object], lo, hi);
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++) {
+					pair->key = (unsigned int)((z * level.res[1] + y) * level.res[0] + x);
+					pair->item = object;
+					pair++;
+				}
+	}
+}
+
+static void grid_cells_job(int begin, int end, void *arg) {
+	GridLevelJob &job = *(GridLevelJob*)arg;
+	for (int i = begin; i < end; i++) {
+		job.cellObjects[i] = job.pairs[i].item;
+		// every cell from after the previous pair's up to this pair's starts here
+		int first = i > 0 ? (int)job.pairs[i - 1].key + 1 : 0;
+		for (int c = first; c <= (int)job.pairs[i].key; c++)
+			job.cells[c] = i;
+	}
+}
+
+void Grid::SetResolution(Level &level, const AABB &bounds, int count, float density) {
+	level.bounds = bounds;
+	glm::vec3 extent = bounds.Extent();
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	// cells of about equal sides, axes much thinner than the longest one are left flat
+	float volume = 1.f;
+	int dimensions = 0;
+	for (int a = 0; a < 3; a++)
+		if (extent[a] > 1e-3f * longest) {
+			volume *= extent[a];
+			dimensions++;
+		}
+	float perUnit = dimensions > 0 ? pow(density * count / volume, 1.f / dimensions) : 0.f;
+	for (int a = 0; a < 3; a++) {
+		level.res[a] = extent[a] > 1e-3f * longest ? std::min(std::max((int)(extent[a] * perUnit), 1), GRID_MAX_RES) : 1;
+		level.cellSize[a] = extent[a] / level.res[a];
+		level.invCellSize[a] = extent[a] > 0.f ? level.res[a] / extent[a] : 0.f;
+	}
+}
+
+void Grid::BuildLevel(Level &level, const std::vector<AABB> &boxes, const int *objects, int count, ThreadPool *pool) {
+	int chunks = (count + GRID_GRAIN - 1) / GRID_GRAIN;
+	GridLevelJob job;
+	job.level = &level;
+	job.boxes = boxes.data();
+	job.objects = objects;
+	while (true) {
+		job.chunkPairs.assign(chunks, 0);
+		run_grid_chunks(pool, count, grid_count_job, &job);
+		job.pairCount = 0;
+		for (int c = 0; c < chunks; c++) {
+			long long pairs = job.chunkPairs[c];
+			job.chunkPairs[c] = job.pairCount;
+			job.pairCount += pairs;
+		}
+		if (job.pairCount <= GRID_PAIR_MAX || level.getCellCount() == 1) break;
+		// large objects over fine cells, halve the resolution along every axis and count again
+		glm::vec3 extent = level.bounds.Extent();
+		for (int a = 0; a < 3; a++) {
+			level.res[a] = std::max(level.res[a] / 2, 1);
+			level.cellSize[a] = extent[a] / level.res[a];
+			level.invCellSize[a] = extent[a] > 0.f ? level.res[a] / extent[a] : 0.f;
+		}
+	}
+
+	int cellCount = level.getCellCount();
+	int pairCount = (int)job.pairCount;
+	level.cells.clear();
+	level.cells.resize(cellCount + 1, 0);
+	level.objects.clear();
+	if (pairCount == 0) return;
+
+	std::vector<SortKey> pairs(pairCount), temp(pairCount);
+	job.pairs = pairs.data();
+	run_grid_chunks(pool, count, grid_pairs_job, &job);
+	int bits = 0;
+	while ((1 << bits) < cellCount) bits++;
+	// stable, so every cell lists its objects in the order of the primitive list
+	RadixSort(job.pairs, temp.data(), pairCount, bits, pool);
+
+	level.objects.resize(pairCount);
+	job.cells = level.cells.data();
+	job.cellObjects = level.objects.data();
+	run_grid_chunks(pool, pairCount, grid_cells_job, &job);
+	// the cells after the last pair's are empty
+	for (int c = (int)pairs[pairCount - 1].key + 1; c <= cellCount; c++)
+		level.cells[c] = pairCount;
+}
+
+/*
+ * state of the jobs building the second level, one top level cell each
+ */
+struct SubgridJob {
+	Grid::Level *top;
+	const std::vector<AABB> *boxes;
+	// top level cell of every grid
+	std::vector<int> cells;
+	std::vector<Grid::Level> *subgrids;
+};
+
+void Grid::subgrid_job(int begin, int end, void *arg) {
+	SubgridJob &job = *(SubgridJob*)arg;
+	const Level &top = *job.top;
+	for (int s = begin; s < end; s++) {
+		int c = job.cells[s];
+		int cell[3] = { c % top.res[0], c / top.res[0] % top.res[1], c / (top.res[0] * top.res[1]) };
+		AABB bounds;
+		for (int a = 0; a < 3; a++) {
+			bounds.min[a] = top.bounds.min[a] + cell[a] * top.cellSize[a];
+			bounds.max[a] = cell[a] == top.res[a] - 1 ? top.bounds.max[a] : bounds.min[a] + top.cellSize[a];
+		}
+		int first = top.cells[c], count = top.cells[c + 1] - first;
+		Level &level = (*job.subgrids)[s];
+		SetResolution(level, bounds, count, GRID_DENSITY);
+		// already on a worker, the pool cannot be waited for from here
+		BuildLevel(level, *job.boxes, &top.objects[first], count, NULL);
+	}
+}
+
+void Grid::Build(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	top = Level();
+	memset(top.res, 0, sizeof(top.res));
+	subgrid.clear();
+	subgrids.clear();
+	int count = primitives.size();
+	if (count == 0) return;
+
+	std::vector<AABB> boxes(count);
+	GridBoundsJob bounds;
+	bounds.primitives = &primitives;
+	bounds.boxes = &boxes[0];
+	bounds.bounds.resize((count + GRID_GRAIN - 1) / GRID_GRAIN);
+	run_grid_chunks(pool, count, grid_bounds_job, &bounds);
+	AABB sceneBounds;
+	for (unsigned int c = 0; c < bounds.bounds.size(); c++)
+		sceneBounds.Extend(bounds.bounds[c]);
+
+	SetResolution(top, sceneBounds, count, levels == 2 ? GRID_TOP_DENSITY : GRID_DENSITY);
+	BuildLevel(top, boxes, NULL, count, pool);
+	if (levels < 2) return;
+
+	/*
+	 * Second level: a grid in every crowded top level cell, built in parallel
+	 */
+	SubgridJob job;
+	job.top = &top;
+	job.boxes = &boxes;
+	job.subgrids = &subgrids;
+	int cellCount = top.getCellCount();
+	subgrid.resize(cellCount, -1);
+	for (int c = 0; c < cellCount; c++)
+		if (top.cells[c + 1] - top.cells[c] > GRID_CELL_MAX) {
+			subgrid[c] = (int)job.cells.size();
+			job.cells.push_back(c);
+		}
+	subgrids.resize(job.cells.size());
+	if (pool)
+		pool->ParallelFor((int)job.cells.size(), 1, subgrid_job, &job);
+	else
+		subgrid_job(0, (int)job.cells.size(), &job);
+	/**/
+}
+
+int Grid::getCellCount() const {
+	int cells = top.getCellCount();
+	for (unsigned int s = 0; s < subgrids.size(); s++)
+		cells += subgrids[s].getCellCount();
+	return cells;
+}
+
+size_t Grid::getMemoryUsage() const {
+	size_t bytes = (top.cells.capacity() + top.objects.capacity() + subgrid.capacity()) * sizeof(int) + subgrids.capacity() * sizeof(Level);
+	for (unsigned int s = 0; s < subgrids.size(); s++)
+		bytes += (subgrids[s].cells.capacity() + subgrids[s].objects.capacity()) * sizeof(int);
+	return bytes;
+}
+#pragma endregion
+
+#pragma region Traversal
+/*
+ * 3D-DDA: from the cell holding the entry point, steps to whichever neighbour the ray reaches first.
+ * the objects of a cell are tested in full, so a hit found there may lie in a later cell; the walk
+ * only stops once the closest hit so far is in front of the exit of the cell just tested
+ */
+bool Grid::Walk(const Level &level, bool outer, const Ray &ray, const glm::vec3 &invDir, float t0, float t1, Query &query) const {
+	glm::vec3 entry = ray(t0);
+	int cell[3], step[3], out[3];
+	float next[3], delta[3];
+	for (int a = 0; a < 3; a++) {
+		cell[a] = cell_of(level, entry[a], a);
+		if (ray.direction[a] > 0.f && level.res[a] > 1) {
+			step[a] = 1;
+			out[a] = level.res[a];
+			next[a] = (level.bounds.min[a] + (cell[a] + 1) * level.cellSize[a] - ray.origin[a]) * invDir[a];
+			delta[a] = level.cellSize[a] * invDir[a];
+		}
+		else if (ray.direction[a] < 0.f && level.res[a] > 1) {
+			step[a] = -1;
+			out[a] = -1;
+			next[a] = (level.bounds.min[a] + cell[a] * level.cellSize[a] - ray.origin[a]) * invDir[a];
+			delta[a] = -level.cellSize[a] * invDir[a];
+		}
+		else {
+			// a single layer of cells is only left through the end of the interval
+			step[a] = 0;
+			out[a] = -1;
+			next[a] = std::numeric_limits<float>::infinity();
+			delta[a] = 0.f;
+		}
+	}
+
+	float enter = t0;
+	while (true) {
+		int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+		float exit = std::min(next[axis], t1);
+		int c = (cell[2] * level.res[1] + cell[1]) * level.res[0] + cell[0];
+
+		if (outer && levels == 2 && subgrid[c] >= 0) {
+			if (Walk(subgrids[subgrid[c]], false, ray, invDir, enter, exit, query))
+				return true;
+		}
+		else {
+			for (int i = level.cells[c]; i < level.cells[c + 1]; i++) {
+				int object = level.objects[i];
+				if (query.mailbox.Seen(object)) continue;
+				PrimitiveRef ref = (*primitives)[object];
+				if (query.info) {
+					if (primitives->Intersect(ref, ray, *query.info, query.MAX))
+						query.hit = true;
+				}
+				else if (primitives->Occluded(ref, ray, query.MAX))
+					return query.hit = true;
+			}
+			if (query.hit && query.info->time <= exit)
+				return true;
+		}
+
+		if (next[axis] >= t1) return false;
+		cell[axis] += step[axis];
+		if (cell[axis] == out[axis]) return false;
+		enter = next[axis];
+		next[axis] += delta[axis];
+	}
+}
+
+/*
+ * the part [t0, t1] of the ray inside the grid and closer than MAX, false if there is none
+ */
+bool Grid::Enter(const Ray &ray, const glm::vec3 &invDir, float MAX, float &t0, float &t1) const {
+	if (top.cells.empty()) return false;
+	t0 = 0.f;
+	t1 = DistanceToTime(ray, MAX);
+	for (int a = 0; a < 3; a++) {
+		float tA = (top.bounds.min[a] - ray.origin[a]) * invDir[a];
+		float tB = (top.bounds.max[a] - ray.origin[a]) * invDir[a];
+		if (tA > tB) std::swap(tA, tB);
+		// as AABB::Intersect, a NaN leaves the interval untouched
+		t0 = tA > t0 ? tA : t0;
+		t1 = tB < t1 ? tB : t1;
+	}
+	return t0 <= t1;
+}
+
+bool Grid::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	glm::vec3 invDir = 1.f / ray.direction;
+	float t0, t1;
+	if (!Enter(ray, invDir, MAX, t0, t1)) return false;
+	Query query;
+	query.info = &info;
+	query.MAX = MAX;
+	query.hit = false;
+	Walk(top, true, ray, invDir, t0, t1, query);
+	return query.hit;
+}
+
+bool Grid::Occluded(const Ray &ray, float MAX) const {
+	glm::vec3 invDir = 1.f / ray.direction;
+	float t0, t1;
+	if (!Enter(ray, invDir, MAX, t0, t1)) return false;
+	Query query;
+	query.info = NULL;
+	query.MAX = MAX;
+	query.hit = false;
+	return Walk(top, true, ray, invDir, t0, t1, query);
+}
+#pragma endregion
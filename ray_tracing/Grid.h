@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Accelerator.h"
+#include "ThreadPool.h"
+
+/*
+ * Grid
+ * cells of equal size over the scene's box, each listing the objects whose boxes overlap it.
+ * a ray walks the cells it crosses front to back (3D-DDA) and stops after the first cell holding
+ * a hit in front of its exit. objects spanning several cells are tested once per ray (mailboxing).
+ * with two levels the top grid is coarse and its cells holding many objects get a grid of their own,
+ * which adapts the cell size to where the objects are.
+ * the build sorts (cell, object) pairs by cell, all of it in parallel with a pool, in time
+ * linear in the pairs, so animated scenes are simply built again (Refit)
+ */
+class Grid : public Accelerator {
+public:
+	// levels: 1 for a uniform grid, 2 for a two level grid
+	Grid(int levels = 1, ThreadPool *pool = NULL);
+	void Build(const PrimitiveList &primitives);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	bool Occluded(const Ray &ray, float MAX) const;
+	const char *getName() const { return levels == 2 ? "grid2" : "grid"; }
+
+	void setThreadPool(ThreadPool *pool) { this->pool = pool; }
+
+	// cells of all levels
+	int getCellCount() const;
+	// bytes held by the cells and their object lists
+	size_t getMemoryUsage() const;
+
+	/*
+	 * one grid: res cells along each axis over bounds, objects[cells[c], cells[c + 1]) overlap cell c
+	 * (cells run along x, then y, then z)
+	 */
+	struct Level {
+		AABB bounds;
+		int res[3];
+		glm::vec3 cellSize, invCellSize;
+		Buffer<int> cells;
+		// indices in the primitive list
+		Buffer<int> objects;
+
+		int getCellCount() const { return res[0] * res[1] * res[2]; }
+	};
+
+private:
+	struct Query;
+
+	// sizes the level for count objects in bounds, density cells per object
+	static void SetResolution(Level &level, const AABB &bounds, int count, float density);
+	// fills the level's cells with the objects given (all of boxes if objects is NULL)
+	static void BuildLevel(Level &level, const std::vector<AABB> &boxes, const int *objects, int count, ThreadPool *pool);
+	static void subgrid_job(int begin, int end, void *arg);
+	/*
+	 * walks the cells of level the ray crosses between t0 and t1, returns true once the query is answered.
+	 * outer is set for the top level, whose cells may hold grids
+	 */
+	bool Walk(const Level &level, bool outer, const Ray &ray, const glm::vec3 &invDir, float t0, float t1, Query &query) const;
+	bool Enter(const Ray &ray, const glm::vec3 &invDir, float MAX, float &t0, float &t1) const;
+
+	int levels;
+	ThreadPool *pool;
+	const PrimitiveList *primitives;
+	Level top;
+	// two levels: index in subgrids of the grid of every top cell, -1 for cells without one
+	Buffer<int> subgrid;
+	std::vector<Level> subgrids;
+};
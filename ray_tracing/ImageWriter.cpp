@@ -0,0 +1,159 @@
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/*
+ * clamps and scales a channel to the integer range of the format
+ */
+static unsigned int quantize(float value, unsigned int maxValue) {
+	value = std::min(1.f, std::max(0.f, value));
+	return (unsigned int)(value * maxValue + .5f);
+}
+
+/*
+ * interleaved RGB rows, big-endian for 16 bits as both PPM and PNG expect
+ */
+static void pack_row(std::vector<unsigned char> &out, const float *r, const float *g, const float *b, int width, int y, int bits) {
+	unsigned int maxValue = bits == 16 ? 65535 : 255;
+	const float *channels[3] = { r, g, b };
+	for (int x = 0; x < width; x++)
+		for (int c = 0; c < 3; c++) {
+			unsigned int value = quantize(channels[c][x + y * width], maxValue);
+			if (bits == 16)
+				out.push_back((unsigned char)(value >> 8));
+			out.push_back((unsigned char)(value & 0xff));
+		}
+}
+
+bool WritePPM(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits) {
+	FILE *file = fopen(path, "wb");
+	if (!file) return false;
+
+	fprintf(file, "P6\n%d %d\n%d\n", width, height, bits == 16 ? 65535 : 255);
+	std::vector<unsigned char> row;
+	bool ok = true;
+	for (int y = 0; y < height && ok; y++) {
+		row.clear();
+		pack_row(row, r, g, b, width, y, bits);
+		ok = fwrite(&row[0], 1, row.size(), file) == row.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+bool WritePFM(const char *path, const float *r, const float *g, const float *b, int width, int height) {
+	FILE *file = fopen(path, "wb");
+	if (!file) return false;
+
+	// negative scale marks little-endian data, rows go from the bottom up
+	fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+	std::vector<float> row(width * 3);
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--) {
+		for (int x = 0; x < width; x++) {
+			row[x * 3 + 0] = r[x + y * width];
+			row[x * 3 + 1] = g[x + y * width];
+			row[x * 3 + 2] = b[x + y * width];
+		}
+		ok = fwrite(&row[0], sizeof(float), row.size(), file) == row.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+#pragma region PNG
+static unsigned int crc_table[256];
+
+static unsigned int crc32(unsigned int crc, const unsigned char *data, size_t length) {
+	if (crc_table[1] == 0)
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			crc_table[n] = c;
+		}
+	crc ^= 0xffffffffu;
+	for (size_t i = 0; i < length; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffffu;
+}
+
+static void put_u32(std::vector<unsigned char> &out, unsigned int value) {
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+/*
+ * length, type, data and the crc of type + data
+ */
+static bool write_chunk(FILE *file, const char *type, const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> chunk;
+	put_u32(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	put_u32(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+	return fwrite(&chunk[0], 1, chunk.size(), file) == chunk.size();
+}
+
+bool WritePNG(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits) {
+	// raw scanlines, each starting with filter type 0
+	std::vector<unsigned char> raw;
+	for (int y = 0; y < height; y++) {
+		raw.push_back(0);
+		pack_row(raw, r, g, b, width, y, bits);
+	}
+
+	// zlib stream made of stored (uncompressed) deflate blocks
+	std::vector<unsigned char> idat;
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	size_t offset = 0;
+	do {
+		size_t length = std::min((size_t)65535, raw.size() - offset);
+		bool last = offset + length == raw.size();
+		idat.push_back(last ? 1 : 0);
+		idat.push_back((unsigned char)(length & 0xff));
+		idat.push_back((unsigned char)(length >> 8));
+		idat.push_back((unsigned char)(~length & 0xff));
+		idat.push_back((unsigned char)((~length >> 8) & 0xff));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+	// adler32 of the uncompressed data
+	unsigned int a = 1, s = 0;
+	for (size_t i = 0; i < raw.size(); i++) {
+		a = (a + raw[i]) % 65521;
+		s = (s + a) % 65521;
+	}
+	put_u32(idat, (s << 16) | a);
+
+	std::vector<unsigned char> ihdr;
+	put_u32(ihdr, width);
+	put_u32(ihdr, height);
+	ihdr.push_back((unsigned char)bits);
+	ihdr.push_back(2);	// truecolour
+	ihdr.push_back(0);	// deflate
+	ihdr.push_back(0);	// adaptive filtering
+	ihdr.push_back(0);	// no interlace
+
+	FILE *file = fopen(path, "wb");
+	if (!file) return false;
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	bool ok = fwrite(signature, 1, 8, file) == 8
+		&& write_chunk(file, "IHDR", ihdr)
+		&& write_chunk(file, "IDAT", idat)
+		&& write_chunk(file, "IEND", std::vector<unsigned char>());
+	return fclose(file) == 0 && ok;
+}
+#pragma endregion
+
+bool WriteImage(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits) {
+	const char *extension = strrchr(path, '.');
+	if (extension && strcmp(extension, ".png") == 0)
+		return WritePNG(path, r, g, b, width, height, bits);
+	if (extension && strcmp(extension, ".pfm") == 0)
+		return WritePFM(path, r, g, b, width, height);
+	return WritePPM(path, r, g, b, width, height, bits);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ * Image output for the headless renderer
+ * pixels are separate float channels in [0, 1], index = x + y * width with row 0 at the top.
+ * functions return false if the file could not be written
+ */
+
+// binary PPM, bits is 8 or 16
+bool WritePPM(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits);
+// PNG without compression, bits is 8 or 16
+bool WritePNG(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits);
+// PFM, full float precision, values are written unclamped
+bool WritePFM(const char *path, const float *r, const float *g, const float *b, int width, int height);
+
+/*
+ * picks the format from the extension (.ppm, .png, .pfm)
+ */
+bool WriteImage(const char *path, const float *r, const float *g, const float *b, int width, int height, int bits);
@@ -0,0 +1,98 @@
+#include "Instance.h"
+#include "Model.h"
+#include <cmath>
+
+static const float PI = 3.14159265358979f;
+
+InstanceMotion::InstanceMotion():
+	scale(1.f),
+	rotate(0.f),
+	translate(0.f),
+	spin(0.f),
+	move(0.f)
+{}
+
+/*
+ * translate * rotate z * rotate y * rotate x * scale
+ */
+glm::mat4 InstanceMotion::getTransform(float frame) const {
+	glm::vec3 angles = rotate + spin * frame;
+	glm::mat4 matrix(1.f);
+	matrix[3] = glm::vec4(translate + move * frame, 1.f);
+	for (int axis = 2; axis >= 0; axis--) {
+		float angle = angles[axis] * PI / 180.f;
+		float c = cosf(angle), s = sinf(angle);
+		int a = (axis + 1) % 3, b = (axis + 2) % 3;
+		glm::mat4 rotation(1.f);
+		rotation[a][a] = c;
+		rotation[a][b] = s;
+		rotation[b][a] = -s;
+		rotation[b][b] = c;
+		matrix = matrix * rotation;
+	}
+	return matrix * glm::mat4(glm::vec4(scale.x, 0.f, 0.f, 0.f), glm::vec4(0.f, scale.y, 0.f, 0.f),
+		glm::vec4(0.f, 0.f, scale.z, 0.f), glm::vec4(0.f, 0.f, 0.f, 1.f));
+}
+
+Instance::Instance(const Model *model, const glm::mat4 &transform):
+Object(0),
+	model(model),
+	animated(false)
+{
+	setTransform(transform);
+}
+
+Instance::Instance(const Model *model, const InstanceMotion &motion):
+Object(0),
+	model(model),
+	motion(motion),
+	animated(motion.isAnimated())
+{
+	setTransform(motion.getTransform(0.f));
+}
+
+void Instance::setTransform(const glm::mat4 &transform) {
+	toWorld = transform;
+	toModel = glm::inverse(transform);
+	normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+	// the corners of the model's box, moved to world space
+	bounds = AABB();
+	AABB box = model->getBounds();
+	if (!box.isEmpty())
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+			bounds.Extend(glm::vec3(transform * glm::vec4(p, 1.f)));
+		}
+	centroid = bounds.isEmpty() ? glm::vec3(transform[3]) : bounds.Centroid();
+	radius = bounds.isEmpty() ? 0.f : glm::length(bounds.Extent()) * .5f;
+}
+
+bool Instance::setFrame(float frame) {
+	if (!animated) return false;
+	setTransform(motion.getTransform(frame));
+	return true;
+}
+
+Ray Instance::ToModel(const Ray &ray, float &MAX) const {
+	// the direction is not normalized, a point at time t in one space is at time t in the other
+	Ray local(glm::vec3(toModel * glm::vec4(ray.origin, 1.f)), glm::vec3(toModel * glm::vec4(ray.direction, 0.f)));
+	if (MAX != std::numeric_limits<float>::infinity())
+		MAX *= glm::length(local.direction) / glm::length(ray.direction);
+	return local;
+}
+
+bool Instance::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	Ray local = ToModel(ray, MAX);
+	if (!model->Intersect(local, info, MAX))
+		return false;
+	// the model filled in its time, material and surface coordinates, the point and normal go back to world space
+	info.hitPoint = ray(info.time);
+	info.normal = glm::normalize(normalMatrix * info.normal);
+	return true;
+}
+
+bool Instance::Occluded(const Ray &ray, float MAX) const {
+	Ray local = ToModel(ray, MAX);
+	return model->Occluded(local, MAX);
+}
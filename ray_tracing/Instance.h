@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Object.h"
+
+class Model;
+
+/*
+ * Instance Motion
+ * placement of an instance as scale, rotation (degrees around x, then y, then z) and translation,
+ * applied in that order; animated instances turn by spin and move by move every frame
+ */
+struct InstanceMotion {
+	InstanceMotion();
+
+	// the transform at a frame of the animation
+	glm::mat4 getTransform(float frame) const;
+	bool isAnimated() const { return spin != glm::vec3(0.f) || move != glm::vec3(0.f); }
+
+	glm::vec3 scale;
+	glm::vec3 rotate;
+	glm::vec3 translate;
+	// per frame
+	glm::vec3 spin;
+	glm::vec3 move;
+};
+
+/*
+ * Instance Object
+ * places a shared Model in the scene through an affine transform. rays are moved into the model's
+ * space and traced through its own BVH (the bottom level), the scene's structure over the instances
+ * is the top level, so any number of instances share a single copy of the model's geometry.
+ * the materials are the model's own, the ray parameter is the same in both spaces
+ */
+class Instance : public Object {
+public:
+	// the model has to be built before and outlive the instance
+	Instance(const Model *model, const glm::mat4 &transform);
+	// placed at frame 0 of the motion
+	Instance(const Model *model, const InstanceMotion &motion);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	// any hit of the model closer than MAX
+	bool Occluded(const Ray &ray, float MAX) const;
+	// box enclosing the transformed model, used to build the acceleration structures
+	AABB getBounds() const { return bounds; }
+
+	const Model *getModel() const { return model; }
+	// model to world space
+	const glm::mat4 &getTransform() const { return toWorld; }
+	/*
+	 * places the instance anew, the accelerators over it have to be refit or built again afterwards
+	 */
+	void setTransform(const glm::mat4 &transform);
+
+	// NULL unless the instance is animated
+	const InstanceMotion *getMotion() const { return animated ? &motion : NULL; }
+	/*
+	 * moves an animated instance to a frame of its motion, false (and nothing done) if it is not animated
+	 */
+	bool setFrame(float frame);
+
+private:
+	/*
+	 * the ray in model space, MAX returns the distance limit measured there
+	 */
+	Ray ToModel(const Ray &ray, float &MAX) const;
+
+	const Model *model;
+	glm::mat4 toWorld;
+	glm::mat4 toModel;
+	// inverse transpose, keeps the normals perpendicular under non-uniform scales
+	glm::mat3 normalMatrix;
+	AABB bounds;
+	InstanceMotion motion;
+	bool animated;
+};
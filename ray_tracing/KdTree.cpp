@@ -0,0 +1,322 @@
+#include "KdTree.h"
+#include <algorithm>
+#include <cmath>
+
+// SAH estimates of the cost of visiting a node and of testing an object
+static const float KD_TRAVERSAL_COST = 1.f;
+static const float KD_INTERSECT_COST = .7f;
+// factor of the cost of planes cutting off empty space, which rays cross without a test
+static const float KD_EMPTY_BONUS = .8f;
+// nodes with this many objects or fewer are always leaves
+static const int KD_LEAF_SIZE = 1;
+// depth limit 8 + 1.3 log2(objects), cuts off runs of planes around objects that cannot be separated
+static const int KD_DEPTH_BASE = 8;
+static const float KD_DEPTH_SCALE = 1.3f;
+// ropes followed at most from the hinted leaf to the one holding a ray's origin
+static const int KD_LOCATE_STEPS = 8;
+
+/*
+ * an object in a node, with its box clipped to the node
+ */
+struct KdTree::Ref {
+	int object;
+	AABB box;
+};
+
+/*
+ * start or end of a box along the axis of the sweep, or both for boxes flat along it.
+ * at one position the ends come first, then the flat boxes, then the starts
+ */
+struct KdEvent {
+	enum Type { END, PLANAR, START };
+	float position;
+	int type;
+
+	KdEvent(float position, int type): position(position), type(type) {}
+	bool operator<(const KdEvent &event) const {
+		return position < event.position || (position == event.position && type < event.type);
+	}
+};
+
+KdTree::KdTree():
+	primitives(NULL),
+	maxDepth(0)
+{
+}
+
+#pragma region Build
+void KdTree::Build(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	bounds = AABB();
+	nodes.clear();
+	leaves.clear();
+	objects.clear();
+	int count = primitives.size();
+	if (count == 0) return;
+
+	std::vector<Ref> refs(count);
+	for (int i = 0; i < count; i++) {
+		refs[i].object = i;
+		refs[i].box = primitives.getBounds(primitives[i]);
+		bounds.Extend(refs[i].box);
+	}
+	maxDepth = KD_DEPTH_BASE + (int)(KD_DEPTH_SCALE * log((float)count) / log(2.f));
+	nodes.resize(1);
+	BuildNode(0, refs, bounds, 0);
+
+	int ropes[6] = { -1, -1, -1, -1, -1, -1 };
+	BuildRopes(0, bounds, ropes);
+	nodes.shrink_to_fit();
+	leaves.shrink_to_fit();
+	objects.shrink_to_fit();
+}
+
+/*
+ * the SAH is swept over every position where a box starts or ends along each axis (Wald and Havran),
+ * boxes flat in the plane are tried on either side
+ */
+void KdTree::BuildNode(int node, std::vector<Ref> &refs, const AABB &bounds, int depth) {
+	int count = (int)refs.size();
+	float area = bounds.SurfaceArea();
+	float best = KD_INTERSECT_COST * count;
+	int axis = -1;
+	float split = 0.f;
+	bool planarLow = false;
+
+	if (count > KD_LEAF_SIZE && depth < maxDepth && area > 0.f) {
+		std::vector<KdEvent> events;
+		events.reserve(2 * count);
+		for (int a = 0; a < 3; a++) {
+			if (!(bounds.max[a] > bounds.min[a])) continue;
+			events.clear();
+			for (int i = 0; i < count; i++) {
+				float low = refs[i].box.min[a], high = refs[i].box.max[a];
+				if (low == high)
+					events.push_back(KdEvent(low, KdEvent::PLANAR));
+				else {
+					events.push_back(KdEvent(low, KdEvent::START));
+					events.push_back(KdEvent(high, KdEvent::END));
+				}
+			}
+			std::sort(events.begin(), events.end());
+
+			int below = 0, above = count;
+			for (size_t e = 0; e < events.size();) {
+				float position = events[e].position;
+				int ends = 0, planar = 0, starts = 0;
+				for (; e < events.size() && events[e].position == position && events[e].type == KdEvent::END; e++) ends++;
+				for (; e < events.size() && events[e].position == position && events[e].type == KdEvent::PLANAR; e++) planar++;
+				for (; e < events.size() && events[e].position == position && events[e].type == KdEvent::START; e++) starts++;
+				above -= ends + planar;
+
+				// a plane on the node's faces would leave a child without volume
+				if (position > bounds.min[a] && position < bounds.max[a]) {
+					AABB low = bounds, high = bounds;
+					low.max[a] = high.min[a] = position;
+					float lowShare = low.SurfaceArea() / area, highShare = high.SurfaceArea() / area;
+					for (int side = 0; side < 2; side++) {
+						int lowCount = below + (side == 0 ? planar : 0), highCount = above + (side == 1 ? planar : 0);
+						float cost = KD_TRAVERSAL_COST + KD_INTERSECT_COST * (lowShare * lowCount + highShare * highCount);
+						if (lowCount == 0 || highCount == 0) cost *= KD_EMPTY_BONUS;
+						if (cost < best) {
+							best = cost;
+							axis = a;
+							split = position;
+							planarLow = side == 0;
+						}
+					}
+				}
+				below += starts + planar;
+			}
+		}
+	}
+
+	if (axis < 0) {
+		KdLeaf leaf;
+		leaf.first = (int)objects.size();
+		leaf.count = count;
+		// set with the boxes once the tree is complete (BuildRopes)
+		std::fill(leaf.ropes, leaf.ropes + 6, -1);
+		for (int i = 0; i < count; i++)
+			objects.push_back(refs[i].object);
+		nodes[node].split = 0.f;
+		nodes[node].data = ((unsigned int)leaves.size() << 2) | 3;
+		leaves.push_back(leaf);
+		return;
+	}
+
+	/*
+	 * Objects crossing the plane go to both children, clipped to each
+	 */
+	AABB lowBounds = bounds, highBounds = bounds;
+	lowBounds.max[axis] = highBounds.min[axis] = split;
+	std::vector<Ref> low, high;
+	for (int i = 0; i < count; i++) {
+		const AABB &box = refs[i].box;
+		if (box.min[axis] == split && box.max[axis] == split)
+			(planarLow ? low : high).push_back(refs[i]);
+		else if (box.max[axis] <= split)
+			low.push_back(refs[i]);
+		else if (box.min[axis] >= split)
+			high.push_back(refs[i]);
+		else {
+			PrimitiveRef ref = (*primitives)[refs[i].object];
+			Ref part = refs[i];
+			part.box = primitives->getClippedBounds(ref, lowBounds);
+			if (!part.box.isEmpty()) low.push_back(part);
+			part.box = primitives->getClippedBounds(ref, highBounds);
+			if (!part.box.isEmpty()) high.push_back(part);
+		}
+	}
+	// the parent's list is not needed any more, only the children's are kept down the recursion
+	std::vector<Ref>().swap(refs);
+
+	int child = (int)nodes.size();
+	nodes.resize(child + 2);
+	nodes[node].split = split;
+	nodes[node].data = ((unsigned int)child << 2) | axis;
+	BuildNode(child, low, lowBounds, depth + 1);
+	BuildNode(child + 1, high, highBounds, depth + 1);
+}
+
+/*
+ * a child inherits the ropes of its parent and points the face on the plane at its sibling.
+ * at the leaves each rope is pushed down the neighbour's subtree for as long as one child of the
+ * neighbouring node covers the whole face, so that following it descends less (Popov et al.)
+ */
+void KdTree::BuildRopes(int node, const AABB &bounds, const int *ropes) {
+	const KdNode &current = nodes[node];
+	if (current.isLeaf()) {
+		KdLeaf &leaf = leaves[current.getIndex()];
+		leaf.bounds = bounds;
+		for (int face = 0; face < 6; face++) {
+			int rope = ropes[face];
+			while (rope >= 0 && !nodes[rope].isLeaf()) {
+				const KdNode &neighbour = nodes[rope];
+				int a = neighbour.getAxis(), child = neighbour.getIndex();
+				// across a max face the neighbour's low child touches it, across a min face its high child
+				if (a == face / 2) rope = face & 1 ? child : child + 1;
+				else if (neighbour.split <= bounds.min[a]) rope = child + 1;
+				else if (neighbour.split >= bounds.max[a]) rope = child;
+				else break;
+			}
+			leaf.ropes[face] = rope;
+		}
+		return;
+	}
+
+	int axis = current.getAxis(), child = current.getIndex();
+	AABB low = bounds, high = bounds;
+	low.max[axis] = high.min[axis] = current.split;
+	int childRopes[6];
+	std::copy(ropes, ropes + 6, childRopes);
+	childRopes[2 * axis + 1] = child + 1;
+	BuildRopes(child, low, childRopes);
+	std::copy(ropes, ropes + 6, childRopes);
+	childRopes[2 * axis] = child;
+	BuildRopes(child + 1, high, childRopes);
+}
+#pragma endregion
+
+#pragma region Traversal
+int KdTree::Descend(int node, const glm::vec3 &point, const glm::vec3 &direction) const {
+	while (!nodes[node].isLeaf()) {
+		const KdNode &current = nodes[node];
+		int a = current.getAxis();
+		bool high = point[a] > current.split || (point[a] == current.split && direction[a] > 0.f);
+		node = current.getIndex() + (high ? 1 : 0);
+	}
+	return node;
+}
+
+/*
+ * the leaves are disjoint, so a hit found in one but lying past its exit may still be beaten in the
+ * next ones: the walk stops once the closest hit so far lies before the exit of the leaf just tested
+ */
+int KdTree::Walk(int node, const Ray &ray, const glm::vec3 &invDir, float t0, float t1, IntersectInfo *info, float MAX) const {
+	float entry = t0;
+	bool hit = false;
+	while (true) {
+		node = Descend(node, ray(entry), ray.direction);
+		const KdLeaf &leaf = leaves[nodes[node].getIndex()];
+		for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+			PrimitiveRef ref = (*primitives)[objects[i]];
+			if (info) {
+				if (primitives->Intersect(ref, ray, *info, MAX))
+					hit = true;
+			}
+			else if (primitives->Occluded(ref, ray, MAX))
+				return node;
+		}
+
+		// face the ray leaves through
+		float exit = std::numeric_limits<float>::infinity();
+		int face = -1;
+		for (int a = 0; a < 3; a++) {
+			if (!(ray.direction[a] != 0.f)) continue;
+			int side = ray.direction[a] > 0.f ? 1 : 0;
+			float t = ((side ? leaf.bounds.max[a] : leaf.bounds.min[a]) - ray.origin[a]) * invDir[a];
+			if (t < exit) {
+				exit = t;
+				face = 2 * a + side;
+			}
+		}
+		if (hit && info->time <= exit)
+			return node;
+		if (face < 0 || exit >= t1 || leaf.ropes[face] < 0)
+			return hit ? node : -1;
+		node = leaf.ropes[face];
+		entry = std::max(entry, exit);
+	}
+}
+
+bool KdTree::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	if (nodes.empty()) return false;
+	glm::vec3 invDir = 1.f / ray.direction;
+	float t0, t1 = DistanceToTime(ray, MAX);
+	if (!bounds.Intersect(ray, invDir, t1, t0)) return false;
+	int node = Walk(0, ray, invDir, t0, t1, &info, MAX);
+	if (node < 0) return false;
+	info.cell = node;
+	return true;
+}
+
+/*
+ * the origin of a secondary ray is near the hit it leaves, mostly in the same leaf or a neighbour:
+ * the ropes are followed towards it, and the descent from the root is only made if that fails
+ */
+bool KdTree::IntersectFrom(const Ray &ray, int cell, IntersectInfo &info, float MAX) const {
+	if (cell < 0 || cell >= (int)nodes.size() || !nodes[cell].isLeaf())
+		return Intersect(ray, info, MAX);
+
+	int node = cell;
+	for (int step = 0; node >= 0; step++) {
+		const AABB &box = leaves[nodes[node].getIndex()].bounds;
+		int face = -1;
+		for (int a = 0; a < 3 && face < 0; a++) {
+			if (ray.origin[a] < box.min[a]) face = 2 * a;
+			else if (ray.origin[a] > box.max[a]) face = 2 * a + 1;
+		}
+		if (face < 0) break;
+		// out of the tree, or too far from the hint
+		if (step == KD_LOCATE_STEPS) return Intersect(ray, info, MAX);
+		node = leaves[nodes[node].getIndex()].ropes[face];
+		if (node >= 0) node = Descend(node, ray.origin, ray.direction);
+	}
+	if (node < 0) return Intersect(ray, info, MAX);
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	node = Walk(node, ray, invDir, 0.f, DistanceToTime(ray, MAX), &info, MAX);
+	if (node < 0) return false;
+	info.cell = node;
+	return true;
+}
+
+bool KdTree::Occluded(const Ray &ray, float MAX) const {
+	if (nodes.empty()) return false;
+	glm::vec3 invDir = 1.f / ray.direction;
+	float t0, t1 = DistanceToTime(ray, MAX);
+	if (!bounds.Intersect(ray, invDir, t1, t0)) return false;
+	return Walk(0, ray, invDir, t0, t1, NULL, MAX) >= 0;
+}
+#pragma endregion
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Accelerator.h"
+
+/*
+ * Kd-tree node
+ * interior nodes split their box in two at a plane across one axis, the children are stored side by side
+ */
+struct KdNode {
+	// position of the splitting plane, unused in leaves
+	float split;
+	// axis of the plane in the low 2 bits (3 for leaves), above it the first child or the index of the leaf
+	unsigned int data;
+
+	bool isLeaf() const { return (data & 3) == 3; }
+	int getAxis() const { return data & 3; }
+	int getIndex() const { return (int)(data >> 2); }
+};
+
+/*
+ * Kd-tree leaf
+ * its box, the objects overlapping it and, for every face, the node on the other side (its rope)
+ */
+struct KdLeaf {
+	AABB bounds;
+	// node across each face (min x, max x, min y, max y, min z, max z), -1 where the tree ends
+	int ropes[6];
+	// objects[first, first + count) of the tree
+	int first, count;
+};
+
+/*
+ * Kd-tree
+ * planes placed by the surface area heuristic over the exact events of the objects' boxes, which are
+ * clipped to the node on both sides of a plane (triangles and planes are cut, see getClippedBounds).
+ * leaves cover the scene without overlapping, so a ray visits them strictly front to back and stops in
+ * the first one holding a hit; objects spanning several leaves are listed in all of them.
+ * every leaf keeps ropes to its neighbours: the traversal needs no stack, it goes from a leaf through
+ * the face the ray leaves by and down to the leaf the exit point lies in. a ray can therefore start in
+ * any leaf, IntersectFrom starts reflected and refracted rays in the leaf of the hit they leave.
+ * the build is serial and slower than the BVH's, the tree is meant for static scenes (Refit builds again)
+ */
+class KdTree : public Accelerator {
+public:
+	KdTree();
+	void Build(const PrimitiveList &primitives);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	bool IntersectFrom(const Ray &ray, int cell, IntersectInfo &info, float MAX) const;
+	bool Occluded(const Ray &ray, float MAX) const;
+	const char *getName() const { return "kd"; }
+
+	int getNodeCount() const { return (int)nodes.size(); }
+	int getLeafCount() const { return (int)leaves.size(); }
+	// bytes held by the nodes, the leaves and their object lists
+	size_t getMemoryUsage() const {
+		return nodes.capacity() * sizeof(KdNode) + leaves.capacity() * sizeof(KdLeaf) + objects.capacity() * sizeof(int);
+	}
+
+private:
+	struct Ref;
+
+	// splits the node over refs if the SAH finds that it pays off, makes it a leaf otherwise
+	void BuildNode(int node, std::vector<Ref> &refs, const AABB &bounds, int depth);
+	// sets the boxes and ropes of the leaves below node, ropes are those of the node's own faces
+	void BuildRopes(int node, const AABB &bounds, const int *ropes);
+	// leaf below node holding the point, ties at a plane go to the side direction points to
+	int Descend(int node, const glm::vec3 &point, const glm::vec3 &direction) const;
+	/*
+	 * visits the leaves from the one below node holding the ray at t0 until t1, info is NULL for
+	 * occlusion queries. returns the leaf node the query was answered in, -1 if there was no hit
+	 */
+	int Walk(int node, const Ray &ray, const glm::vec3 &invDir, float t0, float t1, IntersectInfo *info, float MAX) const;
+
+	const PrimitiveList *primitives;
+	AABB bounds;
+	Buffer<KdNode> nodes;
+	Buffer<KdLeaf> leaves;
+	// indices in the primitive list, per leaf
+	Buffer<int> objects;
+	int maxDepth;
+};
@@ -16,9 +16,22 @@ public:
 	float Diffuse_Light(float Kd, glm::vec3 N, glm::vec3 L);
 	float Specular_Light(float Ks, glm::vec3 N, glm::vec3 L, glm::vec3 V, float glossiness);
 private:
+	friend class SceneCache;
+
 	float ambient;
 	float diffuse;
 	float constant_att;
 	float linear_att;
 	float quadratic_att;
 };
+
+/*
+ * Point Light
+ * a light source placed in the scene, shadow rays are cast towards its position
+ */
+struct PointLight {
+	PointLight(const glm::vec3 &position, const Light &light): position(position), light(light) {}
+
+	glm::vec3 position;
+	Light light;
+};
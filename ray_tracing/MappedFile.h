@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Memory Mapped File
+ * maps a whole file copy-on-write: pages are read from the file when first touched and
+ * writes stay private to the process, so the mapped structures can be modified in place
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// returns false if the file could not be opened or mapped
+	bool Open(const char *path);
+	void Close();
+
+	bool isOpen() const { return data != NULL; }
+	char *getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	// not copyable, the mapping is released by the destructor
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	char *data;
+	size_t size;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+};
@@ -0,0 +1,28 @@
+#include "Material.h"
+#include "Texture.h"
+
+/*
+ * Default Material constructor
+ */
+Material::Material():
+    ambient(.0f),
+    diffuse(.0f),
+    specular(.0f),
+	glossiness(.0f),
+	refraction(.0f),
+	texture(NULL)
+{}
+
+/*
+ * Material constructor with defined properties
+ */
+Material::Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float glossiness, float reflection, float refraction):
+    ambient(ambient), diffuse(diffuse), specular(specular),	glossiness(glossiness),
+	reflection(reflection),	refraction(refraction), texture(NULL){}
+
+void MaterialTable::Clear() {
+	materials.clear();
+	for (unsigned int i = 0; i < textures.size(); i++)
+		delete textures[i];
+	textures.clear();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Ray.h"
+#include <vector>
+
+class Texture;
+
+/*
+ * Material class
+ * keeps material properties
+ */
+class Material {
+public:
+	Material();
+	Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float glossiness, float reflection, float refraction);
+
+	/*
+	 * getter functions for reading member variables from outside
+	 */
+	float getAmbient(int channel) const { return ambient[channel]; };
+	float getDiffuse(int channel) const { return diffuse[channel]; };
+	float getSpecular(int channel) const { return specular[channel]; };
+	float getGlossiness() const { return glossiness; };
+	float getReflectivity() const { return reflection; };
+	float getRefraction() const { return refraction; };
+	// procedural pattern picking the actual material at hit time, NULL for plain materials
+	const Texture *getTexture() const { return texture; }
+	void setTexture(const Texture *texture) { this->texture = texture; }
+
+protected:
+	friend class SceneCache;
+
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float glossiness;
+	float reflection;
+	float refraction;
+	const Texture *texture;
+};
+
+/*
+ * Material Table
+ * the materials of a scene, objects and hits refer to them by id
+ * so that a material shared by many objects is stored once
+ */
+class MaterialTable {
+public:
+	MaterialTable() {}
+	~MaterialTable() { Clear(); }
+
+	// returns the id of the added material
+	MaterialID Add(const Material &material) {
+		materials.push_back(material);
+		return (MaterialID)(materials.size() - 1);
+	}
+	/*
+	 * takes ownership of a texture (allocated with new) so that it lives as long as the materials using it
+	 */
+	const Texture *AddTexture(Texture *texture) {
+		textures.push_back(texture);
+		return texture;
+	}
+	// removes the materials and deletes the textures
+	void Clear();
+	int size() const { return (int)materials.size(); }
+
+	const Material &operator[](MaterialID id) const { return materials[id]; }
+
+private:
+	friend class SceneCache;
+
+	// not copyable, the textures are owned
+	MaterialTable(const MaterialTable &);
+	MaterialTable &operator=(const MaterialTable &);
+
+	std::vector<Material> materials;
+	std::vector<Texture*> textures;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "BVH.h"
+
+/*
+ * Model
+ * geometry shared by instances: a primitive list in the model's own space and the BVH over it.
+ * not copyable, the BVH refers to the list; keep models in a container that does not move them
+ */
+class Model {
+public:
+	Model() {}
+
+	/*
+	 * builds the BVH, call after filling the primitives. the pool, if given, shares out the build
+	 */
+	void Build(ThreadPool *pool = NULL) {
+		bvh.setThreadPool(pool);
+		bvh.Build(primitives);
+	}
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const { return bvh.Intersect(ray, info, MAX); }
+	bool Occluded(const Ray &ray, float MAX) const { return bvh.Occluded(ray, MAX); }
+	// box enclosing the primitives, empty before Build
+	AABB getBounds() const { return bvh.getBounds(); }
+
+	PrimitiveList primitives;
+
+private:
+	friend class SceneCache;
+
+	Model(const Model &);
+	Model &operator=(const Model &);
+
+	BVH bvh;
+};
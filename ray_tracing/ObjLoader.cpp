@@ -0,0 +1,693 @@
+#include "ObjLoader.h"
+#include "Timer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// largest piece of text given to one parse job
+#define OBJ_CHUNK_SIZE (4 << 20)
+// smallest, below that a job costs more than the text it parses
+#define OBJ_MIN_CHUNK_SIZE (64 << 10)
+// meshes with at least this many triangles are built one after the other, each by all the threads
+#define PARALLEL_MESH_BUILD 65536
+
+// triangle material of the faces dropped while merging
+static const MaterialID SKIPPED_FACE = ~0u;
+
+#pragma region Text Parsing
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static const char *skip_space(const char *p, const char *end) {
+	while (p < end && is_space(*p)) p++;
+	return p;
+}
+
+static const char *skip_token(const char *p, const char *end) {
+	while (p < end && !is_space(*p)) p++;
+	return p;
+}
+
+static const char *line_end(const char *p, const char *end) {
+	const char *n = (const char*)memchr(p, '\n', end - p);
+	return n ? n : end;
+}
+
+/*
+ * true if the line at p starts with word followed by a space, p is moved past both
+ */
+static bool keyword(const char *&p, const char *end, const char *word) {
+	size_t n = strlen(word);
+	if ((size_t)(end - p) <= n || memcmp(p, word, n) != 0 || !is_space(p[n]))
+		return false;
+	p = skip_space(p + n, end);
+	return true;
+}
+
+// rest of the line without the trailing spaces
+static std::string rest_of_line(const char *p, const char *end) {
+	while (end > p && is_space(end[-1])) end--;
+	return std::string(p, end);
+}
+
+/*
+ * decimal number with optional fraction and exponent.
+ * strtod also handles locales, hex and inf/nan and is several times slower, which dominates the load time
+ */
+static bool parse_float(const char *&p, const char *end, float &value) {
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = *s++ == '-';
+
+	// digits beyond what the mantissa holds only scale the number
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+		if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (*s - '0');
+		else exponent++;
+	}
+	if (s < end && *s == '.') {
+		for (s++; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+			if (mantissa < 100000000000000000ull) {
+				mantissa = mantissa * 10 + (*s - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0) return false;
+
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char *e = s + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+'))
+			negativeExponent = *e++ == '-';
+		if (e < end && *e >= '0' && *e <= '9') {
+			int n = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++)
+				if (n < 10000) n = n * 10 + (*e - '0');
+			exponent += negativeExponent ? -n : n;
+			s = e;
+		}
+	}
+
+	double d = (double)mantissa;
+	if (exponent < 0)
+		d = -exponent <= 22 ? d / powers[-exponent] : d * pow(10.0, exponent);
+	else if (exponent > 0)
+		d = exponent <= 22 ? d * powers[exponent] : d * pow(10.0, exponent);
+	value = (float)(negative ? -d : d);
+	p = s;
+	return true;
+}
+
+static bool parse_int(const char *&p, const char *end, int &value) {
+	const char *s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = *s++ == '-';
+	if (s >= end || *s < '0' || *s > '9') return false;
+	long long n = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; s++)
+		if (n <= INT_MAX) n = n * 10 + (*s - '0');
+	n = std::min(n, (long long)INT_MAX);
+	value = (int)(negative ? -n : n);
+	p = s;
+	return true;
+}
+
+// up to count floats, the missing ones are left untouched
+static void parse_floats(const char *p, const char *end, float *values, int count) {
+	for (int i = 0; i < count; i++) {
+		p = skip_space(p, end);
+		if (!parse_float(p, end, values[i])) return;
+	}
+}
+
+static bool read_file(const char *path, std::vector<char> &data) {
+	FILE *file = fopen(path, "rb");
+	if (!file) return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data.resize(size > 0 ? (size_t)size : 0);
+	size_t read = data.empty() ? 0 : fread(&data[0], 1, data.size(), file);
+	fclose(file);
+	return read == data.size();
+}
+
+// material libraries are relative to the folder of the .obj
+static std::string folder_of(const char *path) {
+	std::string folder(path);
+	size_t slash = folder.find_last_of("/\\");
+	return slash == std::string::npos ? "" : folder.substr(0, slash + 1);
+}
+
+// appends the library names of an mtllib line, s is past the keyword
+static void parse_mtllib(const char *s, const char *eol, std::vector<std::string> &names) {
+	while ((s = skip_space(s, eol)) < eol) {
+		const char *name = s;
+		s = skip_token(s, eol);
+		names.push_back(std::string(name, s));
+	}
+}
+#pragma endregion
+
+#pragma region Materials
+/*
+ * material as written in a .mtl file
+ */
+struct MtlMaterial {
+	MtlMaterial():
+		ambient(0.f), diffuse(.8f), specular(0.f), shininess(10.f), ior(1.5f), dissolve(1.f), illum(2)
+	{}
+
+	glm::vec3 ambient;	// Ka
+	glm::vec3 diffuse;	// Kd
+	glm::vec3 specular;	// Ks
+	float shininess;	// Ns
+	float ior;			// Ni
+	float dissolve;		// d, or 1 - Tr
+	int illum;
+};
+
+/*
+ * the illumination models 3 to 7 are the ray traced ones, their reflections are tinted by Ks
+ * and 4, 6 and 7 (or a dissolve below 1) are refracting
+ */
+static Material convert_material(const MtlMaterial &mtl) {
+	float reflection = 0.f;
+	if (mtl.illum >= 3 && mtl.illum <= 7)
+		reflection = std::max(mtl.specular.x, std::max(mtl.specular.y, mtl.specular.z));
+	bool transparent = mtl.dissolve < 1.f || mtl.illum == 4 || mtl.illum == 6 || mtl.illum == 7;
+	return Material(mtl.ambient, mtl.diffuse, mtl.specular, mtl.shininess, reflection,
+		transparent ? std::max(mtl.ior, 1e-3f) : 0.f);
+}
+
+/*
+ * plain grey for the faces without a usemtl or naming an unknown material, added on first use (id < 0)
+ */
+static MaterialID default_material(MaterialTable &materials, int &id) {
+	if (id < 0)
+		id = (int)materials.Add(Material(glm::vec3(.1f), glm::vec3(.7f), glm::vec3(.2f), 10.f, 0.f, 0.f));
+	return (MaterialID)id;
+}
+
+/*
+ * adds the materials of a .mtl file, named maps their names to the ids
+ */
+static bool load_mtl(const std::string &path, MaterialTable &materials, std::map<std::string, MaterialID> &named) {
+	std::vector<char> data;
+	if (!read_file(path.c_str(), data))
+		return false;
+
+	const char *p = data.empty() ? NULL : &data[0];
+	const char *end = p + data.size();
+	std::string name;
+	MtlMaterial mtl;
+	bool open = false;
+	while (p < end) {
+		const char *eol = line_end(p, end);
+		const char *s = skip_space(p, eol);
+		p = eol + 1;
+		if (keyword(s, eol, "newmtl")) {
+			if (open) named[name] = materials.Add(convert_material(mtl));
+			name = rest_of_line(s, eol);
+			mtl = MtlMaterial();
+			open = true;
+		}
+		else if (keyword(s, eol, "Ka")) parse_floats(s, eol, &mtl.ambient.x, 3);
+		else if (keyword(s, eol, "Kd")) parse_floats(s, eol, &mtl.diffuse.x, 3);
+		else if (keyword(s, eol, "Ks")) parse_floats(s, eol, &mtl.specular.x, 3);
+		else if (keyword(s, eol, "Ns")) parse_floats(s, eol, &mtl.shininess, 1);
+		else if (keyword(s, eol, "Ni")) parse_floats(s, eol, &mtl.ior, 1);
+		else if (keyword(s, eol, "d")) parse_floats(s, eol, &mtl.dissolve, 1);
+		else if (keyword(s, eol, "Tr")) {
+			float transparency = 0.f;
+			parse_floats(s, eol, &transparency, 1);
+			mtl.dissolve = 1.f - transparency;
+		}
+		else if (keyword(s, eol, "illum")) {
+			int illum;
+			if (parse_int(s, eol, illum)) mtl.illum = illum;
+		}
+	}
+	if (open) named[name] = materials.Add(convert_material(mtl));
+	return true;
+}
+#pragma endregion
+
+#pragma region Chunks
+/*
+ * corner of a face, indices are 0-based and -1 where the corner has no uv/normal.
+ * indices counted back from the last vertex are relative to the start of the chunk
+ * (bits of relative) until the vertex counts of the chunks before are known
+ */
+struct ObjCorner {
+	int v, vt, vn;
+	int relative;
+
+	bool operator==(const ObjCorner &corner) const { return v == corner.v && vt == corner.vt && vn == corner.vn; }
+};
+
+struct ObjCornerHash {
+	size_t operator()(const ObjCorner &corner) const {
+		return (size_t)corner.v * 73856093u ^ (size_t)corner.vt * 19349663u ^ (size_t)corner.vn * 83492791u;
+	}
+};
+
+/*
+ * lines of the file parsed by one job
+ */
+struct ObjChunk {
+	const char *begin;
+	const char *end;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	// three per triangle
+	std::vector<ObjCorner> corners;
+	// per triangle, index in usemtl or -1 for the material still active from the chunks before
+	std::vector<int> faceMaterial;
+	std::vector<std::string> usemtl;
+	std::vector<std::string> mtllib;
+	int skipped;
+
+	// set while merging: position of the chunk's first vertices and triangle in the whole file
+	int positionOffset, uvOffset, normalOffset, triangleOffset;
+	// ids of usemtl, and of the material active when the chunk starts
+	std::vector<MaterialID> materialIds;
+	MaterialID inherited;
+};
+
+/*
+ * one face corner (v, v/vt, v//vn or v/vt/vn), false if it has no valid position index
+ */
+static bool parse_corner(const char *&p, const char *end, const ObjChunk &chunk, ObjCorner &corner) {
+	int *index[3] = { &corner.v, &corner.vt, &corner.vn };
+	int local[3] = { (int)chunk.positions.size(), (int)chunk.uvs.size(), (int)chunk.normals.size() };
+	corner.v = corner.vt = corner.vn = -1;
+	corner.relative = 0;
+	for (int k = 0; k < 3; k++) {
+		int value;
+		if (parse_int(p, end, value)) {
+			if (value > 0)
+				*index[k] = value - 1;
+			else if (value < 0) {
+				*index[k] = local[k] + value;
+				corner.relative |= 1 << k;
+			}
+			// 0 is not an index, left missing
+		}
+		if (p >= end || *p != '/') break;
+		p++;
+	}
+	return corner.v >= 0 || (corner.relative & 1);
+}
+
+static void parse_face(const char *p, const char *end, ObjChunk &chunk, int material) {
+	size_t firstCorner = chunk.corners.size();
+	ObjCorner first, previous, corner;
+	int count = 0;
+	bool valid = true;
+	while ((p = skip_space(p, end)) < end) {
+		if (!parse_corner(p, end, chunk, corner))
+			valid = false;
+		p = skip_token(p, end);
+		// fan triangulation, fine for the convex polygons exporters write
+		if (count == 0)
+			first = corner;
+		else if (count >= 2) {
+			chunk.corners.push_back(first);
+			chunk.corners.push_back(previous);
+			chunk.corners.push_back(corner);
+		}
+		previous = corner;
+		count++;
+	}
+	if (!valid || count < 3) {
+		chunk.corners.resize(firstCorner);
+		chunk.skipped++;
+		return;
+	}
+	chunk.faceMaterial.resize(chunk.corners.size() / 3, material);
+}
+
+static void parse_chunk(ObjChunk &chunk) {
+	int material = -1;
+	const char *p = chunk.begin;
+	while (p < chunk.end) {
+		const char *eol = line_end(p, chunk.end);
+		const char *s = skip_space(p, eol);
+		p = eol + 1;
+		if (s == eol) continue;
+
+		if (s[0] == 'v' && s + 1 < eol && is_space(s[1])) {
+			glm::vec3 position(0.f);
+			parse_floats(s + 1, eol, &position.x, 3);
+			chunk.positions.push_back(position);
+		}
+		else if (s[0] == 'v' && s + 2 < eol && s[1] == 't' && is_space(s[2])) {
+			glm::vec2 uv(0.f);
+			parse_floats(s + 2, eol, &uv.x, 2);
+			chunk.uvs.push_back(uv);
+		}
+		else if (s[0] == 'v' && s + 2 < eol && s[1] == 'n' && is_space(s[2])) {
+			glm::vec3 normal(0.f, 1.f, 0.f);
+			parse_floats(s + 2, eol, &normal.x, 3);
+			chunk.normals.push_back(normal);
+		}
+		else if (s[0] == 'f' && s + 1 < eol && is_space(s[1]))
+			parse_face(s + 1, eol, chunk, material);
+		else if (keyword(s, eol, "usemtl")) {
+			chunk.usemtl.push_back(rest_of_line(s, eol));
+			material = (int)chunk.usemtl.size() - 1;
+		}
+		else if (keyword(s, eol, "mtllib"))
+			parse_mtllib(s, eol, chunk.mtllib);
+	}
+}
+
+static void parse_chunks_job(int begin, int end, void *arg) {
+	ObjChunk *chunks = (ObjChunk*)arg;
+	for (int i = begin; i < end; i++)
+		parse_chunk(chunks[i]);
+}
+
+/*
+ * vertices and faces of the whole file
+ */
+struct ObjData {
+	ObjChunk *chunks;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;
+	// per triangle, SKIPPED_FACE if an index is out of range
+	std::vector<MaterialID> faceMaterial;
+};
+
+// resolves a relative index, false if out of range
+static bool resolve_index(int &index, bool relative, int offset, int count) {
+	if (relative) index += offset;
+	else if (index < 0) return true;
+	return index >= 0 && index < count;
+}
+
+/*
+ * copies a chunk into the file arrays once the offsets are known, then frees it
+ */
+static void merge_chunks_job(int begin, int end, void *arg) {
+	ObjData &data = *(ObjData*)arg;
+	for (int i = begin; i < end; i++) {
+		ObjChunk &chunk = data.chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + chunk.positionOffset);
+		std::copy(chunk.uvs.begin(), chunk.uvs.end(), data.uvs.begin() + chunk.uvOffset);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + chunk.normalOffset);
+
+		int triangles = (int)chunk.faceMaterial.size();
+		for (int t = 0; t < triangles; t++) {
+			bool valid = true;
+			for (int k = 0; k < 3; k++) {
+				ObjCorner corner = chunk.corners[3 * t + k];
+				valid &= resolve_index(corner.v, (corner.relative & 1) != 0, chunk.positionOffset, (int)data.positions.size());
+				valid &= resolve_index(corner.vt, (corner.relative & 2) != 0, chunk.uvOffset, (int)data.uvs.size());
+				valid &= resolve_index(corner.vn, (corner.relative & 4) != 0, chunk.normalOffset, (int)data.normals.size());
+				corner.relative = 0;
+				data.corners[3 * (chunk.triangleOffset + t) + k] = corner;
+			}
+			int slot = chunk.faceMaterial[t];
+			MaterialID material = slot < 0 ? chunk.inherited : chunk.materialIds[slot];
+			data.faceMaterial[chunk.triangleOffset + t] = valid ? material : SKIPPED_FACE;
+			if (!valid) chunk.skipped++;
+		}
+
+		std::vector<glm::vec3>().swap(chunk.positions);
+		std::vector<glm::vec2>().swap(chunk.uvs);
+		std::vector<glm::vec3>().swap(chunk.normals);
+		std::vector<ObjCorner>().swap(chunk.corners);
+		std::vector<int>().swap(chunk.faceMaterial);
+	}
+}
+#pragma endregion
+
+#pragma region Meshes
+/*
+ * triangles of one material and the mesh made of them
+ */
+struct ObjMesh {
+	MaterialID material;
+	// range in ObjMeshes::order
+	int first;
+	int count;
+	TriangleMesh mesh;
+};
+
+static bool larger_mesh(const ObjMesh &a, const ObjMesh &b) { return a.count > b.count; }
+
+struct ObjMeshes {
+	const ObjData *data;
+	ObjMesh *meshes;
+	// triangles grouped by mesh
+	std::vector<int> order;
+};
+
+/*
+ * fills the mesh buffers, corners with the same position/uv/normal share a vertex, and builds the BVH
+ */
+static void build_meshes_job(int begin, int end, void *arg) {
+	ObjMeshes &work = *(ObjMeshes*)arg;
+	const ObjData &data = *work.data;
+	for (int m = begin; m < end; m++) {
+		ObjMesh &group = work.meshes[m];
+		const int *triangles = &work.order[group.first];
+
+		// uvs and normals are kept only if every corner has them
+		bool hasUV = true, hasNormal = true;
+		for (int i = 0; i < group.count; i++)
+			for (int k = 0; k < 3; k++) {
+				const ObjCorner &corner = data.corners[3 * triangles[i] + k];
+				hasUV &= corner.vt >= 0;
+				hasNormal &= corner.vn >= 0;
+			}
+
+		TriangleMesh &mesh = group.mesh;
+		mesh = TriangleMesh(group.material);
+		mesh.indices.reserve(3 * group.count);
+		std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> vertices;
+		vertices.reserve(group.count);
+		for (int i = 0; i < group.count; i++)
+			for (int k = 0; k < 3; k++) {
+				ObjCorner corner = data.corners[3 * triangles[i] + k];
+				if (!hasUV) corner.vt = -1;
+				if (!hasNormal) corner.vn = -1;
+				std::pair<std::unordered_map<ObjCorner, unsigned int, ObjCornerHash>::iterator, bool> inserted =
+					vertices.insert(std::make_pair(corner, (unsigned int)mesh.positions.size()));
+				if (inserted.second) {
+					mesh.positions.push_back(data.positions[corner.v]);
+					if (hasUV) mesh.uvs.push_back(data.uvs[corner.vt]);
+					if (hasNormal) mesh.normals.push_back(glm::normalize(data.normals[corner.vn]));
+				}
+				mesh.indices.push_back(inserted.first->second);
+			}
+		// the big ones are built afterwards with the whole pool
+		if (group.count < PARALLEL_MESH_BUILD)
+			mesh.Build();
+	}
+}
+#pragma endregion
+
+bool LoadOBJ(const char *path, PrimitiveList &primitives, MaterialTable &materials, ThreadPool &pool, ObjLoadStats *stats) {
+	ObjLoadStats local;
+	if (!stats) stats = &local;
+	memset(stats, 0, sizeof(ObjLoadStats));
+	Timer timer;
+
+	std::vector<char> text;
+	if (!read_file(path, text))
+		return false;
+	stats->bytes = text.size();
+	stats->readTime = timer.Seconds();
+	timer.Reset();
+
+	/*
+	 * splits the text at line ends into a few chunks per thread and parses them in parallel
+	 */
+	size_t chunkSize = text.size() / (4 * pool.getThreadCount()) + 1;
+	chunkSize = std::max((size_t)OBJ_MIN_CHUNK_SIZE, std::min((size_t)OBJ_CHUNK_SIZE, chunkSize));
+	std::vector<ObjChunk> chunks;
+	const char *begin = text.empty() ? NULL : &text[0];
+	const char *end = begin + text.size();
+	for (const char *p = begin; p < end;) {
+		const char *stop = p + std::min(chunkSize, (size_t)(end - p));
+		if (stop < end) {
+			stop = line_end(stop, end);
+			stop = stop < end ? stop + 1 : end;
+		}
+		chunks.push_back(ObjChunk());
+		chunks.back().begin = p;
+		chunks.back().end = stop;
+		chunks.back().skipped = 0;
+		p = stop;
+	}
+	if (!chunks.empty())
+		pool.ParallelFor((int)chunks.size(), 1, parse_chunks_job, &chunks[0]);
+	stats->parseTime = timer.Seconds();
+	timer.Reset();
+
+	/*
+	 * material libraries, relative to the folder of the .obj
+	 */
+	std::string folder = folder_of(path);
+	int firstMaterial = materials.size();
+	std::map<std::string, MaterialID> named;
+	std::set<std::string> libraries;
+	for (unsigned int i = 0; i < chunks.size(); i++)
+		for (unsigned int l = 0; l < chunks[i].mtllib.size(); l++) {
+			if (!libraries.insert(chunks[i].mtllib[l]).second) continue;
+			if (!load_mtl(folder + chunks[i].mtllib[l], materials, named))
+				std::cerr << "Could not read material library " << folder + chunks[i].mtllib[l] << std::endl;
+		}
+
+	/*
+	 * offsets of every chunk and the material each usemtl refers to
+	 */
+	ObjData data;
+	data.chunks = chunks.empty() ? NULL : &chunks[0];
+	int positions = 0, uvs = 0, normals = 0, triangles = 0;
+	int defaultMaterial = -1;
+	// material of the last usemtl so far, -1 before the first
+	int active = -1;
+	for (unsigned int i = 0; i < chunks.size(); i++) {
+		ObjChunk &chunk = chunks[i];
+		chunk.positionOffset = positions;
+		chunk.uvOffset = uvs;
+		chunk.normalOffset = normals;
+		chunk.triangleOffset = triangles;
+		positions += (int)chunk.positions.size();
+		uvs += (int)chunk.uvs.size();
+		normals += (int)chunk.normals.size();
+		triangles += (int)chunk.faceMaterial.size();
+
+		// faces before the first usemtl of the file
+		if (active < 0 && !chunk.faceMaterial.empty() && chunk.faceMaterial[0] < 0)
+			active = (int)default_material(materials, defaultMaterial);
+		chunk.inherited = (MaterialID)std::max(active, 0);
+		for (unsigned int m = 0; m < chunk.usemtl.size(); m++) {
+			std::map<std::string, MaterialID>::iterator found = named.find(chunk.usemtl[m]);
+			if (found == named.end()) {
+				std::cerr << "Material " << chunk.usemtl[m] << " not found in the material libraries" << std::endl;
+				found = named.insert(std::make_pair(chunk.usemtl[m], default_material(materials, defaultMaterial))).first;
+			}
+			chunk.materialIds.push_back(found->second);
+		}
+		if (!chunk.materialIds.empty())
+			active = (int)chunk.materialIds.back();
+	}
+
+	data.positions.resize(positions);
+	data.uvs.resize(uvs);
+	data.normals.resize(normals);
+	data.corners.resize(3 * (size_t)triangles);
+	data.faceMaterial.resize(triangles);
+	if (!chunks.empty())
+		pool.ParallelFor((int)chunks.size(), 1, merge_chunks_job, &data);
+	std::vector<char>().swap(text);
+
+	/*
+	 * groups the triangles by material (counting sort), one mesh each
+	 */
+	std::vector<int> meshOf(materials.size(), -1);
+	std::vector<ObjMesh> groups;
+	for (int t = 0; t < triangles; t++) {
+		MaterialID material = data.faceMaterial[t];
+		if (material == SKIPPED_FACE) continue;
+		if (meshOf[material] < 0) {
+			meshOf[material] = (int)groups.size();
+			groups.push_back(ObjMesh());
+			groups.back().material = material;
+			groups.back().count = 0;
+		}
+		groups[meshOf[material]].count++;
+	}
+	// the largest meshes first so that a big one is not left building alone at the end
+	std::sort(groups.begin(), groups.end(), larger_mesh);
+	ObjMeshes work;
+	work.data = &data;
+	work.meshes = groups.empty() ? NULL : &groups[0];
+	int first = 0;
+	for (unsigned int m = 0; m < groups.size(); m++) {
+		meshOf[groups[m].material] = m;
+		groups[m].first = first;
+		first += groups[m].count;
+		groups[m].count = 0;
+	}
+	work.order.resize(first);
+	for (int t = 0; t < triangles; t++) {
+		MaterialID material = data.faceMaterial[t];
+		if (material == SKIPPED_FACE) continue;
+		ObjMesh &group = groups[meshOf[material]];
+		work.order[group.first + group.count++] = t;
+	}
+	for (unsigned int i = 0; i < chunks.size(); i++)
+		stats->skipped += chunks[i].skipped;
+	stats->mergeTime = timer.Seconds();
+	timer.Reset();
+
+	if (!groups.empty())
+		pool.ParallelFor((int)groups.size(), 1, build_meshes_job, &work);
+	for (unsigned int m = 0; m < groups.size(); m++) {
+		if (!groups[m].mesh.isBuilt())
+			groups[m].mesh.Build(&pool);
+		stats->vertices += (int)groups[m].mesh.positions.size();
+		stats->triangles += groups[m].mesh.getTriangleCount();
+		primitives.Add(groups[m].mesh);
+	}
+	stats->meshes = (int)groups.size();
+	stats->materials = materials.size() - firstMaterial;
+	stats->buildTime = timer.Seconds();
+	return true;
+}
+
+bool ObjDependencies(const char *path, std::vector<std::string> &files) {
+	std::vector<char> text;
+	if (!read_file(path, text))
+		return false;
+	std::string folder = folder_of(path);
+	std::vector<std::string> names;
+	const char *p = text.empty() ? NULL : &text[0];
+	const char *end = p + text.size();
+	while (p < end) {
+		const char *eol = line_end(p, end);
+		const char *s = skip_space(p, eol);
+		p = eol + 1;
+		if (s < eol && *s == 'm' && keyword(s, eol, "mtllib"))
+			parse_mtllib(s, eol, names);
+	}
+	std::set<std::string> libraries;
+	for (unsigned int i = 0; i < names.size(); i++)
+		if (libraries.insert(names[i]).second)
+			files.push_back(folder + names[i]);
+	return true;
+}
+
+void ReportObjLoad(const char *path, const ObjLoadStats &stats) {
+	double seconds = stats.readTime + stats.parseTime + stats.mergeTime + stats.buildTime;
+	std::cout << "Loaded " << path << ": " << stats.triangles << " triangles, " << stats.vertices << " vertices, "
+		<< stats.meshes << " meshes, " << stats.materials << " materials in " << seconds << " s (read "
+		<< stats.readTime << " s, parse " << stats.parseTime << " s at " << stats.bytes / stats.parseTime / 1e6 << " MB/s, merge "
+		<< stats.mergeTime << " s, build " << stats.buildTime << " s)" << std::endl;
+	if (stats.skipped)
+		std::cout << "Skipped " << stats.skipped << " faces with invalid indices" << std::endl;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Material.h"
+#include "PrimitiveList.h"
+#include "ThreadPool.h"
+
+/*
+ * Statistics of one LoadOBJ call, times in seconds
+ */
+struct ObjLoadStats {
+	double readTime;	// file into memory
+	double parseTime;	// text to vertex and face lists, in parallel over chunks of lines
+	double mergeTime;	// chunks joined, relative indices and materials resolved, faces grouped by material
+	double buildTime;	// index buffers and mesh BVHs, in parallel over meshes
+	size_t bytes;
+	int vertices;		// mesh vertices after merging identical position/uv/normal corners
+	int triangles;
+	int meshes;
+	int materials;		// materials added to the table
+	int skipped;		// faces dropped for missing or out of range indices
+};
+
+/*
+ * Wavefront OBJ loader
+ * reads v/vt/vn/f (polygons are fan triangulated, negative indices count back from the last vertex),
+ * usemtl and mtllib; groups, objects and smoothing groups are ignored.
+ * the faces of each material become one TriangleMesh added to primitives and the materials of the
+ * .mtl files are appended to materials.
+ * parsing and mesh building run on the pool. returns false if the file could not be read
+ */
+bool LoadOBJ(const char *path, PrimitiveList &primitives, MaterialTable &materials, ThreadPool &pool, ObjLoadStats *stats = NULL);
+
+/*
+ * paths of the .mtl files an .obj refers to, appended to files. only the mtllib lines are looked at.
+ * returns false if the file could not be read
+ */
+bool ObjDependencies(const char *path, std::vector<std::string> &files);
+
+/*
+ * prints the counts and times of a load
+ */
+void ReportObjLoad(const char *path, const ObjLoadStats &stats);
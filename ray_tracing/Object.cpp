@@ -11,55 +11,38 @@ float fmax(float f1,float f2, float f3) {
 }
 
 /*
- * Calculate area of triangle with Heron's Formula
+ * Moller-Trumbore ray-triangle kernel
  */
-float TriangleArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
-{
-	// compute sides of triangle
-	float a = glm::length(p2-p1);
-	float b = glm::length(p3-p2);
-	float c = glm::length(p3-p1);
-	// apply Heron's formula
-	float s = (a+b+c)/2;
-	float area = sqrt(s*(s-a)*(s-b)*(s-c));
-
-	return area;
-}
+bool MollerTrumbore(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2, float &t, float &u, float &v) {
+	glm::vec3 p = glm::cross(ray.direction, e2);
+	float det = glm::dot(e1, p);
+	if (det == 0.f) return false;
+	float invDet = 1.f / det;
 
-/*
- * Check if a point is inside a given triangle by comparing subsequent areas
- */
-bool checkPointInArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec3 p){
-	float area = TriangleArea(p1, p2, p3);
-	float area_diff = abs(area - (TriangleArea(p1, p2, p) + TriangleArea(p1, p, p3) + TriangleArea(p, p2, p3)));
-	if (area_diff > area * 0.01)
-		return false;
+	glm::vec3 s = ray.origin - v0;
+	u = glm::dot(s, p) * invDet;
+	if (u < 0.f || u > 1.f) return false;
+
+	glm::vec3 q = glm::cross(s, e1);
+	v = glm::dot(ray.direction, q) * invDet;
+	if (v < 0.f || v > 1.f) return false;
+
+	t = glm::dot(e2, q) * invDet;
 	return true;
 }
 
 /*
- * Default Material constructor
- */
-Material::Material():
-    ambient(.0f),
-    diffuse(.0f),
-    specular(.0f),
-	glossiness(.0f),
-	refraction(.0f)
-{}
-
-/*
- * Material constructor with defined properties
+ * check if the point at time t is no further than MAX from the ray origin (avoids the sqrt)
  */
-Material::Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float glossiness, float reflection, float refraction):
-    ambient(ambient), diffuse(diffuse), specular(specular),	glossiness(glossiness),
-	reflection(reflection),	refraction(refraction){}
+static inline bool withinDistance(const Ray &ray, float t, float MAX) {
+	return t*t*glm::dot(ray.direction, ray.direction) <= MAX*MAX;
+}
 
 /*
  * Object constructor
  * Superclass
  */
-Object::Object(const Material &material):
+Object::Object(MaterialID material):
    material(material)
 {}
 
@@ -67,7 +50,7 @@ Object::Object(const Material &material):
  * Sphere constructor
  * Subclass
  */
-Sphere::Sphere(glm::vec3 center, float radius, const Material &material):
+Sphere::Sphere(glm::vec3 center, float radius, MaterialID material):
 Object(material)
 {
 	this->centroid = center;
@@ -77,15 +60,14 @@ Object(material)
 /* Polygon constructor
  * Subclass
  */
-Plane::Plane(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4, const Material &material):
+Plane::Plane(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4, MaterialID material):
 Object(material)
 {
-	if(!vertices.empty()) vertices.clear();
 	// store vertices
-	vertices.push_back(v1); 
-	vertices.push_back(v2); 
-	vertices.push_back(v3); 
-	vertices.push_back(v4); 
+	vertices[0] = v1;
+	vertices[1] = v2;
+	vertices[2] = v3;
+	vertices[3] = v4;
 	
 	// temp vectors
 	glm::vec3 u = vertices[1] - vertices[0];
@@ -102,20 +84,23 @@ Object(material)
 	radius = a > b ? a/2 : b/2;
 	radius += 0.1;
 	centroid = (vertices[0] + vertices[1] + vertices[2] + vertices[3]) / 4.f;
+
+	// the fourth vertex closes a parallelogram if it is where the two edges from the first one meet
+	glm::vec3 gap = vertices[1] + vertices[3] - vertices[0] - vertices[2];
+	parallelogram = glm::length(gap) <= 1e-5f * radius;
 }
 
 /*
  * Triangle constructor
  * Subclass
  */
-Triangle::Triangle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, const Material &material):
+Triangle::Triangle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, MaterialID material):
 Object(material)
 {
-	if(!vertices.empty()) vertices.clear();
 	// store vertices
-	vertices.push_back(v1); 
-	vertices.push_back(v2); 
-	vertices.push_back(v3); 
+	vertices[0] = v1;
+	vertices[1] = v2;
+	vertices[2] = v3;
 	
 	// temp vectors
 	glm::vec3 u = vertices[1] - vertices[0];
@@ -164,7 +149,7 @@ bool Sphere::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
 			if(t < info.time){
 				info.time = t;
 				info.hitPoint = ray(info.time);
-				info.material = &this->material;
+				info.material = material;
 				info.normal = (info.hitPoint - centroid)/radius;
 				return true;
 			}
@@ -176,62 +161,83 @@ bool Sphere::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
  * Ray-Plane intersection 
  */
 bool Plane::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
-	// check if ray is not parallel to polygon
-	if(glm::dot(ray.direction,this->normal) != 0.f){
-		// calculate t coefficient of line being axis aligned with polygon
-		float t = glm::dot((vertices[0] - ray.origin),this->normal)/glm::dot(ray.direction,this->normal);
-		glm::vec3 point = ray(t);
-		
-		// check if point is between origin and light
-		if(t < 0.0f || glm::length(point - ray.origin) > MAX){ return false; } 			
+	float t, u, v;
+	if (parallelogram) {
+		// u, v run along the two edges leaving the first vertex
+		if (!MollerTrumbore(ray, vertices[0], vertices[1] - vertices[0], vertices[3] - vertices[0], t, u, v))
+			return false;
+	}
+	else {
+		// two triangles, barycentrics mapped to the same edge coordinates as above
+		float b1, b2;
+		if (MollerTrumbore(ray, vertices[0], vertices[1] - vertices[0], vertices[2] - vertices[0], t, b1, b2) && b1 + b2 <= 1.f) {
+			u = b1 + b2;
+			v = b2;
+		}
+		else if (MollerTrumbore(ray, vertices[0], vertices[2] - vertices[0], vertices[3] - vertices[0], t, b1, b2) && b1 + b2 <= 1.f) {
+			u = b1;
+			v = b1 + b2;
+		}
+		else
+			return false;
+	}
 
-		// check by rough estimate, ignores points that are aligned with plane, but far from it
-		if(glm::distance(centroid, point) > radius){ return false; }
+	// check if point is between origin and light, and closer than any previous intersection
+	if (t < 0.f || t >= info.time || !withinDistance(ray, t, MAX))
+		return false;
 
-		// check if its actually inside polygon
-		if(checkPointInArea(vertices[0], vertices[1], vertices[2], point) || (checkPointInArea(vertices[0], vertices[2], vertices[3], point)))
-			
-			// check if it is closer than any previous intersection
-			if(t < info.time){
-				info.time = t;
-				info.hitPoint = ray(info.time);
-				info.material = &this->material;
-				info.normal = this->normal;
-				return true;
-			}
-		
-	}
-	return false; 
+	info.time = t;
+	info.hitPoint = ray(t);
+	info.material = material;
+	info.normal = this->normal;
+	info.u = u;
+	info.v = v;
+	return true;
 }
 
 /*
  * Ray-Triangle intersection
  */
 bool Triangle::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const { 
-	// check if ray is not parallel to triangle
-	if(glm::dot(ray.direction,this->normal) != 0.f){
-		// calculate t coefficient of line being axis aligned with triangle
-		float t = glm::dot((vertices[0] - ray.origin),this->normal)/glm::dot(ray.direction,this->normal);
-		glm::vec3 point = ray(t);
+	float t, u, v;
+	if (!MollerTrumbore(ray, vertices[0], vertices[1] - vertices[0], vertices[2] - vertices[0], t, u, v) || u + v > 1.f)
+		return false;
 
-		// check if point is between origin and light
-		if(t < 0.0f || glm::length(point-ray.origin) > MAX){ return false; }
-			
-		// check by rough estimate, ignores points that are aligned with plane, but far from it
-		if (glm::distance(centroid, point) > radius){ return false; }
-
-		// check if its actually inside triangle
-		if(checkPointInArea(vertices[0], vertices[1], vertices[2], point))
-			
-			// check if it is closer than any previous intersection
-			if(t < info.time){
-				info.time = t;
-				info.hitPoint = ray(info.time);
-				info.material = &this->material;
-				info.normal = this->normal;
-				return true;
-			}
-		
-	}
-	return false; 
+	// check if point is between origin and light, and closer than any previous intersection
+	if (t < 0.f || t >= info.time || !withinDistance(ray, t, MAX))
+		return false;
+
+	info.time = t;
+	info.hitPoint = ray(t);
+	info.material = material;
+	info.normal = this->normal;
+	info.u = u;
+	info.v = v;
+	return true;
+}
+
+/*
+ * Bounding boxes
+ * flat objects are padded so that their boxes never have zero thickness
+ */
+AABB Sphere::getBounds() const {
+	return AABB(centroid - glm::vec3(radius), centroid + glm::vec3(radius));
+}
+
+AABB Plane::getBounds() const {
+	AABB box;
+	for (int i = 0; i < 4; i++)
+		box.Extend(vertices[i]);
+	box.min -= glm::vec3(1e-4f);
+	box.max += glm::vec3(1e-4f);
+	return box;
+}
+
+AABB Triangle::getBounds() const {
+	AABB box;
+	for (int i = 0; i < 3; i++)
+		box.Extend(vertices[i]);
+	box.min -= glm::vec3(1e-4f);
+	box.max += glm::vec3(1e-4f);
+	return box;
 }
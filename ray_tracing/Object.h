@@ -1,47 +1,33 @@
 #pragma once
 
 #include "Ray.h"
+#include "AABB.h"
+#include "Material.h"
 #include <vector>
 #include <iostream>
+
 /*
- * Material class
- * keeps material properties
+ * Moller-Trumbore ray-triangle kernel
+ * solves origin + t*direction = v0 + u*e1 + v*e2 for (t, u, v) without computing the plane hit first.
+ * fails if the ray is parallel to the edges' plane or u, v fall outside [0, 1];
+ * the caller checks u + v for triangles
  */
-class Material {
-public:
-	Material();
-	Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float glossiness, float reflection, float refraction);
-
-	/*
-	 * getter functions for reading member variables from outside
-	 */
-	float getAmbient(int channel) const { return ambient[channel]; };
-	float getDiffuse(int channel) const { return diffuse[channel]; };
-	float getSpecular(int channel) const { return specular[channel]; };
-	float getGlossiness() const { return glossiness; };
-	float getReflectivity() const { return reflection; };
-	float getRefraction() const { return refraction; };
-
-protected:
-	glm::vec3 ambient;
-	glm::vec3 diffuse;
-	glm::vec3 specular;
-	float glossiness;
-	float reflection;
-	float refraction;
-};
+bool MollerTrumbore(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2, float &t, float &u, float &v);
 
 /*
  * Object Class
- * keeps material properties
+ * keeps the id of its material in the scene's MaterialTable
+ *
+ * objects are stored by value in per-type arrays (see PrimitiveList), so there are no virtual
+ * functions: every subclass provides its own Intersect and getBounds and callers dispatch on the type
  */
 class Object {
 public:
-	Object(const Material &material);
-	virtual bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const { return false; }
+	Object(MaterialID material);
+	glm::vec3 getCentroid() const { return centroid; }
 protected:
 	glm::vec3 centroid;
-	Material material;
+	MaterialID material;
 	float radius;
 };
 
@@ -51,21 +37,31 @@ protected:
  */
 class Sphere : public Object {
 public:
-	Sphere(glm::vec3 center, float radius, const Material &material);
+	Sphere(glm::vec3 center, float radius, MaterialID material);
 	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	// box enclosing the object, used to build the acceleration structures
+	AABB getBounds() const;
+	float getRadius() const { return radius; }
 };
 
 /*
  * Polygon Object
  * keeps list of vertices, normal and material properties
+ * vertices are expected in order around the quad; parallelograms (the usual case) are tested
+ * in a single pass, any other quad as two triangles sharing the v1-v3 diagonal
  */
 class Plane : public Object {
 public:
-	Plane(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4, const Material &material);
+	Plane(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, glm::vec3 v4, MaterialID material);
 	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	// box enclosing the object, used to build the acceleration structures
+	AABB getBounds() const;
+	const glm::vec3 &getVertex(int i) const { return vertices[i]; }
+	bool isParallelogram() const { return parallelogram; }
 private:
-	std::vector<glm::vec3> vertices;
+	glm::vec3 vertices[4];
 	glm::vec3 normal;
+	bool parallelogram;
 };
 
 /*
@@ -74,9 +70,12 @@ private:
  */
 class Triangle : public Object {
 public:
-	Triangle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, const Material &material);
+	Triangle(glm::vec3 v1, glm::vec3 v2, glm::vec3 v3, MaterialID material);
 	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	// box enclosing the object, used to build the acceleration structures
+	AABB getBounds() const;
+	const glm::vec3 &getVertex(int i) const { return vertices[i]; }
 private:
-	std::vector<glm::vec3> vertices;
+	glm::vec3 vertices[3];
 	glm::vec3 normal;
 };
\ No newline at end of file
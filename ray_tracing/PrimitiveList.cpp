@@ -0,0 +1,91 @@
+#include "PrimitiveList.h"
+
+PrimitiveRef PrimitiveList::Add(const Sphere &sphere) {
+	spheres.push_back(sphere);
+	refs.push_back(MakePrimitiveRef(PRIMITIVE_SPHERE, (unsigned int)spheres.size() - 1));
+	return refs.back();
+}
+
+PrimitiveRef PrimitiveList::Add(const Plane &plane) {
+	planes.push_back(plane);
+	refs.push_back(MakePrimitiveRef(PRIMITIVE_PLANE, (unsigned int)planes.size() - 1));
+	return refs.back();
+}
+
+PrimitiveRef PrimitiveList::Add(const Triangle &triangle) {
+	triangles.push_back(triangle);
+	refs.push_back(MakePrimitiveRef(PRIMITIVE_TRIANGLE, (unsigned int)triangles.size() - 1));
+	return refs.back();
+}
+
+PrimitiveRef PrimitiveList::Add(TriangleMesh &mesh) {
+	meshes.push_back(TriangleMesh());
+	meshes.back().Swap(mesh);
+	if (!meshes.back().isBuilt())
+		meshes.back().Build();
+	refs.push_back(MakePrimitiveRef(PRIMITIVE_MESH, (unsigned int)meshes.size() - 1));
+	return refs.back();
+}
+
+PrimitiveRef PrimitiveList::Add(const Instance &instance) {
+	instances.push_back(instance);
+	refs.push_back(MakePrimitiveRef(PRIMITIVE_INSTANCE, (unsigned int)instances.size() - 1));
+	return refs.back();
+}
+
+void PrimitiveList::Clear() {
+	spheres.clear();
+	planes.clear();
+	triangles.clear();
+	meshes.clear();
+	instances.clear();
+	refs.clear();
+}
+
+int PrimitiveList::setFrame(float frame) {
+	int moved = 0;
+	for (unsigned int i = 0; i < instances.size(); i++)
+		if (instances[i].setFrame(frame))
+			moved++;
+	return moved;
+}
+
+AABB PrimitiveList::getBounds(PrimitiveRef ref) const {
+	unsigned int index = getPrimitiveIndex(ref);
+	switch (getPrimitiveType(ref)) {
+	case PRIMITIVE_SPHERE: return spheres[index].getBounds();
+	case PRIMITIVE_PLANE: return planes[index].getBounds();
+	case PRIMITIVE_TRIANGLE: return triangles[index].getBounds();
+	case PRIMITIVE_MESH: return meshes[index].getBounds();
+	case PRIMITIVE_INSTANCE: return instances[index].getBounds();
+	}
+	return AABB();
+}
+
+AABB PrimitiveList::getClippedBounds(PrimitiveRef ref, const AABB &box) const {
+	unsigned int index = getPrimitiveIndex(ref);
+	glm::vec3 vertices[4];
+	switch (getPrimitiveType(ref)) {
+	case PRIMITIVE_TRIANGLE:
+		for (int i = 0; i < 3; i++)
+			vertices[i] = triangles[index].getVertex(i);
+		return ClipPolygon(vertices, 3, box);
+	case PRIMITIVE_PLANE: {
+		const Plane &plane = planes[index];
+		for (int i = 0; i < 4; i++)
+			vertices[i] = plane.getVertex(i);
+		if (plane.isParallelogram())
+			return ClipPolygon(vertices, 4, box);
+		// the two triangles it is intersected as
+		AABB bounds = ClipPolygon(vertices, 3, box);
+		vertices[1] = vertices[3];
+		bounds.Extend(ClipPolygon(vertices, 3, box));
+		return bounds;
+	}
+	default: {
+		AABB bounds = getBounds(ref);
+		bounds.Clip(box);
+		return bounds;
+	}
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Instance.h"
+#include "Object.h"
+#include "PrimitiveRef.h"
+#include "TriangleMesh.h"
+#include <deque>
+#include <vector>
+
+/*
+ * PrimitiveList
+ * keeps the objects of a scene by value in one contiguous array per type,
+ * intersection dispatches on the reference type instead of through virtual calls
+ */
+class PrimitiveList {
+public:
+	PrimitiveRef Add(const Sphere &sphere);
+	PrimitiveRef Add(const Plane &plane);
+	PrimitiveRef Add(const Triangle &triangle);
+	// takes over the buffers of the mesh (left empty) and builds its BVH if that was not done yet
+	PrimitiveRef Add(TriangleMesh &mesh);
+	PrimitiveRef Add(const Instance &instance);
+	void Clear();
+	/*
+	 * moves the animated instances to a frame, returns how many moved.
+	 * the accelerators over the list have to be refit or built again afterwards
+	 */
+	int setFrame(float frame);
+
+	// number of primitives of all types
+	int size() const { return (int)refs.size(); }
+	bool empty() const { return refs.empty(); }
+	// primitives in the order they were added
+	PrimitiveRef operator[](int i) const { return refs[i]; }
+
+	AABB getBounds(PrimitiveRef ref) const;
+	/*
+	 * bounds of the part of a primitive inside box (see BVHClipFunction): triangles and planes are
+	 * clipped to it, the rest only have their bounds cut down to it
+	 */
+	AABB getClippedBounds(PrimitiveRef ref, const AABB &box) const;
+
+	bool Intersect(PrimitiveRef ref, const Ray &ray, IntersectInfo &info, float MAX) const {
+		unsigned int index = getPrimitiveIndex(ref);
+		switch (getPrimitiveType(ref)) {
+		case PRIMITIVE_SPHERE: return spheres[index].Intersect(ray, info, MAX);
+		case PRIMITIVE_PLANE: return planes[index].Intersect(ray, info, MAX);
+		case PRIMITIVE_TRIANGLE: return triangles[index].Intersect(ray, info, MAX);
+		case PRIMITIVE_MESH: return meshes[index].Intersect(ray, info, MAX);
+		case PRIMITIVE_INSTANCE: return instances[index].Intersect(ray, info, MAX);
+		}
+		return false;
+	}
+
+	/*
+	 * any hit closer than MAX, meshes and instances stop at the first primitive found
+	 */
+	bool Occluded(PrimitiveRef ref, const Ray &ray, float MAX) const {
+		if (getPrimitiveType(ref) == PRIMITIVE_MESH)
+			return meshes[getPrimitiveIndex(ref)].Occluded(ray, MAX);
+		if (getPrimitiveType(ref) == PRIMITIVE_INSTANCE)
+			return instances[getPrimitiveIndex(ref)].Occluded(ray, MAX);
+		IntersectInfo info;
+		return Intersect(ref, ray, info, MAX);
+	}
+
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	std::vector<Triangle> triangles;
+	// a deque so that adding a mesh never moves (copies) the others
+	std::deque<TriangleMesh> meshes;
+	// placed copies of shared models, the models are kept outside of the list
+	std::vector<Instance> instances;
+
+private:
+	friend class SceneCache;
+
+	std::vector<PrimitiveRef> refs;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * Primitive types stored by a PrimitiveList
+ */
+enum PrimitiveType {
+	PRIMITIVE_SPHERE = 0,
+	PRIMITIVE_PLANE = 1,
+	PRIMITIVE_TRIANGLE = 2,
+	PRIMITIVE_MESH = 3,
+	PRIMITIVE_INSTANCE = 4
+};
+
+/*
+ * Reference to one primitive of a PrimitiveList
+ * type in the top 4 bits, index into the array of that type in the rest
+ */
+typedef unsigned int PrimitiveRef;
+
+inline PrimitiveRef MakePrimitiveRef(PrimitiveType type, unsigned int index) { return ((unsigned int)type << 28) | index; }
+inline PrimitiveType getPrimitiveType(PrimitiveRef ref) { return (PrimitiveType)(ref >> 28); }
+inline unsigned int getPrimitiveIndex(PrimitiveRef ref) { return ref & 0x0fffffffu; }
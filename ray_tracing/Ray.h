@@ -3,7 +3,8 @@
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
-class Material;
+// index of a material in the scene's MaterialTable
+typedef unsigned int MaterialID;
 
 class Ray {
   public:
@@ -12,6 +13,11 @@ class Ray {
 	// end point
     glm::vec3 direction;
 
+    Ray():
+      origin(0.0f),
+      direction(0.0f)
+    {}
+
     Ray(const glm::vec3 &origin, const glm::vec3 &direction):
       origin(origin),
       direction(direction)
@@ -29,10 +35,13 @@ class Ray {
 class IntersectInfo {
   public:
     IntersectInfo():
-      time(std::numeric_limits<float>::infinity()),
       hitPoint(0.0f),
       normal(0.0f),
-      material(NULL)
+      time(std::numeric_limits<float>::infinity()),
+      u(0.0f),
+      v(0.0f),
+      material(0),
+      cell(-1)
     {}
 
     // The position of intersection
@@ -41,17 +50,12 @@ class IntersectInfo {
     glm::vec3 normal;
     // The time along the ray that the intersection occurs
     float time;
+    // Surface coordinates of the hit (barycentric for triangles, edge coordinates for planes)
+    float u, v;
     // The material of the object that was intersected
-    const Material *material;
-	
-	// overload
-    IntersectInfo &operator =(const IntersectInfo &rhs) {
-      hitPoint = rhs.hitPoint;
-      material = rhs.material;
-      normal = rhs.normal;
-      time = rhs.time;
-	  return *this;
-    }
+    MaterialID material;
+    // Where the acceleration structure found the hit (see Accelerator::IntersectFrom), -1 if it does not say
+    int cell;
 };
 
 class Payload {
@@ -59,10 +63,13 @@ class Payload {
     Payload():
       color(0.0f),
       numBounces_reflect(0.f),
-      numBounces_refract(0.f)
+      numBounces_refract(0.f),
+      numRays(0)
     {}
     
     glm::vec3 color;
     float numBounces_reflect;
 	float numBounces_refract;
+	// rays traced for this pixel (primary, shadow and secondary)
+	int numRays;
 };
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Ray.h"
+#include <cstring>
+
+// packets cover PACKET_WIDTH x PACKET_WIDTH pixels
+#define PACKET_WIDTH 4
+#define PACKET_SIZE (PACKET_WIDTH * PACKET_WIDTH)
+
+// one bit per ray of a packet
+typedef unsigned int RayMask;
+
+/*
+ * Ray Packet
+ * a group of coherent rays (neighbouring pixels, or their shadow rays) traced together,
+ * so that a box is tested against all of them at once and nodes no ray hits are culled for the whole group.
+ * origins and reciprocal directions are also kept in SoA form for the SIMD box test
+ */
+class RayPacket {
+public:
+	RayPacket():
+		count(0)
+	{
+		memset(origin, 0, sizeof(origin));
+		memset(invDir, 0, sizeof(invDir));
+	}
+
+	void Clear() { count = 0; }
+
+	/*
+	 * appends a ray, returns its index in the packet
+	 */
+	int Add(const Ray &ray) {
+		int i = count++;
+		rays[i] = ray;
+		for (int a = 0; a < 3; a++) {
+			origin[a][i] = ray.origin[a];
+			invDir[a][i] = 1.f / ray.direction[a];
+		}
+		return i;
+	}
+
+	// mask with a bit set for every ray in the packet
+	RayMask getMask() const { return (1u << count) - 1u; }
+
+	int count;
+	Ray rays[PACKET_SIZE];
+	// [axis][ray]
+	float origin[3][PACKET_SIZE];
+	float invDir[3][PACKET_SIZE];
+};
@@ -1,79 +1,93 @@
 #include "RayTracer.h"
 
+/*
+ * Frees the objects, materials and buffers of the current scene so that another one can be loaded
+ */
+void release_scene() {
+	delete objects_accel;
+	delete shadow_accel;
+	delete tile_scheduler;
+	objects_accel = shadow_accel = NULL;
+	tile_scheduler = NULL;
+	free(scene.pixel_r);
+	free(scene.pixel_g);
+	free(scene.pixel_b);
+	scene.pixel_r = scene.pixel_g = scene.pixel_b = NULL;
+	objects.Clear();
+	can_cast_shadow.Clear();
+	// after the lists, their instances refer to the models
+	models.clear();
+	materials.Clear();
+	lights.clear();
+	// after the lists and models, their meshes may still refer to the mapping
+	if (scene_cache) scene_cache->Release();
+}
+
 /*
  * Free Memory
  */
 void cleanup() {
-	for(unsigned int i = 0; i < objects.size(); ++i){
-		if(objects[i]){
-			delete objects[i];
-		}
-	}
-	for(unsigned int i = 0; i < can_cast_shadow.size(); ++i){
-		if(can_cast_shadow[i]){
-			delete can_cast_shadow[i];
-		}
-	}
+	release_scene();
+	delete thread_pool;
+	delete scene_cache;
+	thread_pool = NULL;
+	scene_cache = NULL;
 }
 
 /*
- * Runs through all objects and check if intersects with current ray
- * original ray
+ * Finds the closest object intersecting with current ray
+ * original ray, cell is the info.cell of the hit a secondary ray leaves (-1 for the others)
  */
-bool CheckIntersection(const Ray &ray, IntersectInfo &info) {
-	bool flag = false;
-	for(int i = 0; i < objects.size(); i++)
-		if(objects[i]->Intersect(ray,info, std::numeric_limits<float>::infinity()))
-			flag = true;
-		
-	return flag;
+bool CheckIntersection(const Ray &ray, IntersectInfo &info, int cell = -1) {
+	if (!objects_accel->IntersectFrom(ray, cell, info, std::numeric_limits<float>::infinity()))
+		return false;
+	ResolveMaterial(materials, info);
+	return true;
 }
 
 /*
- * Runs through all objects and check if intersects with current ray
+ * Checks if any object blocks the ray before it reaches the light
  * shadow ray
  */
-bool CheckIntersection_Shadow(const Ray &ray, IntersectInfo &info) {
-	bool flag = false;
-	float length_toLight = glm::length(light_pos - ray.origin);
-	for(int i = 0; i < can_cast_shadow.size(); i++)
-		if(can_cast_shadow[i]->Intersect(ray, info, length_toLight))
-			flag = true;
-		
-	return flag;
+bool CheckOcclusion(const Ray &ray, const glm::vec3 &light_position) {
+	float length_toLight = glm::length(light_position - ray.origin);
+	return shadow_accel->Occluded(ray, length_toLight);
 }
 
 /*
  * Calculate colour at given pixel
  */
-glm::vec3 calculateColor(IntersectInfo &info, Light &light, bool shadow_flag){
+glm::vec3 calculateColor(IntersectInfo &info, PointLight &point_light, bool shadow_flag){
+	Light &light = point_light.light;
+	const glm::vec3 &light_pos = point_light.position;
 	float r,g,b;
+	const Material &material = materials[info.material];
 
 	if(shadow_flag){
 		// calculate shadowed light for each colour channel
-		r = light.Ambient_Light(info.material->getAmbient(0));
-		g = light.Ambient_Light(info.material->getAmbient(1));
-		b = light.Ambient_Light(info.material->getAmbient(2));
+		r = light.Ambient_Light(material.getAmbient(0));
+		g = light.Ambient_Light(material.getAmbient(1));
+		b = light.Ambient_Light(material.getAmbient(2));
 	}
 	else{
 		// normalised vector from light position to current point
 		glm::vec3 lightToVertexUnitVector = glm::normalize(light_pos - info.hitPoint);
 		// normalised vector from camera position to current point
-		glm::vec3 cameraToVertexUnitVector = glm::normalize(camera_pos - info.hitPoint);
+		glm::vec3 cameraToVertexUnitVector = glm::normalize(camera.position - info.hitPoint);
 		// distance to light source
 		float distance = glm::length(light_pos - info.hitPoint);
 		// attenuation
 		float attenuation = light.Attenuation(distance);
 		// calculate light for each colour channel
-		r = light.Ambient_Light(info.material->getAmbient(0)) + 
-			attenuation * (light.Diffuse_Light(info.material->getDiffuse(0),info.normal, lightToVertexUnitVector) + 
-			light.Specular_Light(info.material->getSpecular(0), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, info.material->getGlossiness()));
-		g = light.Ambient_Light(info.material->getAmbient(1)) + 
-			attenuation * (light.Diffuse_Light(info.material->getDiffuse(1),info.normal, lightToVertexUnitVector) + 
-			light.Specular_Light(info.material->getSpecular(1), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, info.material->getGlossiness()));
-		b = light.Ambient_Light(info.material->getAmbient(2)) + 
-			attenuation * (light.Diffuse_Light(info.material->getDiffuse(2),info.normal, lightToVertexUnitVector) + 
-			light.Specular_Light(info.material->getSpecular(2), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, info.material->getGlossiness()));
+		r = light.Ambient_Light(material.getAmbient(0)) + 
+			attenuation * (light.Diffuse_Light(material.getDiffuse(0),info.normal, lightToVertexUnitVector) + 
+			light.Specular_Light(material.getSpecular(0), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, material.getGlossiness()));
+		g = light.Ambient_Light(material.getAmbient(1)) + 
+			attenuation * (light.Diffuse_Light(material.getDiffuse(1),info.normal, lightToVertexUnitVector) + 
+			light.Specular_Light(material.getSpecular(1), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, material.getGlossiness()));
+		b = light.Ambient_Light(material.getAmbient(2)) + 
+			attenuation * (light.Diffuse_Light(material.getDiffuse(2),info.normal, lightToVertexUnitVector) + 
+			light.Specular_Light(material.getSpecular(2), info.normal, -lightToVertexUnitVector, cameraToVertexUnitVector, material.getGlossiness()));
 	}
 
 	return glm::vec3(r,g,b);
@@ -82,19 +96,23 @@ glm::vec3 calculateColor(IntersectInfo &info, Light &light, bool shadow_flag){
 /*
  * Creates ray to check for shadows and calculate colour
  */
-glm::vec3 checkLight(IntersectInfo &info){
-	// temp variables for checking illumination
-	Ray check_luminance(info.hitPoint+info.normal*.1f,light_pos);
-	IntersectInfo temp;
-
-	/*
-	 * check if current point is visible by light source
-	 * if new casted ray intersects with some object then point is occluded,
-	 *		calculate only ambient illumination
-	 * else calculate full illumination
-	 */
-	return calculateColor(info, light_0, CheckIntersection_Shadow(check_luminance, temp));
-
+glm::vec3 checkLight(IntersectInfo &info, Payload &payload){
+	glm::vec3 colour(0.f);
+	glm::vec3 origin = info.hitPoint+info.normal*.1f;
+	for (unsigned int l = 0; l < lights.size(); l++){
+		// ray from the current point towards the light
+		Ray check_luminance(origin, lights[l].position - origin);
+		payload.numRays++;
+
+		/*
+		 * check if current point is visible by light source
+		 * if new casted ray intersects with some object then point is occluded,
+		 *		calculate only ambient illumination
+		 * else calculate full illumination
+		 */
+		colour += calculateColor(info, lights[l], CheckOcclusion(check_luminance, lights[l].position));
+	}
+	return colour;
 }
 
 /*
@@ -111,7 +129,7 @@ Ray reflect(const Ray &ray, IntersectInfo &info){
  * Calculates the direction of the refracted ray
  */
 Ray refract(const Ray &ray, IntersectInfo &info){
-	float mat_dif = glm::dot(info.normal,ray.direction) < 0 ? air_ref/info.material->getRefraction() : info.material->getRefraction()/air_ref;
+	float mat_dif = glm::dot(info.normal,ray.direction) < 0 ? air_ref/materials[info.material].getRefraction() : materials[info.material].getRefraction()/air_ref;
 	glm::vec3 norm = glm::dot(info.normal,ray.direction) < 0 ? info.normal : -info.normal;
 	float cosTheta = -glm::dot(norm, ray.direction);
 	float cosPhi2 = 1.f - mat_dif*mat_dif * (1.f - cosTheta*cosTheta);
@@ -125,12 +143,13 @@ Ray refract(const Ray &ray, IntersectInfo &info){
  */
 void CastReflection(Ray &ray, Payload &payload, IntersectInfo info){
 	if(payload.numBounces_reflect<MAX_BOUNCES)
-		if(info.material->getReflectivity()>0.f){
+		if(materials[info.material].getReflectivity()>0.f){
 			payload.numBounces_reflect++;
 			IntersectInfo temp;
 			Ray reflected_ray = reflect(ray, info);
-			if(CheckIntersection(reflected_ray, temp)){
-				payload.color += checkLight(temp) * info.material->getReflectivity();
+			payload.numRays++;
+			if(CheckIntersection(reflected_ray, temp, info.cell)){
+				payload.color += checkLight(temp, payload) * materials[info.material].getReflectivity();
 				CastRay(reflected_ray, payload, temp);
 			}
 		}
@@ -140,17 +159,18 @@ void CastReflection(Ray &ray, Payload &payload, IntersectInfo info){
  * Creates and casts refracted rays
  */
 void CastRefraction(Ray &ray, Payload &payload, IntersectInfo info){
-	if(info.material->getRefraction()>0.f){
+	if(materials[info.material].getRefraction()>0.f){
 		if(payload.numBounces_refract<MAX_BOUNCES){
 			payload.numBounces_refract++;
 			IntersectInfo temp;
 			Ray refracted_ray = refract(ray, info);
-			if(CheckIntersection(refracted_ray, temp))
+			payload.numRays++;
+			if(CheckIntersection(refracted_ray, temp, info.cell))
 					CastRay(refracted_ray, payload, temp);
 		}
 	}
 	else if(payload.numBounces_refract>0){
-		payload.color += checkLight(info);
+		payload.color += checkLight(info, payload);
 	}
 }
 
@@ -173,9 +193,9 @@ glm::vec3 CastRay(Ray &ray, Payload &payload, IntersectInfo &info) {
 void DrawOutput(OUTPUT &o){
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glBegin(GL_POINTS);
-	for (int x = 0; x < windowX; x++) {
-		for (int y = 0; y < windowY; y++) {
-			int index = x + y * windowX;
+	for (int x = 0; x < camera.width; x++) {
+		for (int y = 0; y < camera.height; y++) {
+			int index = x + y * camera.width;
 			glColor3f(o.pixel_r[index], o.pixel_g[index], o.pixel_b[index]);
 			glVertex3f(x, y, 0);
 		}
@@ -185,72 +205,187 @@ void DrawOutput(OUTPUT &o){
 	glutSwapBuffers();
 }
 
-void *thread_work(void *arg){
-	int offset = (int)arg;
-	int start_loop = 0 + offset;
-	int end_loop = windowX*windowY;
-
+/*
+ * Traces the pixels of one tile into the output buffers
+ * returns the number of rays traced
+ */
+long long render_tile(const Tile &tile){
 	glm::vec3 colour;
-	glm::mat4 viewMatrix = glm::lookAt(glm::vec3(-10.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 projMatrix = glm::perspective(45.0f, (float)windowX / (float)windowY, 1.0f, 10000.0f);
+	long long rays = 0;
 
+	for (int y = tile.y0; y < tile.y1; y++){
+		// step along the row from the first pixel of the tile
+		glm::vec3 direction = camera.PixelDirection(tile.x0, y);
+		for (int x = tile.x0; x < tile.x1; x++, direction += camera.stepX){
+			int i = x + y * camera.width;
 
-	for (int i = start_loop; i < end_loop; i += NUMTHREADS){
-		int x = i % windowX;
-		int y = i / windowX;
+			Payload payload;
+			IntersectInfo info;
+			Ray ray = camera.GenerateRay(direction);
+			payload.numRays++;
 
-		float pixelX = 2 * ((x + 0.5f) / windowX) - 1;
-		float pixelY = -2 * ((y + 0.5f) / windowY) + 1;
+			if (CheckIntersection(ray, info)) {
+				payload.color += checkLight(info, payload);
+				colour = CastRay(ray, payload, info);
+			}
+			else
+				colour = glm::vec3(0, 0, 0);
 
-		glm::vec4 worldNear = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, -1, 1);
-		glm::vec4 worldFar = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, 1, 1);
+			scene.pixel_r[i] = colour.r;
+			scene.pixel_g[i] = colour.g;
+			scene.pixel_b[i] = colour.b;
+			rays += payload.numRays;
+		}
+	}
+	return rays;
+}
 
-		glm::vec3 worldNearPos = glm::vec3(worldNear.x, worldNear.y, worldNear.z) / worldNear.w;
-		glm::vec3 worldFarPos = glm::vec3(worldFar.x, worldFar.y, worldFar.z) / worldFar.w;
+/*
+ * Traces the pixels of one tile a packet of neighbouring pixels at a time:
+ * primary rays as one packet, then the shadow rays of the pixels that hit something as another.
+ * reflected and refracted rays no longer travel together and are traced one by one
+ * returns the number of rays traced
+ */
+long long render_tile_packets(const Tile &tile){
+	long long rays = 0;
+	RayPacket primary, shadow;
+	// direction of the next pixel of every row, stepped across the tile as in render_tile
+	glm::vec3 rowDirection[PACKET_WIDTH];
+	IntersectInfo infos[PACKET_SIZE];
+	int pixels[PACKET_SIZE];
+	float distances[PACKET_SIZE];
+	int shadowIndex[PACKET_SIZE];
+	// direct light of every pixel, summed over the lights
+	glm::vec3 lighting[PACKET_SIZE];
+
+	for (int y0 = tile.y0; y0 < tile.y1; y0 += PACKET_WIDTH){
+		int y1 = std::min(y0 + PACKET_WIDTH, tile.y1);
+		for (int y = y0; y < y1; y++)
+			rowDirection[y - y0] = camera.PixelDirection(tile.x0, y);
+
+		for (int x0 = tile.x0; x0 < tile.x1; x0 += PACKET_WIDTH){
+			int x1 = std::min(x0 + PACKET_WIDTH, tile.x1);
+			primary.Clear();
+			for (int y = y0; y < y1; y++){
+				glm::vec3 &direction = rowDirection[y - y0];
+				for (int x = x0; x < x1; x++, direction += camera.stepX)
+					pixels[primary.Add(camera.GenerateRay(direction))] = x + y * camera.width;
+			}
+			for (int i = 0; i < primary.count; i++)
+				infos[i] = IntersectInfo();
+			RayMask hits = objects_accel->IntersectPacket(primary, infos, std::numeric_limits<float>::infinity());
+
+			for (int i = 0; i < primary.count; i++){
+				if (hits & (1u << i))
+					ResolveMaterial(materials, infos[i]);
+				lighting[i] = glm::vec3(0.f);
+			}
 
-		Payload payload;
-		IntersectInfo info;
-		Ray ray(worldNearPos, glm::normalize(glm::vec3(worldFarPos - worldNearPos)));
+			// same shadow rays as checkLight, one packet per light
+			for (unsigned int l = 0; l < lights.size(); l++){
+				const glm::vec3 &light_pos = lights[l].position;
+				shadow.Clear();
+				for (int i = 0; i < primary.count; i++){
+					if (!(hits & (1u << i))) continue;
+					glm::vec3 origin = infos[i].hitPoint + infos[i].normal*.1f;
+					shadowIndex[i] = shadow.Add(Ray(origin, light_pos - origin));
+					distances[shadowIndex[i]] = glm::length(light_pos - origin);
+				}
+				RayMask occluded = shadow_accel->OccludedPacket(shadow, distances);
+				for (int i = 0; i < primary.count; i++)
+					if (hits & (1u << i))
+						lighting[i] += calculateColor(infos[i], lights[l], (occluded & (1u << shadowIndex[i])) != 0);
+			}
 
-		if (CheckIntersection(ray, info)) {
-			payload.color += checkLight(info);
-			colour = CastRay(ray, payload, info);
+			for (int i = 0; i < primary.count; i++){
+				Payload payload;
+				glm::vec3 colour(0.f, 0.f, 0.f);
+				payload.numRays++;
+				if (hits & (1u << i)) {
+					payload.numRays += (int)lights.size();
+					payload.color += lighting[i];
+					colour = CastRay(primary.rays[i], payload, infos[i]);
+				}
+
+				scene.pixel_r[pixels[i]] = colour.r;
+				scene.pixel_g[pixels[i]] = colour.g;
+				scene.pixel_b[pixels[i]] = colour.b;
+				rays += payload.numRays;
+			}
 		}
-		else
-			colour = glm::vec3(0, 0, 0);
-		
-		scene.pixel_r[i] = colour.r;
-		scene.pixel_g[i] = colour.g;
-		scene.pixel_b[i] = colour.b;
 	}
+	return rays;
+}
 
-	pthread_exit((void*)0);
-	return NULL;
+/*
+ * Worker task, renders tiles until the scheduler runs out of them
+ * arg is the index of the tile queue the task starts from
+ */
+void thread_work(void *arg){
+	int worker = (int)(size_t)arg;
+
+	Tile tile;
+	long long rays = 0;
+	while (tile_scheduler->NextTile(worker, tile))
+		rays += use_packets ? render_tile_packets(tile) : render_tile(tile);
+	ray_counts[worker] = rays;
 }
 
-void render_threads(){
-	std::clock_t start = std::clock();
-	void *status;
-	// start threads
-	for (int i = 0; i < NUMTHREADS; i++){
-		pthread_create(&callThd[i], &attr, thread_work, (void *)i);
+/*
+ * Renders one frame into the output buffers with the thread pool
+ * returns the number of rays traced
+ */
+long long render_frame(){
+	// hand out the tiles again
+	tile_scheduler->Reset();
+	// one task per tile queue
+	for (int i = 0; i < num_threads; i++){
+		thread_pool->Submit(thread_work, (void *)(size_t)i);
 	}
 	// wait to finish
-	for (int i = 0; i < NUMTHREADS; i++){
-		pthread_join(callThd[i], &status);
-	}
+	thread_pool->Wait();
+
+	long long rays = 0;
+	for (int i = 0; i < num_threads; i++)
+		rays += ray_counts[i];
+	return rays;
+}
+
+void render_threads(){
+	Timer timer;
+	render_frame();
 	// draw output
 	DrawOutput(scene);
-	std::cout << "Done " << (std::clock() - start) / (double)(CLOCKS_PER_SEC / 100) / 100 << " s" << std::endl;
+	std::cout << "Done " << timer.Seconds() << " s" << std::endl;
 }
 
 void initialise_thread_variables(){
-	scene.pixel_r = (float*)malloc(NUMTHREADS*windowX*windowY*sizeof(float));
-	scene.pixel_g = (float*)malloc(NUMTHREADS*windowX*windowY*sizeof(float));
-	scene.pixel_b = (float*)malloc(NUMTHREADS*windowX*windowY*sizeof(float));
+	scene.pixel_r = (float*)malloc(camera.width*camera.height*sizeof(float));
+	scene.pixel_g = (float*)malloc(camera.width*camera.height*sizeof(float));
+	scene.pixel_b = (float*)malloc(camera.width*camera.height*sizeof(float));
+	tile_scheduler = new TileScheduler(camera.width, camera.height, num_threads);
+	ray_counts.assign(num_threads, 0);
+}
+
+/*
+ * Renders without a window and writes the image to disk
+ */
+int render_headless(const char *output, int bits){
+	initialise_thread_variables();
+
+	Timer timer;
+	long long rays = render_frame();
+	double seconds = timer.Seconds();
+
+	std::cout << "Rendered " << camera.width << "x" << camera.height << " on " << num_threads << " threads with " << SimdLevelName(getSimdLevel()) << " kernels" << (use_packets ? " and packets" : "") << " in "
+		<< seconds << " s, " << rays << " rays (" << rays / seconds / 1e6 << " Mrays/s)" << std::endl;
 
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	if (!WriteImage(output, scene.pixel_r, scene.pixel_g, scene.pixel_b, camera.width, camera.height, bits)) {
+		std::cerr << "Could not write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << output << std::endl;
+	return 0;
 }
 #pragma endregion
 /*
@@ -261,29 +396,17 @@ void Render() {
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glm::mat4 viewMatrix = glm::lookAt(glm::vec3(-10.0f,10.0f,10.0f), glm::vec3(0.0f,0.0f,0.0f), glm::vec3(0.0f,1.0f,0.0f));
-	glm::mat4 projMatrix = glm::perspective(45.0f, (float)windowX / (float)windowY, 1.0f, 10000.0f);
-
 	glBegin(GL_POINTS);
   
-	for(int x = 0; x < windowX; ++x)
-  		for(int y = 0; y < windowY; ++y){
-
-      			float pixelX =  2*((x+0.5f)/windowX)-1;
-      			float pixelY = -2*((y+0.5f)/windowY)+1;
-      
-      			glm::vec4 worldNear = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, -1, 1);
-      			glm::vec4 worldFar  = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY,  1, 1);
-      		
-      			glm::vec3 worldNearPos = glm::vec3(worldNear.x, worldNear.y, worldNear.z) / worldNear.w;
-      			glm::vec3 worldFarPos  = glm::vec3(worldFar.x, worldFar.y, worldFar.z) / worldFar.w;
-      
+	for(int x = 0; x < camera.width; ++x)
+  		for(int y = 0; y < camera.height; ++y){
+
 			Payload payload;
 			IntersectInfo info;
-			Ray ray(worldNearPos, glm::normalize(glm::vec3(worldFarPos - worldNearPos)));	
+			Ray ray = camera.GenerateRay(x, y);
 
 			if (CheckIntersection(ray, info)) {
-				payload.color += checkLight(info);
+				payload.color += checkLight(info, payload);
 				glm::vec3 color = CastRay(ray,payload, info);
 				glColor3f(color.x,color.y,color.z);
 			}
@@ -301,36 +424,40 @@ void Render() {
 }
 
 
-int main(int argc, char **argv) {
 #pragma region Create Scene
+/*
+ * Builds the scene compiled into the program
+ */
+void create_default_scene() {
 	/*
-	* Creates the floor with chess pattern
+	* Registers the shared materials, objects refer to them by id
 	*/
-	bool color_flag = true;
-	Material mat;
-	for (int i = 0; i > -11; i--)
-		for (int z = 0; z < 11; z++){
-			mat = color_flag ? white : black;
-			objects.push_back(new Plane(glm::vec3(i, 0.f, z),		// point 1
-				glm::vec3(i - 1, 0.f, z),				// point 2
-				glm::vec3(i - 1, 0.f, z + 1),				// point 3
-				glm::vec3(i, 0.f, z + 1),				// point 4  
-				mat)								// Material
-				);
-			color_flag = !color_flag;
-		}
+	MaterialID white_id = materials.Add(white);
+	MaterialID black_id = materials.Add(black);
+	MaterialID mirror_id = materials.Add(mirror);
+	/**/
+
+	/*
+	* Creates the light source
+	*/
+	lights.push_back(PointLight(glm::vec3(-6.f, 4.f, 3.f),	// position
+		Light(.7f, 1.f, .0f, .3f, .0f)));
 	/**/
 
 	/*
-	* Creates the floor overlay for shadow casting
+	* Creates the floor with chess pattern
+	* one plane, the texture picks white or black for each 1x1 square
 	*/
+	Material chess;
+	chess.setTexture(materials.AddTexture(new CheckerTexture(white_id, black_id, 11.f, 11.f)));
 	Plane floor(glm::vec3(0.f, 0.f, 0.f),		// point 1
 		glm::vec3(-11.f, 0.f, 0.f),				// point 2
 		glm::vec3(-11.f, 0.f, 11.f),			// point 3
 		glm::vec3(0.f, 0.f, 11.f),				// point 4
-		mat										// material
+		materials.Add(chess)					// material
 		);
-	can_cast_shadow.push_back(&floor);
+	objects.Add(floor);
+	can_cast_shadow.Add(floor);
 	/**/
 
 	/*
@@ -340,10 +467,10 @@ int main(int argc, char **argv) {
 		glm::vec3(0.f, 0.f, 11.f),				// point 2
 		glm::vec3(0.f, 11.f, 11.f),			// point 3
 		glm::vec3(0.f, 11.f, 0.f),				// point 4
-		mirror								// material
+		mirror_id							// material
 		);
-	objects.push_back(&front_right_wall);
-	can_cast_shadow.push_back(&front_right_wall);
+	objects.Add(front_right_wall);
+	can_cast_shadow.Add(front_right_wall);
 	/**/
 
 	/*
@@ -353,10 +480,10 @@ int main(int argc, char **argv) {
 		glm::vec3(0.f, 11.f, 0.f),				// point 2
 		glm::vec3(-11.f, 11.f, 0.f),			// point 3
 		glm::vec3(-11.f, 0.f, 0.f),				// point 4
-		mirror								// material
+		mirror_id							// material
 		);
-	objects.push_back(&front_left_wall);
-	can_cast_shadow.push_back(&front_left_wall);
+	objects.Add(front_left_wall);
+	can_cast_shadow.Add(front_left_wall);
 	/**/
 
 	/*
@@ -364,15 +491,15 @@ int main(int argc, char **argv) {
 	*/
 	Sphere ball(glm::vec3(-2.f, 1.f, 2.f),		  	// position
 		1.f,								// radius
-		Material(glm::vec3(0.f, .2f, .2f),  // ambient 
+		materials.Add(Material(glm::vec3(0.f, .2f, .2f),  // ambient 
 		glm::vec3(.3f, .5f, .5f),		// diffuse
 		glm::vec3(1.f, 1.f, 1.f),		// specular
 		10.f,						// glossiness
 		.0f,							// reflectivity			
-		1.5f)						// refractivity			
+		1.5f))						// refractivity			
 		);
-	objects.push_back(&ball);
-	can_cast_shadow.push_back(&ball);
+	objects.Add(ball);
+	can_cast_shadow.Add(ball);
 	/**/
 
 	/*
@@ -381,21 +508,450 @@ int main(int argc, char **argv) {
 	Triangle trigwno(glm::vec3(-5.f, 0.f, 1.f),	// point 1
 		glm::vec3(-4.f, 0.f, 3.f),			// point 2
 		glm::vec3(-4.f, 3.f, 2.f),			// point 3
-		Material(glm::vec3(.2f, .2f, .2f),	// ambient 
+		materials.Add(Material(glm::vec3(.2f, .2f, .2f),	// ambient 
 		glm::vec3(.5f, .5f, .0f),  			// diffuse
 		glm::vec3(1.f, 1.f, 1.f), 			// specular
 		3.f,								// glossiness
 		.0f,								// reflectivity
-		.0f)								// refractivity
+		.0f))								// refractivity
 		);
-	objects.push_back(&trigwno);
-	can_cast_shadow.push_back(&trigwno);
+	objects.Add(trigwno);
+	can_cast_shadow.Add(trigwno);
+	/**/
+}
+
+/*
+ * Acceleration structure of the given name (-accel), NULL if there is none by that name
+ */
+Accelerator *new_accelerator(const char *name) {
+	if (strcmp(name, "bvh") == 0) return new BVH(SIMD_BLOCK_SIZE, thread_pool);
+	if (strcmp(name, "bvh4") == 0) return new BVH4(thread_pool);
+	if (strcmp(name, "bvh8") == 0) return new BVH8(thread_pool);
+	if (strcmp(name, "bvh4q") == 0) return new BVH4Q(thread_pool);
+	if (strcmp(name, "bvh8q") == 0) return new BVH8Q(thread_pool);
+	if (strcmp(name, "grid") == 0) return new Grid(1, thread_pool);
+	if (strcmp(name, "grid2") == 0) return new Grid(2, thread_pool);
+	if (strcmp(name, "kd") == 0) return new KdTree();
+	if (strcmp(name, "list") == 0) return new ObjectList();
+	return NULL;
+}
+
+/*
+ * Loads a scene file (the built-in scene if scene_file is NULL) and the -obj models,
+ * then builds the acceleration structures. returns false if a file could not be read.
+ * accelerator is the -accel choice, NULL to take the scene file's (a binary BVH if it has none)
+ */
+bool create_scene(const char *scene_file, const std::vector<const char*> &obj_files, const char *accelerator) {
+	Timer timer;
+	std::string scene_accelerator;
+	if (!accelerator && scene_file && SceneAccelerator(scene_file, scene_accelerator)) {
+		Accelerator *known = new_accelerator(scene_accelerator.c_str());
+		if (known)
+			accelerator = scene_accelerator.c_str();
+		else
+			std::cout << "Unknown accelerator " << scene_accelerator << " in " << scene_file << ", using bvh" << std::endl;
+		delete known;
+	}
+	if (!accelerator)
+		accelerator = "bvh";
+	// only the binary BVHs are kept in the cache, the other structures are built over the mapped lists
+	bool use_bvh = strcmp(accelerator, "bvh") == 0;
+
+	/*
+	 * A scene file met before is mapped from the cache together with its BVHs
+	 */
+	unsigned long long key = 0;
+	// the builder shapes every BVH in the file, the meshes' too
+	std::string cache_name = std::string(accelerator) + "-" + BVHBuildMethodName(getBVHBuildMethod());
+	bool cached = scene_cache && scene_file && SceneCache::ComputeKey(scene_file, obj_files, cache_name.c_str(), key);
+	if (cached) {
+		BVH *objects_bvh = use_bvh ? new BVH(SIMD_BLOCK_SIZE, thread_pool) : NULL;
+		BVH *shadow_bvh = use_bvh ? new BVH(SIMD_BLOCK_SIZE, thread_pool) : NULL;
+		if (scene_cache->Load(key, camera, lights, materials, models, objects, can_cast_shadow, objects_bvh, shadow_bvh)) {
+			if (use_bvh) {
+				objects_accel = objects_bvh;
+				shadow_accel = shadow_bvh;
+			}
+			else {
+				objects_accel = new_accelerator(accelerator);
+				shadow_accel = new_accelerator(accelerator);
+				objects_accel->Build(objects);
+				shadow_accel->Build(can_cast_shadow);
+			}
+			std::cout << "Mapped " << scene_file << " from " << scene_cache->getPath(key) << ": " << objects.size() << " objects in "
+				<< timer.Milliseconds() << " ms" << std::endl;
+			return true;
+		}
+		delete objects_bvh;
+		delete shadow_bvh;
+	}
+	/**/
+
+	if (scene_file) {
+		if (!LoadScene(scene_file, camera, lights, materials, models, objects, can_cast_shadow, *thread_pool))
+			return false;
+		std::cout << "Loaded " << scene_file << ": " << objects.size() << " objects, " << materials.size() << " materials, " << lights.size() << " lights" << std::endl;
+	}
+	else
+		create_default_scene();
+
+	/*
+	* Loads the models given with -obj, one mesh per material
+	*/
+	for (unsigned int m = 0; m < obj_files.size(); m++) {
+		int first = objects.size();
+		ObjLoadStats stats;
+		if (!LoadOBJ(obj_files[m], objects, materials, *thread_pool, &stats)) {
+			std::cerr << "Could not read " << obj_files[m] << std::endl;
+			return false;
+		}
+		// the shadow list gets its own copy of the already built meshes
+		for (int i = first; i < objects.size(); i++) {
+			TriangleMesh mesh = objects.meshes[getPrimitiveIndex(objects[i])];
+			can_cast_shadow.Add(mesh);
+		}
+		ReportObjLoad(obj_files[m], stats);
+	}
+	/**/
+
+	/*
+	 * Builds the acceleration structures
+	 */
+	objects_accel = new_accelerator(accelerator);
+	shadow_accel = new_accelerator(accelerator);
+	Timer build;
+	objects_accel->Build(objects);
+	shadow_accel->Build(can_cast_shadow);
 	/**/
+	std::cout << "Scene ready in " << timer.Milliseconds() << " ms";
+	if (strcmp(accelerator, "list") != 0)
+		// the grids and the kd-tree have builds of their own, the builder only shapes the meshes' BVHs
+		std::cout << " (" << accelerator << (strncmp(accelerator, "bvh", 3) != 0 ? "" : std::string(" built by ") + BVHBuildMethodName(getBVHBuildMethod()))
+			<< " in " << build.Milliseconds() << " ms)";
+	std::cout << std::endl;
+
+	if (cached) {
+		Timer save;
+		if (scene_cache->Save(key, camera, lights, materials, models, objects, can_cast_shadow,
+			dynamic_cast<BVH*>(objects_accel), dynamic_cast<BVH*>(shadow_accel)))
+			std::cout << "Wrote " << scene_cache->getPath(key) << " in " << save.Milliseconds() << " ms" << std::endl;
+		else
+			std::cerr << "Could not write " << scene_cache->getPath(key) << std::endl;
+	}
+	return true;
+}
+#pragma endregion
+
+/*
+ * Inserts a suffix in a file name before its extension (out.png and _2 give out_2.png)
+ */
+std::string add_suffix(const std::string &path, const std::string &suffix) {
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || (path.find_last_of("/\\") != std::string::npos && path.find_last_of("/\\") > dot))
+		return path + suffix;
+	return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+/*
+ * Image name of a scene when several are rendered: the scene's file name is appended to
+ * the name given with -o (out.png and scenes/room.scene give out_room.png)
+ */
+std::string image_path(const char *output, const char *scene_file) {
+	std::string path(output);
+	if (!scene_file)
+		return path;
+	std::string name(scene_file);
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos) name = name.substr(slash + 1);
+	name = name.substr(0, name.find('.'));
+	return add_suffix(path, "_" + name);
+}
+
+/*
+ * Renders frames of the scene's animation, each to its own image (out.png gives out_0000.png, ...).
+ * between frames the animated instances move and the acceleration structures are refit; a BVH (binary
+ * or wide) whose SAH cost grew past rebuild_ratio times its cost when last built is built again instead.
+ * reports the update (refit or build) and trace times of every frame
+ */
+int render_animation(const char *output, int bits, int frames, float rebuild_ratio) {
+	initialise_thread_variables();
+
+	Accelerator *accels[2] = { objects_accel, shadow_accel };
+	PrimitiveList *lists[2] = { &objects, &can_cast_shadow };
+	// SAH cost of the structures right after their last build, 0 for those without one
+	float built_cost[2] = { objects_accel->getSAHCost(), shadow_accel->getSAHCost() };
+
+	double update_total = 0.0, trace_total = 0.0;
+	int rebuilds = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		// frame 0 is where the structures were built
+		Timer update;
+		int moved = frame > 0 ? objects.setFrame((float)frame) : 0;
+		bool rebuilt = false;
+		float quality = 1.f;
+		if (moved > 0) {
+			can_cast_shadow.setFrame((float)frame);
+			for (int a = 0; a < 2; a++) {
+				accels[a]->Refit(*lists[a]);
+				if (built_cost[a] <= 0.f) continue;
+				float cost = accels[a]->getSAHCost();
+				if (a == 0) quality = cost / built_cost[a];
+				if (cost > built_cost[a] * rebuild_ratio) {
+					accels[a]->Build(*lists[a]);
+					built_cost[a] = accels[a]->getSAHCost();
+					rebuilt = true;
+				}
+			}
+			if (rebuilt) rebuilds++;
+		}
+		double update_ms = update.Milliseconds();
+
+		Timer trace;
+		long long rays = render_frame();
+		double trace_ms = trace.Milliseconds();
+		update_total += update_ms;
+		trace_total += trace_ms;
+
+		std::cout << "Frame " << frame << ": " << moved << " moved, " << (rebuilt ? "rebuilt" : "refit") << " in " << update_ms
+			<< " ms (SAH cost " << quality << "x of the last build), traced in " << trace_ms << " ms, " << rays << " rays" << std::endl;
+
+		std::ostringstream number;
+		number << "_" << std::setw(4) << std::setfill('0') << frame;
+		std::string path = add_suffix(output, number.str());
+		if (!WriteImage(path.c_str(), scene.pixel_r, scene.pixel_g, scene.pixel_b, camera.width, camera.height, bits)) {
+			std::cerr << "Could not write " << path << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Rendered " << frames << " frames, " << rebuilds << " rebuilds: update " << update_total / frames << " ms, trace "
+		<< trace_total / frames << " ms per frame" << std::endl;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+#pragma region Command Line
+	/*
+	 * -threads N       number of render threads
+	 * -o file          render without a window and write the image (.ppm, .png or .pfm)
+	 * -bits 16         16 bit output for .ppm and .png
+	 * -size W H        image resolution
+	 * -camera px py pz tx ty tz   camera position and target
+	 * -fov degrees     vertical field of view
+	 * -linear          test every object instead of using the BVH (same as -accel list)
+	 * -accel bvh|bvh4|bvh8|bvh4q|bvh8q|grid|grid2|kd|list   acceleration structure: binary BVH (default), 4 or 8 wide
+	 *                  BVH traversed with SIMD box tests of all the children of a node, the same with 8 bit
+	 *                  quantized child boxes, uniform or two level grid, SAH kd-tree with ropes, or none. overrides the scene file's
+	 *                  accelerator statement
+	 * -single          trace primary and shadow rays one at a time instead of in packets
+	 * -simd scalar|sse|avx2   instruction set of the intersection kernels (default: best supported)
+	 * -builder sah|lbvh|lbvh-treelets|sbvh   how the BVHs are built (see BuildBVH): best trees, fastest builds,
+	 *                  fast builds with their treelets reshaped (default sah), or SAH with spatial splits
+	 *                  cutting long walls and floors, slower to build but faster to trace on such scenes
+	 * -benchmark [N]   run the BVH scaling benchmark up to N objects and exit
+	 * -benchmark-intersect   time the ray-triangle/ray-plane kernels and exit
+	 * -benchmark-simd        time the SIMD block kernels and exit
+	 * -benchmark-camera      time primary ray generation and exit
+	 * -benchmark-packets [N] time packet against single ray tracing on N random objects and exit
+	 * -benchmark-mesh [N]    time a mesh of N triangles against separate triangle objects and exit
+	 * -benchmark-build [N]   time BVH builds of N objects on one thread against builds on the pool and exit
+	 * -benchmark-builders [N] time the BVH builders and tracing through their trees for N objects and exit
+	 * -benchmark-wide [N]    time the binary BVH against the 4 and 8 wide ones on N objects and exit
+	 * -benchmark-spatial [N] time SAH against SBVH builds of a building furnished with N objects and exit
+	 * -benchmark-grid [N]    time the grids against the BVHs on N objects and exit
+	 * -benchmark-kd [N]      time the kd-tree against the BVH on N objects, secondary rays too, and exit
+	 * -scene file      loads a scene description instead of the built-in scene (format in SceneLoader.h),
+	 *                  repeat it to render several scenes in one run, each to its own image (with -o)
+	 * -cache folder    keeps a binary image of every scene file rendered in folder (which must exist), later runs
+	 *                  of an unchanged scene map it instead of loading the files and building the BVHs
+	 * -obj file.obj    adds a Wavefront OBJ model (and its .mtl materials) to the scene, can be repeated
+	 * -frames N        with -o, renders N frames of the scene's animation (instances with spin/move) to numbered images
+	 * -rebuild-ratio r builds an animated BVH (binary or wide) again once refitting made its SAH cost r times worse (default 1.5)
+	 */
+	// NULL leaves the choice to the scene files
+	const char *accelerator = NULL;
+	const char *output = NULL;
+	int bits = 8;
+	int frames = 0;
+	float rebuild_ratio = 1.5f;
+	std::vector<const char*> obj_files;
+	std::vector<const char*> scene_files;
+	// camera settings given on the command line, they override the scene's
+	Camera view = camera;
+	bool set_size = false, set_camera = false, set_fov = false;
+	num_threads = default_thread_count();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			num_threads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (strcmp(argv[i], "-bits") == 0 && i + 1 < argc)
+			bits = atoi(argv[++i]) == 16 ? 16 : 8;
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			frames = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-rebuild-ratio") == 0 && i + 1 < argc)
+			rebuild_ratio = std::max(1.f, (float)atof(argv[++i]));
+		else if (strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+			view.width = std::max(1, atoi(argv[++i]));
+			view.height = std::max(1, atoi(argv[++i]));
+			set_size = true;
+		}
+		else if (strcmp(argv[i], "-camera") == 0 && i + 6 < argc) {
+			for (int c = 0; c < 3; c++)
+				view.position[c] = (float)atof(argv[++i]);
+			for (int c = 0; c < 3; c++)
+				view.target[c] = (float)atof(argv[++i]);
+			set_camera = true;
+		}
+		else if (strcmp(argv[i], "-fov") == 0 && i + 1 < argc) {
+			view.fov = (float)atof(argv[++i]);
+			set_fov = true;
+		}
+		else if (strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+			scene_files.push_back(argv[++i]);
+		else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+			delete scene_cache;
+			scene_cache = new SceneCache(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-linear") == 0)
+			accelerator = "list";
+		else if (strcmp(argv[i], "-accel") == 0 && i + 1 < argc) {
+			Accelerator *known = new_accelerator(argv[++i]);
+			if (known)
+				accelerator = argv[i];
+			else
+				std::cout << "Unknown accelerator " << argv[i] << ", ignored" << std::endl;
+			delete known;
+		}
+		else if (strcmp(argv[i], "-obj") == 0 && i + 1 < argc)
+			obj_files.push_back(argv[++i]);
+		else if (strcmp(argv[i], "-single") == 0)
+			use_packets = false;
+		else if (strcmp(argv[i], "-simd") == 0 && i + 1 < argc) {
+			i++;
+			SimdLevel level = SIMD_SCALAR;
+			if (strcmp(argv[i], "sse") == 0) level = SIMD_SSE;
+			else if (strcmp(argv[i], "avx2") == 0) level = SIMD_AVX2;
+			if (SetSimdLevel(level) != level)
+				std::cout << "SIMD level " << argv[i] << " not supported, using " << SimdLevelName(getSimdLevel()) << std::endl;
+		}
+		else if (strcmp(argv[i], "-benchmark") == 0) {
+			int max_objects = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_scaling(max_objects > 0 ? max_objects : 50000);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-intersect") == 0) {
+			benchmark_intersection();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-simd") == 0) {
+			benchmark_simd();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-camera") == 0) {
+			benchmark_camera(view);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-mesh") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_mesh(count > 0 ? count : 1000000);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-builder") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "lbvh") == 0) SetBVHBuildMethod(BVH_BUILD_LBVH);
+			else if (strcmp(argv[i], "lbvh-treelets") == 0) SetBVHBuildMethod(BVH_BUILD_LBVH_TREELETS);
+			else if (strcmp(argv[i], "sah") == 0) SetBVHBuildMethod(BVH_BUILD_SAH);
+			else if (strcmp(argv[i], "sbvh") == 0) SetBVHBuildMethod(BVH_BUILD_SBVH);
+			else
+				std::cout << "Unknown builder " << argv[i] << ", using " << BVHBuildMethodName(getBVHBuildMethod()) << std::endl;
+		}
+		else if (strcmp(argv[i], "-benchmark-builders") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			thread_pool = new ThreadPool(num_threads);
+			benchmark_builders(count > 0 ? count : 1000000, *thread_pool);
+			cleanup();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-wide") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_wide(count > 0 ? count : 1000000);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-spatial") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_spatial(count > 0 ? count : 100000);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-grid") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			thread_pool = new ThreadPool(num_threads);
+			benchmark_grid(count > 0 ? count : 1000000, *thread_pool);
+			cleanup();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-kd") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_kdtree(count > 0 ? count : 100000);
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-build") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			thread_pool = new ThreadPool(num_threads);
+			benchmark_build(count > 0 ? count : 1000000, *thread_pool);
+			cleanup();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark-packets") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			benchmark_packets(count > 0 ? count : 20000);
+			return 0;
+		}
+	}
+	// also used to load the models, so created before the scene
+	thread_pool = new ThreadPool(num_threads);
 #pragma endregion
 
+	/*
+	 * Renders every scene to its own image, or shows the first one in the window
+	 */
+	Camera default_camera = camera;
+	int scene_count = output ? std::max(1, (int)scene_files.size()) : 1;
+	for (int i = 0; i < scene_count; i++) {
+		camera = default_camera;
+		if (!create_scene(i < (int)scene_files.size() ? scene_files[i] : NULL, obj_files, accelerator)) {
+			cleanup();
+			return 1;
+		}
+		if (set_size) {
+			camera.width = view.width;
+			camera.height = view.height;
+		}
+		if (set_camera) {
+			camera.position = view.position;
+			camera.target = view.target;
+		}
+		if (set_fov)
+			camera.fov = view.fov;
+		camera.Update();
+
+		if (output) {
+			std::string path = image_path(output, scene_files.size() > 1 ? scene_files[i] : NULL);
+			int status = frames > 0 ? render_animation(path.c_str(), bits, frames, rebuild_ratio) : render_headless(path.c_str(), bits);
+			release_scene();
+			if (status != 0) {
+				cleanup();
+				return status;
+			}
+		}
+	}
+	if (output) {
+		cleanup();
+		return 0;
+	}
+
 #pragma region OpenGL Parameters
 	glutInit(&argc, argv);
-	glutInitWindowSize(windowX, windowY);	
+	glutInitWindowSize(camera.width, camera.height);	
 	glutCreateWindow("RayTracer");	
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_MULTISAMPLE);
 	
@@ -403,7 +959,7 @@ int main(int argc, char **argv) {
 
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	glOrtho(0, windowX, windowY, 0, -512, 512);
+	glOrtho(0, camera.width, camera.height, 0, -512, 512);
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	glDisable(GL_DEPTH_TEST);
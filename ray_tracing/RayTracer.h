@@ -7,11 +7,28 @@
 #include "Ray.h"
 #include "Object.h"
 #include "Light.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Grid.h"
+#include "KdTree.h"
+#include "Model.h"
+#include "Benchmark.h"
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+#include "ImageWriter.h"
+#include "Timer.h"
+#include "Camera.h"
+#include "Texture.h"
+#include "ObjLoader.h"
+#include "SceneLoader.h"
+#include "SceneCache.h"
+#include <deque>
 #include <iomanip>
+#include <sstream>
 #include <iostream>
 #include <ctime>
-
-#define NUMTHREADS 6
+#include <cstdlib>
+#include <cstring>
 
 typedef struct{
 	float *pixel_r;
@@ -20,22 +37,31 @@ typedef struct{
 } OUTPUT;
 
 OUTPUT scene;
-pthread_t callThd[NUMTHREADS];
-pthread_attr_t attr;
+// render threads, created once at startup (-threads N, RAYTRACER_THREADS or hardware threads)
+int num_threads = 0;
+ThreadPool *thread_pool = NULL;
+// distributes image tiles between the threads
+TileScheduler *tile_scheduler = NULL;
+// rays traced by each tile queue in the last frame
+std::vector<long long> ray_counts;
+
+// camera, also holds the window/image dimensions (set by the scene file, -camera, -fov and -size on the command line)
+Camera camera(glm::vec3(-10.f,10.f,10.f),	// position
+	glm::vec3(0.f,0.f,0.f),					// target
+	glm::vec3(0.f,1.f,0.f),					// up
+	45.f,									// vertical field of view
+	640, 480);								// resolution
+// light sources, the scene file can give several
+std::vector<PointLight> lights;
 
-// window dimensions
-const int windowX = 640;
-const int windowY = 480;
+// materials of the scene, objects and hits refer to them by id
+MaterialTable materials;
 
-// camera position
-glm::vec3 camera_pos(-10.f,10.f,10.f);
-// light position
-glm::vec3 light_pos(-6.f,4.f,3.f);
-// create light source
-Light light_0(.7f, 1.f, .0f, .3f, .0f);
+// geometry shared by the instances in the lists below (a deque, so adding one never moves the others)
+std::deque<Model> models;
 
 // list of objects
-std::vector<Object*> objects;
+PrimitiveList objects;
 
 /*
  * list of objects that can cast shadow
@@ -43,7 +69,15 @@ std::vector<Object*> objects;
  * some objects may not cast shadow or may be simplified
  * (ex. chess floor pattern can be reduced to one plane instead of 100)
  */
-std::vector<Object*> can_cast_shadow;
+PrimitiveList can_cast_shadow;
+
+// acceleration structures built over the two lists above (BVH unless -accel or -linear says otherwise)
+Accelerator *objects_accel = NULL;
+Accelerator *shadow_accel = NULL;
+// binary images of scenes loaded before (-cache folder), NULL when off
+SceneCache *scene_cache = NULL;
+// trace primary and shadow rays in PACKET_WIDTH x PACKET_WIDTH packets (-single turns it off)
+bool use_packets = true;
 
 // number of bounces allowed
 const int MAX_BOUNCES = 2;
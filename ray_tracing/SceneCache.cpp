@@ -0,0 +1,483 @@
+#include "SceneCache.h"
+#include "Model.h"
+#include "ObjLoader.h"
+#include "SceneLoader.h"
+#include "Texture.h"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
+
+// changed whenever the file layout changes
+#define SCENE_CACHE_VERSION 5
+// arrays start at multiples of this, a cache line and enough for any SIMD load
+#define SCENE_CACHE_ALIGNMENT 64
+
+static const char SCENE_CACHE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+
+#pragma region File Layout
+/*
+ * count elements starting offset bytes into the file
+ */
+struct CacheArray {
+	unsigned long long offset;
+	unsigned long long count;
+};
+
+struct CacheCamera {
+	glm::vec3 position, target, up;
+	float fov;
+	int width, height;
+};
+
+struct CacheLight {
+	glm::vec3 position;
+	float ambient, diffuse, constant_att, linear_att, quadratic_att;
+};
+
+struct CacheMaterial {
+	glm::vec3 ambient, diffuse, specular;
+	float glossiness, reflection, refraction;
+	// index in the textures, -1 for none
+	int texture;
+};
+
+// CheckerTexture, the only kind of texture
+struct CacheTexture {
+	MaterialID materials[2];
+	int useUV;
+	float repeatsU, repeatsV;
+	glm::vec3 invCellSize;
+};
+
+struct CacheMesh {
+	MaterialID material;
+	glm::vec3 centroid;
+	float radius;
+	AABB bounds;
+	CacheArray positions, normals, uvs, indices, nodes, references;
+};
+
+struct CacheInstance {
+	// index in the models
+	unsigned int model;
+	// 1 if motion is used, transform is then its frame 0
+	int animated;
+	glm::mat4 transform;
+	InstanceMotion motion;
+};
+
+struct CacheList {
+	CacheArray spheres, planes, triangles, meshes, instances, refs;
+};
+
+struct CacheBVH {
+	int present;
+	int maxLeafSize;
+	CacheArray nodes, blocks;
+};
+
+struct CacheModel {
+	CacheList primitives;
+	CacheBVH bvh;
+};
+
+struct CacheHeader {
+	char magic[8];
+	unsigned int version;
+	// hash of the sizes of the stored structures, a build with other sizes cannot read the file
+	unsigned int layout;
+	unsigned long long key;
+	// of the whole file, catches files cut short
+	unsigned long long size;
+	CacheCamera camera;
+	CacheArray lights, materials, textures;
+	// in the order they were added, instances only refer to models before them
+	CacheArray models;
+	// objects and can_cast_shadow
+	CacheList lists[2];
+	CacheBVH bvhs[2];
+};
+#pragma endregion
+
+/*
+ * FNV-1a
+ */
+static unsigned long long hash_bytes(const void *data, size_t size, unsigned long long hash) {
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+static unsigned int layout_signature() {
+	unsigned int sizes[] = {
+		sizeof(CacheHeader), sizeof(CacheMesh), sizeof(Sphere), sizeof(Plane), sizeof(Triangle),
+		sizeof(PrimitiveRef), sizeof(BVHNode), sizeof(PrimitiveBlock), sizeof(CacheInstance), sizeof(CacheModel),
+		SIMD_BLOCK_SIZE, SCENE_CACHE_ALIGNMENT
+	};
+	return (unsigned int)hash_bytes(sizes, sizeof(sizes), 14695981039346656037ull);
+}
+
+/*
+ * appends aligned arrays to the file after the space left for the header
+ */
+class CacheWriter {
+public:
+	CacheWriter(FILE *file): file(file), offset(0), failed(false) {
+		CacheHeader header;
+		memset((void*)&header, 0, sizeof(CacheHeader));
+		Put(&header, sizeof(CacheHeader));
+	}
+
+	template <class T>
+	CacheArray Write(const T *items, size_t count) {
+		CacheArray array = { 0, count };
+		if (count == 0) return array;
+		static const char zeros[SCENE_CACHE_ALIGNMENT] = { 0 };
+		Put(zeros, (size_t)((SCENE_CACHE_ALIGNMENT - offset % SCENE_CACHE_ALIGNMENT) % SCENE_CACHE_ALIGNMENT));
+		array.offset = offset;
+		Put(items, count * sizeof(T));
+		return array;
+	}
+
+	unsigned long long getSize() const { return offset; }
+	bool hasFailed() const { return failed; }
+
+private:
+	void Put(const void *data, size_t size) {
+		if (size && fwrite(data, 1, size, file) != size) failed = true;
+		offset += size;
+	}
+
+	FILE *file;
+	unsigned long long offset;
+	bool failed;
+};
+
+// true if the array lies inside the file
+template <class T>
+static bool valid_array(const CacheArray &array, size_t size) {
+	if (array.count == 0) return true;
+	return array.offset % SCENE_CACHE_ALIGNMENT == 0 && array.offset <= size &&
+		array.count <= (size - array.offset) / sizeof(T);
+}
+
+template <class T>
+static T *array_items(char *base, const CacheArray &array) {
+	return array.count ? (T*)(base + array.offset) : NULL;
+}
+
+SceneCache::SceneCache(const char *folder):
+	folder(folder)
+{
+	if (!this->folder.empty() && this->folder[this->folder.size() - 1] != '/' && this->folder[this->folder.size() - 1] != '\\')
+		this->folder += '/';
+}
+
+std::string SceneCache::getPath(unsigned long long key) const {
+	std::ostringstream name;
+	name << folder << std::hex << std::setw(16) << std::setfill('0') << key << ".rtscene";
+	return name.str();
+}
+
+bool SceneCache::ComputeKey(const char *scene_file, const std::vector<const char*> &models, const char *accelerator, unsigned long long &key) {
+	FILE *file = fopen(scene_file, "rb");
+	if (!file) return false;
+	unsigned long long hash = 14695981039346656037ull;
+	char chunk[1 << 16];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		hash = hash_bytes(chunk, read, hash);
+	fclose(file);
+
+	/*
+	 * the models are too large to hash every run, a change shows in their size or time instead.
+	 * a missing file counts with size -1: a material library may be left out (its materials are then the
+	 * defaults), a scene missing a model fails to load and is never saved
+	 */
+	std::vector<std::string> files;
+	if (!SceneDependencies(scene_file, files)) return false;
+	for (unsigned int i = 0; i < models.size(); i++) {
+		files.push_back(models[i]);
+		ObjDependencies(models[i], files);
+	}
+	for (unsigned int i = 0; i < files.size(); i++) {
+		struct stat info;
+		long long size = -1, time = 0;
+		if (stat(files[i].c_str(), &info) == 0)
+			size = (long long)info.st_size, time = (long long)info.st_mtime;
+		hash = hash_bytes(files[i].c_str(), files[i].size() + 1, hash);
+		hash = hash_bytes(&size, sizeof(size), hash);
+		hash = hash_bytes(&time, sizeof(time), hash);
+	}
+
+	unsigned int version[2] = { SCENE_CACHE_VERSION, layout_signature() };
+	hash = hash_bytes(version, sizeof(version), hash);
+	hash = hash_bytes(accelerator, strlen(accelerator), hash);
+	key = hash;
+	return true;
+}
+
+#pragma region Save
+void SceneCache::WriteList(CacheWriter &writer, const PrimitiveList &list, const std::deque<Model> &models, CacheList &cached) {
+	cached.spheres = writer.Write(list.spheres.empty() ? NULL : &list.spheres[0], list.spheres.size());
+	cached.planes = writer.Write(list.planes.empty() ? NULL : &list.planes[0], list.planes.size());
+	cached.triangles = writer.Write(list.triangles.empty() ? NULL : &list.triangles[0], list.triangles.size());
+	cached.refs = writer.Write(list.refs.empty() ? NULL : &list.refs[0], list.refs.size());
+
+	std::vector<CacheMesh> meshes(list.meshes.size());
+	for (unsigned int m = 0; m < meshes.size(); m++) {
+		const TriangleMesh &mesh = list.meshes[m];
+		CacheMesh &cachedMesh = meshes[m];
+		cachedMesh.material = mesh.material;
+		cachedMesh.centroid = mesh.centroid;
+		cachedMesh.radius = mesh.radius;
+		cachedMesh.bounds = mesh.bounds;
+		cachedMesh.positions = writer.Write(mesh.positions.data(), mesh.positions.size());
+		cachedMesh.normals = writer.Write(mesh.normals.data(), mesh.normals.size());
+		cachedMesh.uvs = writer.Write(mesh.uvs.data(), mesh.uvs.size());
+		cachedMesh.indices = writer.Write(mesh.indices.data(), mesh.indices.size());
+		cachedMesh.nodes = writer.Write(mesh.nodes.data(), mesh.nodes.size());
+		cachedMesh.references = writer.Write(mesh.references.data(), mesh.references.size());
+	}
+	cached.meshes = writer.Write(meshes.empty() ? NULL : &meshes[0], meshes.size());
+
+	std::vector<CacheInstance> instances(list.instances.size());
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		const Instance &instance = list.instances[i];
+		instances[i].model = 0;
+		while (instances[i].model < models.size() && &models[instances[i].model] != instance.getModel())
+			instances[i].model++;
+		instances[i].animated = instance.getMotion() ? 1 : 0;
+		instances[i].transform = instance.getTransform();
+		if (instance.getMotion())
+			instances[i].motion = *instance.getMotion();
+	}
+	cached.instances = writer.Write(instances.empty() ? NULL : &instances[0], instances.size());
+}
+
+void SceneCache::WriteBVH(CacheWriter &writer, const BVH &bvh, CacheBVH &cached) {
+	cached.present = 1;
+	cached.maxLeafSize = bvh.maxLeafSize;
+	cached.nodes = writer.Write(bvh.nodes.data(), bvh.nodes.size());
+	cached.blocks = writer.Write(bvh.blocks.data(), bvh.blocks.size());
+}
+
+bool SceneCache::Save(unsigned long long key, const Camera &camera, const std::vector<PointLight> &lights, const MaterialTable &materials,
+	const std::deque<Model> &models, const PrimitiveList &objects, const PrimitiveList &can_cast_shadow, const BVH *objects_bvh, const BVH *shadow_bvh) {
+	CacheHeader header;
+	memset((void*)&header, 0, sizeof(CacheHeader));
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_CACHE_VERSION;
+	header.layout = layout_signature();
+	header.key = key;
+	header.camera.position = camera.position;
+	header.camera.target = camera.target;
+	header.camera.up = camera.up;
+	header.camera.fov = camera.fov;
+	header.camera.width = camera.width;
+	header.camera.height = camera.height;
+
+	std::vector<CacheLight> cachedLights(lights.size());
+	for (unsigned int i = 0; i < lights.size(); i++) {
+		const Light &light = lights[i].light;
+		cachedLights[i].position = lights[i].position;
+		cachedLights[i].ambient = light.ambient;
+		cachedLights[i].diffuse = light.diffuse;
+		cachedLights[i].constant_att = light.constant_att;
+		cachedLights[i].linear_att = light.linear_att;
+		cachedLights[i].quadratic_att = light.quadratic_att;
+	}
+
+	std::vector<CacheTexture> cachedTextures(materials.textures.size());
+	for (unsigned int i = 0; i < materials.textures.size(); i++) {
+		const CheckerTexture *checker = dynamic_cast<const CheckerTexture*>(materials.textures[i]);
+		if (!checker) return false;
+		cachedTextures[i].materials[0] = checker->materials[0];
+		cachedTextures[i].materials[1] = checker->materials[1];
+		cachedTextures[i].useUV = checker->useUV;
+		cachedTextures[i].repeatsU = checker->repeatsU;
+		cachedTextures[i].repeatsV = checker->repeatsV;
+		cachedTextures[i].invCellSize = checker->invCellSize;
+	}
+
+	std::vector<CacheMaterial> cachedMaterials(materials.materials.size());
+	for (unsigned int i = 0; i < materials.materials.size(); i++) {
+		const Material &material = materials.materials[i];
+		CacheMaterial &cached = cachedMaterials[i];
+		cached.ambient = material.ambient;
+		cached.diffuse = material.diffuse;
+		cached.specular = material.specular;
+		cached.glossiness = material.glossiness;
+		cached.reflection = material.reflection;
+		cached.refraction = material.refraction;
+		cached.texture = -1;
+		for (unsigned int t = 0; t < materials.textures.size(); t++)
+			if (materials.textures[t] == material.texture)
+				cached.texture = (int)t;
+		// a texture the table does not own cannot be restored
+		if (material.texture && cached.texture < 0) return false;
+	}
+
+	// written next to the final name and renamed once complete, a reader never sees half a file
+	std::string path = getPath(key);
+	std::string temporary = path + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file) return false;
+	CacheWriter writer(file);
+	header.lights = writer.Write(cachedLights.empty() ? NULL : &cachedLights[0], cachedLights.size());
+	header.materials = writer.Write(cachedMaterials.empty() ? NULL : &cachedMaterials[0], cachedMaterials.size());
+	header.textures = writer.Write(cachedTextures.empty() ? NULL : &cachedTextures[0], cachedTextures.size());
+	std::vector<CacheModel> cachedModels(models.size());
+	for (unsigned int m = 0; m < models.size(); m++) {
+		WriteList(writer, models[m].primitives, models, cachedModels[m].primitives);
+		WriteBVH(writer, models[m].bvh, cachedModels[m].bvh);
+	}
+	header.models = writer.Write(cachedModels.empty() ? NULL : &cachedModels[0], cachedModels.size());
+	WriteList(writer, objects, models, header.lists[0]);
+	WriteList(writer, can_cast_shadow, models, header.lists[1]);
+	const BVH *bvhs[2] = { objects_bvh, shadow_bvh };
+	for (int b = 0; b < 2; b++)
+		if (bvhs[b]) WriteBVH(writer, *bvhs[b], header.bvhs[b]);
+	header.size = writer.getSize();
+
+	bool written = !writer.hasFailed() && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+	written = fclose(file) == 0 && written;
+	remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Load
+bool SceneCache::ReadList(char *base, size_t size, const CacheList &cached, const std::deque<Model> &models, PrimitiveList &list) {
+	if (!valid_array<Sphere>(cached.spheres, size) || !valid_array<Plane>(cached.planes, size) ||
+		!valid_array<Triangle>(cached.triangles, size) || !valid_array<PrimitiveRef>(cached.refs, size) ||
+		!valid_array<CacheMesh>(cached.meshes, size) || !valid_array<CacheInstance>(cached.instances, size))
+		return false;
+
+	// the objects are small and copied, the mesh buffers are used in place
+	Sphere *spheres = array_items<Sphere>(base, cached.spheres);
+	Plane *planes = array_items<Plane>(base, cached.planes);
+	Triangle *triangles = array_items<Triangle>(base, cached.triangles);
+	PrimitiveRef *refs = array_items<PrimitiveRef>(base, cached.refs);
+	list.spheres.assign(spheres, spheres + cached.spheres.count);
+	list.planes.assign(planes, planes + cached.planes.count);
+	list.triangles.assign(triangles, triangles + cached.triangles.count);
+	list.refs.assign(refs, refs + cached.refs.count);
+
+	CacheMesh *meshes = array_items<CacheMesh>(base, cached.meshes);
+	for (unsigned long long m = 0; m < cached.meshes.count; m++) {
+		const CacheMesh &cachedMesh = meshes[m];
+		if (!valid_array<glm::vec3>(cachedMesh.positions, size) || !valid_array<glm::vec3>(cachedMesh.normals, size) ||
+			!valid_array<glm::vec2>(cachedMesh.uvs, size) || !valid_array<unsigned int>(cachedMesh.indices, size) ||
+			!valid_array<BVHNode>(cachedMesh.nodes, size) || !valid_array<unsigned int>(cachedMesh.references, size))
+			return false;
+		list.meshes.push_back(TriangleMesh(cachedMesh.material));
+		TriangleMesh &mesh = list.meshes.back();
+		mesh.centroid = cachedMesh.centroid;
+		mesh.radius = cachedMesh.radius;
+		mesh.bounds = cachedMesh.bounds;
+		mesh.positions.Reference(array_items<glm::vec3>(base, cachedMesh.positions), (size_t)cachedMesh.positions.count);
+		mesh.normals.Reference(array_items<glm::vec3>(base, cachedMesh.normals), (size_t)cachedMesh.normals.count);
+		mesh.uvs.Reference(array_items<glm::vec2>(base, cachedMesh.uvs), (size_t)cachedMesh.uvs.count);
+		mesh.indices.Reference(array_items<unsigned int>(base, cachedMesh.indices), (size_t)cachedMesh.indices.count);
+		mesh.nodes.Reference(array_items<BVHNode>(base, cachedMesh.nodes), (size_t)cachedMesh.nodes.count);
+		mesh.references.Reference(array_items<unsigned int>(base, cachedMesh.references), (size_t)cachedMesh.references.count);
+	}
+
+	CacheInstance *instances = array_items<CacheInstance>(base, cached.instances);
+	for (unsigned long long i = 0; i < cached.instances.count; i++) {
+		if (instances[i].model >= models.size()) return false;
+		const Model *model = &models[instances[i].model];
+		list.instances.push_back(instances[i].animated ? Instance(model, instances[i].motion) : Instance(model, instances[i].transform));
+	}
+	return true;
+}
+
+bool SceneCache::ReadBVH(char *base, size_t size, const CacheBVH &cached, const PrimitiveList &list, BVH &bvh) {
+	if (!cached.present || !valid_array<BVHNode>(cached.nodes, size) || !valid_array<PrimitiveBlock>(cached.blocks, size))
+		return false;
+	bvh.maxLeafSize = cached.maxLeafSize;
+	bvh.primitives = &list;
+	bvh.nodes.Reference(array_items<BVHNode>(base, cached.nodes), (size_t)cached.nodes.count);
+	bvh.blocks.Reference(array_items<PrimitiveBlock>(base, cached.blocks), (size_t)cached.blocks.count);
+	return true;
+}
+
+bool SceneCache::Load(unsigned long long key, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+	std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, BVH *objects_bvh, BVH *shadow_bvh) {
+	if (!file.Open(getPath(key).c_str()))
+		return false;
+	char *base = file.getData();
+	size_t size = file.getSize();
+	CacheHeader header;
+	if (size < sizeof(CacheHeader)) {
+		file.Close();
+		return false;
+	}
+	header = *(const CacheHeader*)base;
+	bool valid = memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == SCENE_CACHE_VERSION && header.layout == layout_signature() &&
+		header.key == key && header.size == size &&
+		valid_array<CacheLight>(header.lights, size) && valid_array<CacheMaterial>(header.materials, size) &&
+		valid_array<CacheTexture>(header.textures, size) && valid_array<CacheModel>(header.models, size);
+	// the models are read one after the other, so that an instance only finds the models before it
+	CacheModel *cachedModels = valid ? array_items<CacheModel>(base, header.models) : NULL;
+	for (unsigned long long m = 0; valid && m < header.models.count; m++) {
+		models.emplace_back();
+		valid = ReadList(base, size, cachedModels[m].primitives, models, models.back().primitives) &&
+			ReadBVH(base, size, cachedModels[m].bvh, models.back().primitives, models.back().bvh);
+	}
+	valid = valid && ReadList(base, size, header.lists[0], models, objects) && ReadList(base, size, header.lists[1], models, can_cast_shadow);
+	PrimitiveList *lists[2] = { &objects, &can_cast_shadow };
+	BVH *bvhs[2] = { objects_bvh, shadow_bvh };
+	for (int b = 0; b < 2; b++)
+		valid = valid && (!bvhs[b] || ReadBVH(base, size, header.bvhs[b], *lists[b], *bvhs[b]));
+	if (!valid) {
+		objects.Clear();
+		can_cast_shadow.Clear();
+		models.clear();
+		file.Close();
+		return false;
+	}
+
+	camera.position = header.camera.position;
+	camera.target = header.camera.target;
+	camera.up = header.camera.up;
+	camera.fov = header.camera.fov;
+	camera.width = header.camera.width;
+	camera.height = header.camera.height;
+
+	CacheLight *cachedLights = array_items<CacheLight>(base, header.lights);
+	for (unsigned long long i = 0; i < header.lights.count; i++) {
+		const CacheLight &cached = cachedLights[i];
+		lights.push_back(PointLight(cached.position, Light(cached.ambient, cached.diffuse, cached.constant_att, cached.linear_att, cached.quadratic_att)));
+	}
+
+	CacheTexture *cachedTextures = array_items<CacheTexture>(base, header.textures);
+	std::vector<const Texture*> textures;
+	for (unsigned long long i = 0; i < header.textures.count; i++) {
+		const CacheTexture &cached = cachedTextures[i];
+		CheckerTexture *checker = new CheckerTexture(cached.materials[0], cached.materials[1], cached.repeatsU, cached.repeatsV);
+		checker->useUV = cached.useUV != 0;
+		checker->invCellSize = cached.invCellSize;
+		textures.push_back(materials.AddTexture(checker));
+	}
+
+	CacheMaterial *cachedMaterials = array_items<CacheMaterial>(base, header.materials);
+	for (unsigned long long i = 0; i < header.materials.count; i++) {
+		const CacheMaterial &cached = cachedMaterials[i];
+		Material material(cached.ambient, cached.diffuse, cached.specular, cached.glossiness, cached.reflection, cached.refraction);
+		if (cached.texture >= 0 && cached.texture < (int)textures.size())
+			material.setTexture(textures[cached.texture]);
+		materials.Add(material);
+	}
+	return true;
+}
+#pragma endregion
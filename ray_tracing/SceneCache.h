@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Light.h"
+#include "MappedFile.h"
+#include "Material.h"
+#include "Model.h"
+#include "PrimitiveList.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+struct CacheBVH;
+struct CacheList;
+class CacheWriter;
+
+/*
+ * Scene Cache
+ * binary image of a built scene: camera, lights, materials, the models with their BVHs, both object lists and their BVHs.
+ * it is written once a scene has been loaded and built, and memory-mapped by later runs of the same scene.
+ * the file only holds indices and offsets from its start, so it works wherever it is mapped; the large
+ * arrays (mesh buffers, BVH nodes and blocks) are used in place and only the small ones are copied out.
+ * the files are named after a key hashed from the scene source, a changed source gets a new file
+ */
+class SceneCache {
+public:
+	// files are kept in folder, which has to exist
+	SceneCache(const char *folder);
+
+	/*
+	 * key of the scene built from scene_file and the extra models: hash of the scene file's bytes,
+	 * of the paths, sizes and modification times of the files it refers to, of the accelerator name
+	 * and of the layout of the cached structures. false if a file is missing
+	 */
+	static bool ComputeKey(const char *scene_file, const std::vector<const char*> &models, const char *accelerator, unsigned long long &key);
+
+	/*
+	 * maps the file of key and fills in the (empty) scene. the BVHs are set up over the loaded lists
+	 * when given, they can be NULL to build another accelerator. the mapping is kept until Release,
+	 * which must follow the clearing of the lists, models and BVHs.
+	 * returns false, with everything left empty, if there is no valid file for the key
+	 */
+	bool Load(unsigned long long key, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+		std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, BVH *objects_bvh, BVH *shadow_bvh);
+	/*
+	 * writes the scene under key, the BVHs are left out when NULL. returns false if it could not be written
+	 */
+	bool Save(unsigned long long key, const Camera &camera, const std::vector<PointLight> &lights, const MaterialTable &materials,
+		const std::deque<Model> &models, const PrimitiveList &objects, const PrimitiveList &can_cast_shadow, const BVH *objects_bvh, const BVH *shadow_bvh);
+	// unmaps the loaded file
+	void Release() { file.Close(); }
+
+	std::string getPath(unsigned long long key) const;
+
+private:
+	static void WriteList(CacheWriter &writer, const PrimitiveList &list, const std::deque<Model> &models, CacheList &cached);
+	static void WriteBVH(CacheWriter &writer, const BVH &bvh, CacheBVH &cached);
+	static bool ReadList(char *base, size_t size, const CacheList &cached, const std::deque<Model> &models, PrimitiveList &list);
+	static bool ReadBVH(char *base, size_t size, const CacheBVH &cached, const PrimitiveList &list, BVH &bvh);
+
+	std::string folder;
+	MappedFile file;
+};
@@ -0,0 +1,535 @@
+#include "SceneLoader.h"
+#include "ObjLoader.h"
+#include "Texture.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+// folder of a file, with the trailing separator
+static std::string folder_of(const std::string &path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// path of a file named in a scene, relative ones start from the scene's folder
+static std::string resolve_path(const std::string &folder, const std::string &file) {
+	bool absolute = !file.empty() && (file[0] == '/' || file[0] == '\\' || (file.size() > 1 && file[1] == ':'));
+	return absolute ? file : folder + file;
+}
+
+/*
+ * Scene Parser
+ * reads the statements of a scene file one line at a time. the readers check their token and
+ * report the first error, after which every read fails and the parse stops
+ */
+class SceneParser {
+public:
+	SceneParser(const char *path, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+		std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, ThreadPool &pool);
+	bool Parse();
+
+private:
+	/*
+	 * statements, the keyword is already consumed
+	 */
+	void ParseCamera();
+	void ParseLight();
+	void ParseMaterial();
+	void ParseChecker();
+	void ParseSphere();
+	void ParsePlane();
+	void ParseTriangle();
+	void ParseMesh();
+	void ParseModel();
+	void ParseEnd();
+	void ParseInstance();
+	void ParseAccelerator();
+
+	/*
+	 * tokens of the current line
+	 */
+	// true while the line has tokens left and nothing failed
+	bool More() const { return !failed && next < tokens.size(); }
+	// consumes the next token if it is word
+	bool Next(const char *word);
+	bool NextIsNumber() const;
+	void Read(float &value);
+	void Read(int &value);
+	void Read(glm::vec3 &value);
+	void Read(std::string &value);
+	// name of a defined material
+	void ReadMaterial(MaterialID &id);
+	// a name that is not taken yet
+	void ReadNewName(std::string &name, const std::map<std::string, MaterialID> &names);
+	void Error(const std::string &message);
+	void Unexpected();
+
+	// adds an object to the lists (or to the open model), shadow is false for noshadow objects
+	template <class T>
+	void AddObject(const T &object, bool shadow) {
+		if (model) {
+			if (!shadow) Error("noshadow inside a model, it is set on the instances");
+			else model->primitives.Add(object);
+			return;
+		}
+		objects.Add(object);
+		if (shadow) can_cast_shadow.Add(object);
+	}
+	// path of a file named in the scene
+	std::string Resolve(const std::string &file) const;
+
+	std::string path;
+	std::string folder;
+	Camera &camera;
+	std::vector<PointLight> &lights;
+	MaterialTable &materials;
+	std::deque<Model> &models;
+	PrimitiveList &objects;
+	PrimitiveList &can_cast_shadow;
+	ThreadPool &pool;
+
+	int line;
+	std::vector<std::string> tokens;
+	unsigned int next;
+	bool failed;
+
+	std::map<std::string, MaterialID> namedMaterials;
+	// models of the mesh and model statements
+	std::map<std::string, Model*> namedModels;
+	// the model between a model statement and its end, NULL outside
+	Model *model;
+	std::string modelName;
+};
+
+SceneParser::SceneParser(const char *path, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+	std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, ThreadPool &pool):
+	path(path), camera(camera), lights(lights), materials(materials), models(models), objects(objects),
+	can_cast_shadow(can_cast_shadow), pool(pool), line(0), next(0), failed(false), model(NULL)
+{
+	folder = folder_of(this->path);
+}
+
+bool SceneParser::Parse() {
+	std::ifstream file(path.c_str());
+	if (!file) {
+		std::cerr << "Could not read " << path << std::endl;
+		return false;
+	}
+
+	std::string text;
+	while (!failed && std::getline(file, text)) {
+		line++;
+		// the comment is cut before splitting the line in tokens
+		size_t comment = text.find('#');
+		if (comment != std::string::npos) text.erase(comment);
+		std::istringstream stream(text);
+		tokens.clear();
+		next = 0;
+		std::string token;
+		while (stream >> token)
+			tokens.push_back(token);
+		if (tokens.empty()) continue;
+
+		if (Next("camera")) ParseCamera();
+		else if (Next("light")) ParseLight();
+		else if (Next("material")) ParseMaterial();
+		else if (Next("checker")) ParseChecker();
+		else if (Next("sphere")) ParseSphere();
+		else if (Next("plane")) ParsePlane();
+		else if (Next("triangle")) ParseTriangle();
+		else if (Next("mesh")) ParseMesh();
+		else if (Next("model")) ParseModel();
+		else if (Next("end")) ParseEnd();
+		else if (Next("instance")) ParseInstance();
+		else if (Next("accelerator")) ParseAccelerator();
+		else Error("unknown statement '" + tokens[0] + "'");
+	}
+	if (model)
+		Error("model '" + modelName + "' has no end");
+	return !failed;
+}
+
+#pragma region Statements
+void SceneParser::ParseCamera() {
+	while (More()) {
+		if (Next("position")) Read(camera.position);
+		else if (Next("target")) Read(camera.target);
+		else if (Next("up")) Read(camera.up);
+		else if (Next("fov")) Read(camera.fov);
+		else if (Next("size")) {
+			Read(camera.width);
+			Read(camera.height);
+			if (!failed && (camera.width < 1 || camera.height < 1))
+				Error("image size must be positive");
+		}
+		else Unexpected();
+	}
+}
+
+void SceneParser::ParseLight() {
+	glm::vec3 position;
+	float ambient = 0.f, diffuse = 1.f;
+	glm::vec3 attenuation(1.f, 0.f, 0.f);
+	bool hasPosition = false;
+	while (More()) {
+		if (Next("position")) {
+			Read(position);
+			hasPosition = true;
+		}
+		else if (Next("ambient")) Read(ambient);
+		else if (Next("diffuse")) Read(diffuse);
+		else if (Next("attenuation")) Read(attenuation);
+		else Unexpected();
+	}
+	if (!failed && !hasPosition)
+		Error("light without position");
+	if (!failed)
+		lights.push_back(PointLight(position, Light(ambient, diffuse, attenuation.x, attenuation.y, attenuation.z)));
+}
+
+void SceneParser::ParseMaterial() {
+	std::string name;
+	ReadNewName(name, namedMaterials);
+	glm::vec3 ambient(0.f), diffuse(0.f), specular(0.f);
+	float glossiness = 0.f, reflection = 0.f, refraction = 0.f;
+	while (More()) {
+		if (Next("ambient")) Read(ambient);
+		else if (Next("diffuse")) Read(diffuse);
+		else if (Next("specular")) Read(specular);
+		else if (Next("glossiness")) Read(glossiness);
+		else if (Next("reflection")) Read(reflection);
+		else if (Next("refraction")) Read(refraction);
+		else Unexpected();
+	}
+	if (!failed)
+		namedMaterials[name] = materials.Add(Material(ambient, diffuse, specular, glossiness, reflection, refraction));
+}
+
+void SceneParser::ParseChecker() {
+	std::string name;
+	MaterialID even = 0, odd = 0;
+	ReadNewName(name, namedMaterials);
+	ReadMaterial(even);
+	ReadMaterial(odd);
+	Texture *texture = NULL;
+	if (Next("repeat")) {
+		float u = 1.f, v = 1.f;
+		Read(u);
+		Read(v);
+		if (!failed) texture = new CheckerTexture(even, odd, u, v);
+	}
+	else if (Next("cell")) {
+		glm::vec3 size;
+		Read(size);
+		if (!failed) texture = new CheckerTexture(even, odd, size);
+	}
+	else if (!failed)
+		Error("checker needs 'repeat u v' or 'cell x y z'");
+	if (More()) Unexpected();
+	if (failed) {
+		delete texture;
+		return;
+	}
+
+	Material checker;
+	checker.setTexture(materials.AddTexture(texture));
+	namedMaterials[name] = materials.Add(checker);
+}
+
+void SceneParser::ParseSphere() {
+	glm::vec3 center(0.f);
+	float radius = 1.f;
+	MaterialID material = 0;
+	bool hasMaterial = false, shadow = true;
+	while (More()) {
+		if (Next("center")) Read(center);
+		else if (Next("radius")) Read(radius);
+		else if (Next("material")) {
+			ReadMaterial(material);
+			hasMaterial = true;
+		}
+		else if (Next("noshadow")) shadow = false;
+		else Unexpected();
+	}
+	if (!failed && !hasMaterial)
+		Error("sphere without material");
+	if (!failed)
+		AddObject(Sphere(center, radius, material), shadow);
+}
+
+void SceneParser::ParsePlane() {
+	glm::vec3 v[4];
+	for (int i = 0; i < 4; i++)
+		Read(v[i]);
+	MaterialID material = 0;
+	bool hasMaterial = false, shadow = true;
+	while (More()) {
+		if (Next("material")) {
+			ReadMaterial(material);
+			hasMaterial = true;
+		}
+		else if (Next("noshadow")) shadow = false;
+		else Unexpected();
+	}
+	if (!failed && !hasMaterial)
+		Error("plane without material");
+	if (!failed)
+		AddObject(Plane(v[0], v[1], v[2], v[3], material), shadow);
+}
+
+void SceneParser::ParseTriangle() {
+	glm::vec3 v[3];
+	for (int i = 0; i < 3; i++)
+		Read(v[i]);
+	MaterialID material = 0;
+	bool hasMaterial = false, shadow = true;
+	while (More()) {
+		if (Next("material")) {
+			ReadMaterial(material);
+			hasMaterial = true;
+		}
+		else if (Next("noshadow")) shadow = false;
+		else Unexpected();
+	}
+	if (!failed && !hasMaterial)
+		Error("triangle without material");
+	if (!failed)
+		AddObject(Triangle(v[0], v[1], v[2], material), shadow);
+}
+
+void SceneParser::ParseMesh() {
+	std::string name, file;
+	Read(name);
+	Read(file);
+	if (More()) Unexpected();
+	if (!failed && model)
+		Error("mesh inside model '" + modelName + "'");
+	if (failed) return;
+	if (namedModels.count(name)) {
+		Error("'" + name + "' is already defined");
+		return;
+	}
+
+	ObjLoadStats stats;
+	std::string resolved = Resolve(file);
+	models.emplace_back();
+	Model &loaded = models.back();
+	if (!LoadOBJ(resolved.c_str(), loaded.primitives, materials, pool, &stats)) {
+		Error("could not read " + resolved);
+		return;
+	}
+	loaded.Build(&pool);
+	namedModels[name] = &loaded;
+	ReportObjLoad(resolved.c_str(), stats);
+}
+
+void SceneParser::ParseModel() {
+	std::string name;
+	Read(name);
+	if (More()) Unexpected();
+	if (!failed && model)
+		Error("model inside model '" + modelName + "'");
+	if (!failed && namedModels.count(name))
+		Error("'" + name + "' is already defined");
+	if (failed) return;
+	models.emplace_back();
+	model = &models.back();
+	modelName = name;
+}
+
+void SceneParser::ParseEnd() {
+	if (More()) Unexpected();
+	if (!failed && !model)
+		Error("end without model");
+	if (!failed && model->primitives.empty())
+		Error("model '" + modelName + "' is empty");
+	if (failed) return;
+	// defined once complete, so a model cannot place instances of itself
+	model->Build(&pool);
+	namedModels[modelName] = model;
+	model = NULL;
+}
+
+void SceneParser::ParseInstance() {
+	std::string name;
+	Read(name);
+	if (!failed && !namedModels.count(name)) {
+		Error("unknown model '" + name + "'");
+		return;
+	}
+
+	InstanceMotion motion;
+	bool shadow = true;
+	while (More()) {
+		if (Next("scale")) {
+			// one uniform factor or one per axis
+			Read(motion.scale.x);
+			motion.scale.y = motion.scale.z = motion.scale.x;
+			if (NextIsNumber()) {
+				Read(motion.scale.y);
+				Read(motion.scale.z);
+			}
+		}
+		else if (Next("rotate")) Read(motion.rotate);
+		else if (Next("translate")) Read(motion.translate);
+		else if (Next("spin")) Read(motion.spin);
+		else if (Next("move")) Read(motion.move);
+		else if (Next("noshadow")) shadow = false;
+		else Unexpected();
+	}
+	if (failed) return;
+
+	// both lists place the same model, its geometry is never copied
+	AddObject(Instance(namedModels[name], motion), shadow);
+}
+
+// the structure is picked before loading (see SceneAccelerator), only the statement is checked here
+void SceneParser::ParseAccelerator() {
+	std::string name;
+	Read(name);
+	if (More()) Unexpected();
+	if (!failed && model)
+		Error("accelerator inside model '" + modelName + "'");
+}
+#pragma endregion
+
+#pragma region Tokens
+bool SceneParser::Next(const char *word) {
+	if (!More() || tokens[next] != word)
+		return false;
+	next++;
+	return true;
+}
+
+bool SceneParser::NextIsNumber() const {
+	if (!More()) return false;
+	const char *text = tokens[next].c_str();
+	char *end;
+	strtod(text, &end);
+	return end != text && *end == '\0';
+}
+
+void SceneParser::Read(float &value) {
+	if (failed) return;
+	if (next >= tokens.size()) {
+		Error("missing number");
+		return;
+	}
+	const char *text = tokens[next].c_str();
+	char *end;
+	double number = strtod(text, &end);
+	if (end == text || *end != '\0') {
+		Error("expected a number instead of '" + tokens[next] + "'");
+		return;
+	}
+	value = (float)number;
+	next++;
+}
+
+void SceneParser::Read(int &value) {
+	if (failed) return;
+	if (next >= tokens.size()) {
+		Error("missing number");
+		return;
+	}
+	const char *text = tokens[next].c_str();
+	char *end;
+	long number = strtol(text, &end, 10);
+	if (end == text || *end != '\0') {
+		Error("expected an integer instead of '" + tokens[next] + "'");
+		return;
+	}
+	value = (int)number;
+	next++;
+}
+
+void SceneParser::Read(glm::vec3 &value) {
+	for (int c = 0; c < 3; c++)
+		Read(value[c]);
+}
+
+void SceneParser::Read(std::string &value) {
+	if (failed) return;
+	if (next >= tokens.size()) {
+		Error("missing name");
+		return;
+	}
+	value = tokens[next++];
+}
+
+void SceneParser::ReadMaterial(MaterialID &id) {
+	std::string name;
+	Read(name);
+	if (failed) return;
+	std::map<std::string, MaterialID>::const_iterator found = namedMaterials.find(name);
+	if (found == namedMaterials.end())
+		Error("unknown material '" + name + "'");
+	else
+		id = found->second;
+}
+
+void SceneParser::ReadNewName(std::string &name, const std::map<std::string, MaterialID> &names) {
+	Read(name);
+	if (!failed && names.count(name))
+		Error("'" + name + "' is already defined");
+}
+
+void SceneParser::Error(const std::string &message) {
+	if (failed) return;
+	std::cerr << path << ":" << line << ": " << message << std::endl;
+	failed = true;
+}
+
+void SceneParser::Unexpected() {
+	Error("unexpected '" + tokens[next] + "'");
+}
+
+std::string SceneParser::Resolve(const std::string &file) const {
+	return resolve_path(folder, file);
+}
+#pragma endregion
+
+bool LoadScene(const char *path, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+	std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, ThreadPool &pool) {
+	SceneParser parser(path, camera, lights, materials, models, objects, can_cast_shadow, pool);
+	return parser.Parse();
+}
+
+bool SceneDependencies(const char *path, std::vector<std::string> &files) {
+	std::ifstream file(path);
+	if (!file) return false;
+	std::string folder = folder_of(path);
+	std::string text;
+	while (std::getline(file, text)) {
+		text.erase(std::min(text.find('#'), text.size()));
+		std::istringstream stream(text);
+		std::string keyword, name, model;
+		if (stream >> keyword >> name >> model && keyword == "mesh") {
+			files.push_back(resolve_path(folder, model));
+			ObjDependencies(files.back().c_str(), files);
+		}
+	}
+	return true;
+}
+
+bool SceneAccelerator(const char *path, std::string &name) {
+	std::ifstream file(path);
+	if (!file) return false;
+	bool found = false;
+	std::string text;
+	while (std::getline(file, text)) {
+		text.erase(std::min(text.find('#'), text.size()));
+		std::istringstream stream(text);
+		std::string keyword, value;
+		// the last statement wins
+		if (stream >> keyword >> value && keyword == "accelerator") {
+			name = value;
+			found = true;
+		}
+	}
+	return found;
+}
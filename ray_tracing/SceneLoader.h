@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Camera.h"
+#include "Light.h"
+#include "Material.h"
+#include "Model.h"
+#include "PrimitiveList.h"
+#include "ThreadPool.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+ * Scene description file
+ * one statement per line, '#' starts a comment. a statement is a keyword followed by
+ * its arguments and optional named properties in any order ([..] below, defaults in brackets after):
+ *
+ *   camera [position x y z] [target x y z] [up x y z] [fov degrees] [size width height]
+ *   light position x y z [ambient a (0)] [diffuse d (1)] [attenuation constant linear quadratic (1 0 0)]
+ *   material name [ambient r g b] [diffuse r g b] [specular r g b] [glossiness g] [reflection r] [refraction index]
+ *   checker name even odd repeat u v       alternates two materials over the surface coordinates
+ *   checker name even odd cell x y z       or over a world space grid (0 leaves an axis out)
+ *   sphere center x y z radius r material name [noshadow]
+ *   plane x y z  x y z  x y z  x y z  material name [noshadow]
+ *   triangle x y z  x y z  x y z  material name [noshadow]
+ *   mesh name file.obj                     loads a Wavefront OBJ (with its .mtl materials) as a model
+ *   model name                             the sphere, plane, triangle and instance statements up to
+ *   end                                    the end make up a model instead of being placed in the scene
+ *   instance name [scale s | scale x y z] [rotate x y z] [translate x y z] [spin x y z] [move x y z] [noshadow]
+ *   accelerator name                       structure the scene is traced with when -accel is not given
+ *                                          (bvh, bvh4, bvh8, bvh4q, bvh8q, grid, grid2, kd or list)
+ *
+ * materials and models are used by name after their statement, unset material colours are 0.
+ * models are only placed by instances, which share the model's geometry and apply scale, rotation
+ * (degrees around x, then y, then z) and translation in that order. spin and move animate an instance
+ * placed in the scene, adding to its rotation and translation every frame (see -frames).
+ * noshadow keeps an object out of can_cast_shadow, paths are relative to the scene file
+ */
+
+/*
+ * reads a scene file, appending to the lights, materials, models and object lists; camera keeps what
+ * the file does not set. the instances in the lists refer to the models, which have to outlive them.
+ * errors are reported with their line and make it return false
+ */
+bool LoadScene(const char *path, Camera &camera, std::vector<PointLight> &lights, MaterialTable &materials,
+	std::deque<Model> &models, PrimitiveList &objects, PrimitiveList &can_cast_shadow, ThreadPool &pool);
+
+/*
+ * paths of the files a scene file refers to (its meshes and their material libraries), without parsing the rest.
+ * returns false if the scene file could not be read
+ */
+bool SceneDependencies(const char *path, std::vector<std::string> &files);
+
+/*
+ * name given by the scene file's accelerator statement, without parsing the rest.
+ * returns false if the file could not be read or has no such statement
+ */
+bool SceneAccelerator(const char *path, std::string &name);
@@ -0,0 +1,703 @@
+#include "SimdKernels.h"
+#include "PrimitiveList.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+// lets gcc/clang emit the instructions without building the whole program for them
+#define TARGET_SSE __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/*
+ * Block kernel
+ * returns the lane of the closest primitive hit before tmax (and its time in t), or -1
+ */
+typedef int (*BlockKernel)(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t);
+/*
+ * Packet box kernel
+ * returns the active rays hitting the box before their tmax
+ */
+typedef RayMask (*BoxKernel)(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax);
+/*
+ * Child box kernel
+ * returns the lanes of a wide node whose boxes the ray enters before tmax, with their entry times
+ */
+typedef unsigned int (*ChildBoxKernel)(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear);
+/*
+ * Quantized child box kernel
+ * as ChildBoxKernel, the boxes are decoded to frame + bounds * step first
+ */
+typedef unsigned int (*QuantizedChildBoxKernel)(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear);
+
+/*
+ * picks the smallest of the per lane times, misses are infinity
+ */
+static inline int closest_lane(const float *times, int count, float &t) {
+	int lane = -1;
+	t = std::numeric_limits<float>::infinity();
+	for (int i = 0; i < count; i++)
+		if (times[i] < t) {
+			t = times[i];
+			lane = i;
+		}
+	return lane;
+}
+
+#pragma region Scalar Kernels
+/*
+ * same arithmetic as Sphere::Intersect / the Moller-Trumbore kernel in Object.cpp, lane by lane
+ */
+static int sphere_kernel_scalar(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	float A = glm::dot(d, d);
+	float times[SIMD_BLOCK_SIZE];
+	for (int i = 0; i < block.count; i++) {
+		times[i] = std::numeric_limits<float>::infinity();
+		float ocx = o.x - block.data[0][i], ocy = o.y - block.data[1][i], ocz = o.z - block.data[2][i];
+		float b = d.x*ocx + d.y*ocy + d.z*ocz;
+		float C = ocx*ocx + ocy*ocy + ocz*ocz - block.data[3][i];
+		float discriminant = b*b - A*C;
+		if (discriminant < 0.f) continue;
+		float root = sqrt(discriminant);
+		float t1 = (-b - root) / A;
+		float t2 = (-b + root) / A;
+		float ti = t1 > 0.f ? t1 : t2;
+		if (ti > 0.f && ti < tmax) times[i] = ti;
+	}
+	return closest_lane(times, block.count, t);
+}
+
+template <bool parallelogram>
+static int triangle_kernel_scalar(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	float times[SIMD_BLOCK_SIZE];
+	for (int i = 0; i < block.count; i++) {
+		times[i] = std::numeric_limits<float>::infinity();
+		glm::vec3 v0(block.data[0][i], block.data[1][i], block.data[2][i]);
+		glm::vec3 e1(block.data[3][i], block.data[4][i], block.data[5][i]);
+		glm::vec3 e2(block.data[6][i], block.data[7][i], block.data[8][i]);
+
+		glm::vec3 p = glm::cross(d, e2);
+		float det = glm::dot(e1, p);
+		if (det == 0.f) continue;
+		float invDet = 1.f / det;
+		glm::vec3 s = o - v0;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.f || u > 1.f) continue;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(d, q) * invDet;
+		if (v < 0.f || v > 1.f || (!parallelogram && u + v > 1.f)) continue;
+		float ti = glm::dot(e2, q) * invDet;
+		if (ti >= 0.f && ti < tmax) times[i] = ti;
+	}
+	return closest_lane(times, block.count, t);
+}
+
+static RayMask box_kernel_scalar(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax) {
+	RayMask hits = 0;
+	for (int i = 0; i < packet.count; i++) {
+		if (!(active & (1u << i))) continue;
+		glm::vec3 invDir(packet.invDir[0][i], packet.invDir[1][i], packet.invDir[2][i]);
+		float tnear;
+		if (box.Intersect(packet.rays[i], invDir, tmax[i], tnear))
+			hits |= 1u << i;
+	}
+	return hits;
+}
+
+static unsigned int child_box_kernel_scalar(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	unsigned int hits = 0;
+	for (int i = 0; i < width; i++) {
+		float t0 = 0.f, t1 = tmax;
+		for (int a = 0; a < 3; a++) {
+			float tA = (bounds[a * width + i] - origin[a]) * invDir[a];
+			float tB = (bounds[(3 + a) * width + i] - origin[a]) * invDir[a];
+			if (tA > tB) std::swap(tA, tB);
+			t0 = tA > t0 ? tA : t0;
+			t1 = tB < t1 ? tB : t1;
+		}
+		tnear[i] = t0;
+		if (t0 <= t1) hits |= 1u << i;
+	}
+	return hits;
+}
+
+static unsigned int quantized_child_box_kernel_scalar(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	unsigned int hits = 0;
+	for (int i = 0; i < width; i++) {
+		float t0 = 0.f, t1 = tmax;
+		for (int a = 0; a < 3; a++) {
+			// decoded exactly as QuantizedWideBVHNode::getBounds, which the rounding was checked against
+			float tA = (frame[a] + bounds[a * width + i] * step[a] - origin[a]) * invDir[a];
+			float tB = (frame[a] + bounds[(3 + a) * width + i] * step[a] - origin[a]) * invDir[a];
+			if (tA > tB) std::swap(tA, tB);
+			t0 = tA > t0 ? tA : t0;
+			t1 = tB < t1 ? tB : t1;
+		}
+		tnear[i] = t0;
+		if (t0 <= t1) hits |= 1u << i;
+	}
+	return hits;
+}
+#pragma endregion
+
+#ifdef SIMD_X86
+#pragma region SSE Kernels
+/*
+ * 4 lanes at a time, the block is processed in two halves
+ */
+TARGET_SSE static int sphere_kernel_sse(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	__m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+	__m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	__m128 A = _mm_set1_ps(glm::dot(d, d));
+	__m128 zero = _mm_setzero_ps(), inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	__m128 limit = _mm_set1_ps(tmax), count = _mm_set1_ps((float)block.count);
+
+	float times[SIMD_BLOCK_SIZE];
+	int any = 0;
+	for (int base = 0; base < block.count; base += 4) {
+		__m128 valid = _mm_cmplt_ps(_mm_setr_ps(base + 0.f, base + 1.f, base + 2.f, base + 3.f), count);
+		__m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(&block.data[0][base]));
+		__m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(&block.data[1][base]));
+		__m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(&block.data[2][base]));
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ocx), _mm_mul_ps(dy, ocy)), _mm_mul_ps(dz, ocz));
+		__m128 C = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+			_mm_loadu_ps(&block.data[3][base]));
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(A, C));
+		__m128 mask = _mm_and_ps(valid, _mm_cmpge_ps(discriminant, zero));
+
+		__m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+		__m128 nb = _mm_sub_ps(zero, b);
+		__m128 t1 = _mm_div_ps(_mm_sub_ps(nb, root), A);
+		__m128 t2 = _mm_div_ps(_mm_add_ps(nb, root), A);
+		__m128 near1 = _mm_cmpgt_ps(t1, zero);
+		__m128 ti = _mm_or_ps(_mm_and_ps(near1, t1), _mm_andnot_ps(near1, t2));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(ti, zero), _mm_cmplt_ps(ti, limit)));
+
+		any |= _mm_movemask_ps(mask);
+		_mm_storeu_ps(&times[base], _mm_or_ps(_mm_and_ps(mask, ti), _mm_andnot_ps(mask, inf)));
+	}
+	if (!any) return -1;
+	return closest_lane(times, block.count, t);
+}
+
+template <bool parallelogram>
+TARGET_SSE static int triangle_kernel_sse(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	__m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+	__m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	__m128 limit = _mm_set1_ps(tmax), count = _mm_set1_ps((float)block.count);
+
+	float times[SIMD_BLOCK_SIZE];
+	int any = 0;
+	for (int base = 0; base < block.count; base += 4) {
+		__m128 valid = _mm_cmplt_ps(_mm_setr_ps(base + 0.f, base + 1.f, base + 2.f, base + 3.f), count);
+		__m128 e1x = _mm_loadu_ps(&block.data[3][base]), e1y = _mm_loadu_ps(&block.data[4][base]), e1z = _mm_loadu_ps(&block.data[5][base]);
+		__m128 e2x = _mm_loadu_ps(&block.data[6][base]), e2y = _mm_loadu_ps(&block.data[7][base]), e2z = _mm_loadu_ps(&block.data[8][base]);
+
+		// p = d x e2, det = e1 . p
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 invDet = _mm_div_ps(one, det);
+
+		// s = o - v0, u = (s . p) / det
+		__m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(&block.data[0][base]));
+		__m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(&block.data[1][base]));
+		__m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(&block.data[2][base]));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+		// q = s x e1, v = (d . q) / det, t = (e2 . q) / det
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+		__m128 ti = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+		__m128 mask = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(v, one)));
+		if (!parallelogram)
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(ti, zero), _mm_cmplt_ps(ti, limit)));
+
+		any |= _mm_movemask_ps(mask);
+		_mm_storeu_ps(&times[base], _mm_or_ps(_mm_and_ps(mask, ti), _mm_andnot_ps(mask, inf)));
+	}
+	if (!any) return -1;
+	return closest_lane(times, block.count, t);
+}
+
+/*
+ * slab test of 4 rays at a time, min/max take the accumulated interval as the second operand
+ * so that a NaN (flat box, parallel ray) leaves it untouched, as in AABB::Intersect
+ */
+TARGET_SSE static RayMask box_kernel_sse(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax) {
+	RayMask hits = 0;
+	for (int base = 0; base < packet.count; base += 4) {
+		if (!((active >> base) & 0xf)) continue;
+		__m128 t0 = _mm_setzero_ps(), t1 = _mm_loadu_ps(&tmax[base]);
+		for (int a = 0; a < 3; a++) {
+			__m128 o = _mm_loadu_ps(&packet.origin[a][base]);
+			__m128 invDir = _mm_loadu_ps(&packet.invDir[a][base]);
+			__m128 tA = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min[a]), o), invDir);
+			__m128 tB = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max[a]), o), invDir);
+			t0 = _mm_max_ps(_mm_min_ps(tB, tA), t0);
+			t1 = _mm_min_ps(_mm_max_ps(tB, tA), t1);
+		}
+		hits |= (RayMask)_mm_movemask_ps(_mm_cmple_ps(t0, t1)) << base;
+	}
+	return hits & active;
+}
+
+/*
+ * one ray against 4 child boxes at a time, the same operand order as box_kernel_sse
+ */
+TARGET_SSE static unsigned int child_box_kernel_sse(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	unsigned int hits = 0;
+	for (int base = 0; base < width; base += 4) {
+		__m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(tmax);
+		for (int a = 0; a < 3; a++) {
+			__m128 o = _mm_set1_ps(origin[a]), inv = _mm_set1_ps(invDir[a]);
+			__m128 tA = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&bounds[a * width + base]), o), inv);
+			__m128 tB = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&bounds[(3 + a) * width + base]), o), inv);
+			t0 = _mm_max_ps(_mm_min_ps(tB, tA), t0);
+			t1 = _mm_min_ps(_mm_max_ps(tB, tA), t1);
+		}
+		_mm_storeu_ps(&tnear[base], t0);
+		hits |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(t0, t1)) << base;
+	}
+	return hits;
+}
+
+// 4 bytes to 4 floats, SSE2 has no single instruction for it
+TARGET_SSE static __m128 load_u8_sse(const unsigned char *p) {
+	int bytes;
+	memcpy(&bytes, p, sizeof(bytes));
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+}
+
+TARGET_SSE static unsigned int quantized_child_box_kernel_sse(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	unsigned int hits = 0;
+	for (int base = 0; base < width; base += 4) {
+		__m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(tmax);
+		for (int a = 0; a < 3; a++) {
+			__m128 f = _mm_set1_ps(frame[a]), s = _mm_set1_ps(step[a]);
+			__m128 o = _mm_set1_ps(origin[a]), inv = _mm_set1_ps(invDir[a]);
+			__m128 lo = _mm_add_ps(f, _mm_mul_ps(load_u8_sse(&bounds[a * width + base]), s));
+			__m128 hi = _mm_add_ps(f, _mm_mul_ps(load_u8_sse(&bounds[(3 + a) * width + base]), s));
+			__m128 tA = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+			__m128 tB = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+			t0 = _mm_max_ps(_mm_min_ps(tB, tA), t0);
+			t1 = _mm_min_ps(_mm_max_ps(tB, tA), t1);
+		}
+		_mm_storeu_ps(&tnear[base], t0);
+		hits |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(t0, t1)) << base;
+	}
+	return hits;
+}
+#pragma endregion
+
+#pragma region AVX2 Kernels
+/*
+ * all 8 lanes at once
+ */
+TARGET_AVX2 static int sphere_kernel_avx2(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	__m256 zero = _mm256_setzero_ps(), inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+	__m256 A = _mm256_set1_ps(glm::dot(d, d));
+	__m256 valid = _mm256_cmp_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps((float)block.count), _CMP_LT_OQ);
+
+	__m256 ocx = _mm256_sub_ps(_mm256_set1_ps(o.x), _mm256_loadu_ps(block.data[0]));
+	__m256 ocy = _mm256_sub_ps(_mm256_set1_ps(o.y), _mm256_loadu_ps(block.data[1]));
+	__m256 ocz = _mm256_sub_ps(_mm256_set1_ps(o.z), _mm256_loadu_ps(block.data[2]));
+	__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(d.x), ocx), _mm256_mul_ps(_mm256_set1_ps(d.y), ocy)),
+		_mm256_mul_ps(_mm256_set1_ps(d.z), ocz));
+	__m256 C = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+		_mm256_loadu_ps(block.data[3]));
+	__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(A, C));
+	__m256 mask = _mm256_and_ps(valid, _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ));
+	if (!_mm256_movemask_ps(mask)) return -1;
+
+	__m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+	__m256 nb = _mm256_sub_ps(zero, b);
+	__m256 t1 = _mm256_div_ps(_mm256_sub_ps(nb, root), A);
+	__m256 t2 = _mm256_div_ps(_mm256_add_ps(nb, root), A);
+	__m256 ti = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, zero, _CMP_GT_OQ));
+	mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(ti, zero, _CMP_GT_OQ), _mm256_cmp_ps(ti, _mm256_set1_ps(tmax), _CMP_LT_OQ)));
+	if (!_mm256_movemask_ps(mask)) return -1;
+
+	float times[SIMD_BLOCK_SIZE];
+	_mm256_storeu_ps(times, _mm256_blendv_ps(inf, ti, mask));
+	return closest_lane(times, block.count, t);
+}
+
+template <bool parallelogram>
+TARGET_AVX2 static int triangle_kernel_avx2(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	const glm::vec3 &o = ray.origin, &d = ray.direction;
+	__m256 dx = _mm256_set1_ps(d.x), dy = _mm256_set1_ps(d.y), dz = _mm256_set1_ps(d.z);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+	__m256 valid = _mm256_cmp_ps(_mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f), _mm256_set1_ps((float)block.count), _CMP_LT_OQ);
+
+	__m256 e1x = _mm256_loadu_ps(block.data[3]), e1y = _mm256_loadu_ps(block.data[4]), e1z = _mm256_loadu_ps(block.data[5]);
+	__m256 e2x = _mm256_loadu_ps(block.data[6]), e2y = _mm256_loadu_ps(block.data[7]), e2z = _mm256_loadu_ps(block.data[8]);
+
+	// p = d x e2, det = e1 . p
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+	__m256 invDet = _mm256_div_ps(one, det);
+
+	// s = o - v0, u = (s . p) / det
+	__m256 sx = _mm256_sub_ps(_mm256_set1_ps(o.x), _mm256_loadu_ps(block.data[0]));
+	__m256 sy = _mm256_sub_ps(_mm256_set1_ps(o.y), _mm256_loadu_ps(block.data[1]));
+	__m256 sz = _mm256_sub_ps(_mm256_set1_ps(o.z), _mm256_loadu_ps(block.data[2]));
+	__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+
+	__m256 mask = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+	mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+	if (!_mm256_movemask_ps(mask)) return -1;
+
+	// q = s x e1, v = (d . q) / det, t = (e2 . q) / det
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+	__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+	__m256 ti = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+
+	mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, one, _CMP_LE_OQ)));
+	if (!parallelogram)
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(ti, zero, _CMP_GE_OQ), _mm256_cmp_ps(ti, _mm256_set1_ps(tmax), _CMP_LT_OQ)));
+	if (!_mm256_movemask_ps(mask)) return -1;
+
+	float times[SIMD_BLOCK_SIZE];
+	_mm256_storeu_ps(times, _mm256_blendv_ps(inf, ti, mask));
+	return closest_lane(times, block.count, t);
+}
+
+TARGET_AVX2 static RayMask box_kernel_avx2(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax) {
+	RayMask hits = 0;
+	for (int base = 0; base < packet.count; base += 8) {
+		if (!((active >> base) & 0xff)) continue;
+		__m256 t0 = _mm256_setzero_ps(), t1 = _mm256_loadu_ps(&tmax[base]);
+		for (int a = 0; a < 3; a++) {
+			__m256 o = _mm256_loadu_ps(&packet.origin[a][base]);
+			__m256 invDir = _mm256_loadu_ps(&packet.invDir[a][base]);
+			__m256 tA = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.min[a]), o), invDir);
+			__m256 tB = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.max[a]), o), invDir);
+			t0 = _mm256_max_ps(_mm256_min_ps(tB, tA), t0);
+			t1 = _mm256_min_ps(_mm256_max_ps(tB, tA), t1);
+		}
+		hits |= (RayMask)_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)) << base;
+	}
+	return hits & active;
+}
+
+/*
+ * all 8 children of a node at once, 4 wide nodes go through the SSE kernel
+ */
+TARGET_AVX2 static unsigned int child_box_kernel_avx2(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	if (width != 8)
+		return child_box_kernel_sse(bounds, width, origin, invDir, tmax, tnear);
+	__m256 t0 = _mm256_setzero_ps(), t1 = _mm256_set1_ps(tmax);
+	for (int a = 0; a < 3; a++) {
+		__m256 o = _mm256_set1_ps(origin[a]), inv = _mm256_set1_ps(invDir[a]);
+		__m256 tA = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&bounds[a * 8]), o), inv);
+		__m256 tB = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&bounds[(3 + a) * 8]), o), inv);
+		t0 = _mm256_max_ps(_mm256_min_ps(tB, tA), t0);
+		t1 = _mm256_min_ps(_mm256_max_ps(tB, tA), t1);
+	}
+	_mm256_storeu_ps(tnear, t0);
+	return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+
+TARGET_AVX2 static unsigned int quantized_child_box_kernel_avx2(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	if (width != 8)
+		return quantized_child_box_kernel_sse(bounds, width, frame, step, origin, invDir, tmax, tnear);
+	__m256 t0 = _mm256_setzero_ps(), t1 = _mm256_set1_ps(tmax);
+	for (int a = 0; a < 3; a++) {
+		__m256 f = _mm256_set1_ps(frame[a]), s = _mm256_set1_ps(step[a]);
+		__m256 o = _mm256_set1_ps(origin[a]), inv = _mm256_set1_ps(invDir[a]);
+		__m256 qA = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&bounds[a * 8])));
+		__m256 qB = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&bounds[(3 + a) * 8])));
+		// separate multiply and add, a fused one would round differently from getBounds
+		__m256 tA = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(f, _mm256_mul_ps(qA, s)), o), inv);
+		__m256 tB = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(f, _mm256_mul_ps(qB, s)), o), inv);
+		t0 = _mm256_max_ps(_mm256_min_ps(tB, tA), t0);
+		t1 = _mm256_min_ps(_mm256_max_ps(tB, tA), t1);
+	}
+	_mm256_storeu_ps(tnear, t0);
+	return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#pragma endregion
+#endif
+
+#pragma region Dispatch
+static SimdLevel simd_level = SIMD_SCALAR;
+static BlockKernel kernels[3] = {
+	sphere_kernel_scalar,
+	triangle_kernel_scalar<false>,
+	triangle_kernel_scalar<true>
+};
+static BoxKernel box_kernel = box_kernel_scalar;
+static ChildBoxKernel child_box_kernel = child_box_kernel_scalar;
+static QuantizedChildBoxKernel quantized_child_box_kernel = quantized_child_box_kernel_scalar;
+
+#ifdef SIMD_X86
+static void cpuid(int leaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, leaf, 0);
+	for (int i = 0; i < 4; i++) regs[i] = (unsigned int)info[i];
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+SimdLevel DetectSimdLevel() {
+#ifdef SIMD_X86
+	// SSE2 is part of x86-64 and the default target of the compilers we build with
+	SimdLevel level = SIMD_SSE;
+	unsigned int regs[4];
+	cpuid(0, regs);
+	unsigned int maxLeaf = regs[0];
+	cpuid(1, regs);
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	// the os has to save the ymm registers on context switches
+	if (maxLeaf >= 7 && osxsave && avx && (xgetbv0() & 6) == 6) {
+		cpuid(7, regs);
+		if (regs[1] & (1u << 5))
+			level = SIMD_AVX2;
+	}
+	return level;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel SetSimdLevel(SimdLevel level) {
+	level = std::min(level, DetectSimdLevel());
+	simd_level = level;
+
+	kernels[PrimitiveBlock::SPHERES] = sphere_kernel_scalar;
+	kernels[PrimitiveBlock::TRIANGLES] = triangle_kernel_scalar<false>;
+	kernels[PrimitiveBlock::PARALLELOGRAMS] = triangle_kernel_scalar<true>;
+	box_kernel = box_kernel_scalar;
+	child_box_kernel = child_box_kernel_scalar;
+	quantized_child_box_kernel = quantized_child_box_kernel_scalar;
+#ifdef SIMD_X86
+	if (level == SIMD_SSE) {
+		kernels[PrimitiveBlock::SPHERES] = sphere_kernel_sse;
+		kernels[PrimitiveBlock::TRIANGLES] = triangle_kernel_sse<false>;
+		kernels[PrimitiveBlock::PARALLELOGRAMS] = triangle_kernel_sse<true>;
+		box_kernel = box_kernel_sse;
+		child_box_kernel = child_box_kernel_sse;
+		quantized_child_box_kernel = quantized_child_box_kernel_sse;
+	}
+	else if (level == SIMD_AVX2) {
+		kernels[PrimitiveBlock::SPHERES] = sphere_kernel_avx2;
+		kernels[PrimitiveBlock::TRIANGLES] = triangle_kernel_avx2<false>;
+		kernels[PrimitiveBlock::PARALLELOGRAMS] = triangle_kernel_avx2<true>;
+		box_kernel = box_kernel_avx2;
+		child_box_kernel = child_box_kernel_avx2;
+		quantized_child_box_kernel = quantized_child_box_kernel_avx2;
+	}
+#endif
+	return level;
+}
+
+/*
+ * the best kernels are selected while the program starts, before main and any thread, so the
+ * rendering threads only ever read the table (-simd changes it in main, before the pool starts)
+ */
+static const SimdLevel simd_detected = SetSimdLevel(DetectSimdLevel());
+
+SimdLevel getSimdLevel() {
+	return simd_level;
+}
+
+const char *SimdLevelName(SimdLevel level) {
+	switch (level) {
+	case SIMD_SSE: return "sse";
+	case SIMD_AVX2: return "avx2";
+	default: return "scalar";
+	}
+}
+#pragma endregion
+
+/*
+ * block kind of a primitive and the geometry its lane holds, SCALAR kinds leave the geometry untouched
+ */
+static int lane_geometry(const PrimitiveList &primitives, PrimitiveRef ref, glm::vec3 &v0, glm::vec3 &e1, glm::vec3 &e2, float &r2) {
+	unsigned int index = getPrimitiveIndex(ref);
+	switch (getPrimitiveType(ref)) {
+	case PRIMITIVE_SPHERE: {
+		const Sphere &sphere = primitives.spheres[index];
+		v0 = sphere.getCentroid();
+		r2 = sphere.getRadius() * sphere.getRadius();
+		return PrimitiveBlock::SPHERES;
+	}
+	case PRIMITIVE_TRIANGLE: {
+		const Triangle &triangle = primitives.triangles[index];
+		v0 = triangle.getVertex(0);
+		e1 = triangle.getVertex(1) - v0;
+		e2 = triangle.getVertex(2) - v0;
+		return PrimitiveBlock::TRIANGLES;
+	}
+	case PRIMITIVE_MESH:
+	case PRIMITIVE_INSTANCE:
+		// meshes and models have blocks of their own inside
+		break;
+	case PRIMITIVE_PLANE: {
+		const Plane &plane = primitives.planes[index];
+		if (!plane.isParallelogram()) break;
+		v0 = plane.getVertex(0);
+		e1 = plane.getVertex(1) - v0;
+		e2 = plane.getVertex(3) - v0;
+		return PrimitiveBlock::PARALLELOGRAMS;
+	}
+	}
+	return PrimitiveBlock::SCALAR;
+}
+
+static void set_lane(PrimitiveBlock &block, int lane, const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2, float r2) {
+	for (int c = 0; c < 3; c++) {
+		block.data[c][lane] = v0[c];
+		block.data[3 + c][lane] = e1[c];
+		block.data[6 + c][lane] = e2[c];
+	}
+	if (block.kind == PrimitiveBlock::SPHERES)
+		block.data[3][lane] = r2;
+}
+
+void PackBlocks(const PrimitiveList &primitives, const PrimitiveRef *refs, int count, Buffer<PrimitiveBlock> &blocks) {
+	// one open block per kind, flushed when full
+	PrimitiveBlock open[4];
+	for (int k = 0; k < 4; k++) {
+		memset(&open[k], 0, sizeof(PrimitiveBlock));
+		open[k].kind = k;
+	}
+
+	for (int i = 0; i < count; i++) {
+		glm::vec3 v0, e1, e2;
+		float r2 = 0.f;
+		int kind = lane_geometry(primitives, refs[i], v0, e1, e2, r2);
+
+		PrimitiveBlock &block = open[kind];
+		int lane = block.count++;
+		block.refs[lane] = refs[i];
+		set_lane(block, lane, v0, e1, e2, r2);
+
+		if (block.count == SIMD_BLOCK_SIZE) {
+			blocks.push_back(block);
+			memset(&block, 0, sizeof(PrimitiveBlock));
+			block.kind = kind;
+		}
+	}
+
+	for (int k = 0; k < 4; k++)
+		if (open[k].count > 0)
+			blocks.push_back(open[k]);
+}
+
+void UpdateBlock(const PrimitiveList &primitives, PrimitiveBlock &block) {
+	if (block.kind == PrimitiveBlock::SCALAR) return;
+	for (int lane = 0; lane < block.count; lane++) {
+		glm::vec3 v0, e1, e2;
+		float r2 = 0.f;
+		lane_geometry(primitives, block.refs[lane], v0, e1, e2, r2);
+		set_lane(block, lane, v0, e1, e2, r2);
+	}
+}
+
+int ClosestInBlock(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t) {
+	return kernels[block.kind](block, ray, tmax, t);
+}
+
+bool IntersectBlock(const PrimitiveList &primitives, const PrimitiveBlock &block, const Ray &ray, IntersectInfo &info, float MAX) {
+	if (block.kind == PrimitiveBlock::SCALAR) {
+		bool flag = false;
+		for (int i = 0; i < block.count; i++)
+			if (primitives.Intersect(block.refs[i], ray, info, MAX))
+				flag = true;
+		return flag;
+	}
+
+	float tmax = info.time;
+	if (MAX != std::numeric_limits<float>::infinity())
+		tmax = std::min(tmax, MAX / glm::length(ray.direction));
+	float t;
+	int lane = kernels[block.kind](block, ray, tmax, t);
+	if (lane < 0) return false;
+	// the primitive fills in the hit point, normal and material
+	if (primitives.Intersect(block.refs[lane], ray, info, MAX)) return true;
+
+	// kernel and primitive disagree on a borderline hit (rounding), settle it one by one
+	bool flag = false;
+	for (int i = 0; i < block.count; i++)
+		if (primitives.Intersect(block.refs[i], ray, info, MAX))
+			flag = true;
+	return flag;
+}
+
+bool OccludedBlock(const PrimitiveList &primitives, const PrimitiveBlock &block, const Ray &ray, float MAX) {
+	if (block.kind == PrimitiveBlock::SCALAR) {
+		for (int i = 0; i < block.count; i++)
+			if (primitives.Occluded(block.refs[i], ray, MAX))
+				return true;
+		return false;
+	}
+
+	float tmax = std::numeric_limits<float>::infinity();
+	if (MAX != std::numeric_limits<float>::infinity())
+		tmax = MAX / glm::length(ray.direction);
+	float t;
+	return kernels[block.kind](block, ray, tmax, t) >= 0;
+}
+
+RayMask IntersectBoxPacket(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax) {
+	return box_kernel(box, packet, active, tmax);
+}
+
+unsigned int IntersectChildBoxes(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	return child_box_kernel(bounds, width, origin, invDir, tmax, tnear);
+}
+
+unsigned int IntersectQuantizedChildBoxes(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) {
+	return quantized_child_box_kernel(bounds, width, frame, step, origin, invDir, tmax, tnear);
+}
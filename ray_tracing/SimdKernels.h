@@ -0,0 +1,97 @@
+#pragma once
+
+#include "AABB.h"
+#include "Buffer.h"
+#include "PrimitiveRef.h"
+#include "RayPacket.h"
+#include <vector>
+
+// primitives per block, one AVX register or two SSE registers
+#define SIMD_BLOCK_SIZE 8
+
+class PrimitiveList;
+
+/*
+ * Instruction sets the block kernels can use, picked at runtime
+ */
+enum SimdLevel {
+	SIMD_SCALAR = 0,
+	SIMD_SSE = 1,
+	SIMD_AVX2 = 2
+};
+
+/*
+ * Primitive Block
+ * up to SIMD_BLOCK_SIZE primitives of one kind with their geometry in SoA form,
+ * so that one ray is tested against all of them with a few vector instructions.
+ * the kernels only find the closest lane, the primitive's own Intersect then fills the IntersectInfo
+ */
+struct PrimitiveBlock {
+	enum Kind {
+		SPHERES,		// centre, squared radius
+		TRIANGLES,		// first vertex and the two edges leaving it
+		PARALLELOGRAMS,	// same layout as triangles (planes that are parallelograms)
+		SCALAR			// anything else, tested one by one through the PrimitiveList
+	};
+
+	int kind;
+	int count;
+	// the object of each lane (triangle index in meshes)
+	PrimitiveRef refs[SIMD_BLOCK_SIZE];
+	// data[component][lane]
+	float data[9][SIMD_BLOCK_SIZE];
+};
+
+/*
+ * lane of the closest primitive of a spheres, triangles or parallelograms block hit before tmax
+ * (t returns its time), -1 if there is none. used directly where the lanes are not PrimitiveList objects
+ */
+int ClosestInBlock(const PrimitiveBlock &block, const Ray &ray, float tmax, float &t);
+
+/*
+ * groups the referenced primitives by kind into blocks, appended to the list
+ */
+void PackBlocks(const PrimitiveList &primitives, const PrimitiveRef *refs, int count, Buffer<PrimitiveBlock> &blocks);
+/*
+ * copies the current geometry of the block's primitives into its lanes, after they moved
+ */
+void UpdateBlock(const PrimitiveList &primitives, PrimitiveBlock &block);
+
+/*
+ * closest hit in the block, same contract as Object::Intersect
+ */
+bool IntersectBlock(const PrimitiveList &primitives, const PrimitiveBlock &block, const Ray &ray, IntersectInfo &info, float MAX);
+/*
+ * any hit in the block closer than MAX
+ */
+bool OccludedBlock(const PrimitiveList &primitives, const PrimitiveBlock &block, const Ray &ray, float MAX);
+
+/*
+ * box test for the active rays of a packet, tmax holds the time limit of every ray.
+ * returns the active rays that hit the box
+ */
+RayMask IntersectBoxPacket(const AABB &box, const RayPacket &packet, RayMask active, const float *tmax);
+/*
+ * slab test of one ray against the boxes of a wide BVH node (width 4 or 8), stored as bounds[component][lane]
+ * with the components min x, y, z, max x, y, z. returns the lanes entered before tmax, tnear gets every lane's entry time
+ */
+unsigned int IntersectChildBoxes(const float *bounds, int width, const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear);
+/*
+ * the same for quantized boxes, stored as bounds[component][lane] steps of size step from frame
+ * (box = frame + bounds * step along every axis)
+ */
+unsigned int IntersectQuantizedChildBoxes(const unsigned char *bounds, int width, const float *frame, const float *step,
+	const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear);
+
+/*
+ * best level supported by the cpu and the operating system
+ */
+SimdLevel DetectSimdLevel();
+/*
+ * selects the kernels used by IntersectBlock/OccludedBlock/IntersectBoxPacket/Intersect(Quantized)ChildBoxes (clamped to what the cpu supports),
+ * returns the level actually selected. the best level is selected at startup; not thread safe, call it before
+ * any thread traces rays
+ */
+SimdLevel SetSimdLevel(SimdLevel level);
+SimdLevel getSimdLevel();
+const char *SimdLevelName(SimdLevel level);
@@ -0,0 +1,39 @@
+#include "Texture.h"
+#include <algorithm>
+
+CheckerTexture::CheckerTexture(MaterialID even, MaterialID odd, float repeatsU, float repeatsV):
+	useUV(true),
+	repeatsU(repeatsU),
+	repeatsV(repeatsV),
+	invCellSize(0.f)
+{
+	materials[0] = even;
+	materials[1] = odd;
+}
+
+CheckerTexture::CheckerTexture(MaterialID even, MaterialID odd, const glm::vec3 &cellSize):
+	useUV(false),
+	repeatsU(0.f),
+	repeatsV(0.f)
+{
+	materials[0] = even;
+	materials[1] = odd;
+	for (int a = 0; a < 3; a++)
+		invCellSize[a] = cellSize[a] > 0.f ? 1.f / cellSize[a] : 0.f;
+}
+
+/*
+ * parity of the sum of the cell indices
+ */
+MaterialID CheckerTexture::Evaluate(const glm::vec3 &point, float u, float v) const {
+	int cells;
+	if (useUV) {
+		// keep the far edge (u or v == 1) inside the last cell
+		cells = std::min((int)floor(u * repeatsU), (int)repeatsU - 1) +
+			std::min((int)floor(v * repeatsV), (int)repeatsV - 1);
+	}
+	else {
+		cells = (int)floor(point.x * invCellSize.x) + (int)floor(point.y * invCellSize.y) + (int)floor(point.z * invCellSize.z);
+	}
+	return materials[cells & 1];
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Material.h"
+
+/*
+ * Texture class
+ * pattern evaluated at hit time from the hit point or the surface coordinates (u, v),
+ * it picks the material that shades that point of the surface.
+ * a material with a texture only stands for the pattern, ResolveMaterial swaps it for the picked one
+ */
+class Texture {
+public:
+	virtual ~Texture() {}
+	virtual MaterialID Evaluate(const glm::vec3 &point, float u, float v) const = 0;
+};
+
+/*
+ * Checker Texture
+ * alternates between two materials, either on a grid over the surface coordinates
+ * (repeats cells along u and v, the edges of a plane) or on a solid grid in world space
+ * (cells of the given size, a size of 0 leaves that axis out)
+ */
+class CheckerTexture : public Texture {
+public:
+	// grid over the surface coordinates, the first cell (u, v < 1 / repeats) gets the even material
+	CheckerTexture(MaterialID even, MaterialID odd, float repeatsU, float repeatsV);
+	// grid in world space, the cell at the origin gets the even material
+	CheckerTexture(MaterialID even, MaterialID odd, const glm::vec3 &cellSize);
+	MaterialID Evaluate(const glm::vec3 &point, float u, float v) const;
+private:
+	friend class SceneCache;
+
+	MaterialID materials[2];
+	bool useUV;
+	float repeatsU, repeatsV;
+	// reciprocal of the cell size, 0 for ignored axes
+	glm::vec3 invCellSize;
+};
+
+/*
+ * replaces a textured material in the hit with the one its texture picks for the hit point
+ */
+inline void ResolveMaterial(const MaterialTable &materials, IntersectInfo &info) {
+	const Texture *texture = materials[info.material].getTexture();
+	if (texture)
+		info.material = texture->Evaluate(info.hitPoint, info.u, info.v);
+}
@@ -0,0 +1,139 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+ThreadPool::ThreadPool(int numThreads):
+	active(0),
+	quit(false)
+{
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&job_available, NULL);
+	pthread_cond_init(&all_done, NULL);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	threads.resize(std::max(1, numThreads));
+	for (unsigned int i = 0; i < threads.size(); i++)
+		pthread_create(&threads[i], &attr, WorkerMain, this);
+	pthread_attr_destroy(&attr);
+}
+
+ThreadPool::~ThreadPool() {
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&job_available);
+	pthread_mutex_unlock(&lock);
+
+	for (unsigned int i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_cond_destroy(&all_done);
+	pthread_cond_destroy(&job_available);
+	pthread_mutex_destroy(&lock);
+}
+
+void ThreadPool::Submit(Task task, void *arg) {
+	Job job;
+	job.task = task;
+	job.arg = arg;
+	pthread_mutex_lock(&lock);
+	jobs.push_back(job);
+	pthread_cond_signal(&job_available);
+	pthread_mutex_unlock(&lock);
+}
+
+void ThreadPool::Wait() {
+	pthread_mutex_lock(&lock);
+	while (!jobs.empty() || active > 0)
+		pthread_cond_wait(&all_done, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Worker loop, sleeps until a job is queued or the pool is destroyed
+ */
+void *ThreadPool::WorkerMain(void *arg) {
+	ThreadPool *pool = (ThreadPool*)arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (pool->jobs.empty() && !pool->quit)
+			pthread_cond_wait(&pool->job_available, &pool->lock);
+		if (pool->jobs.empty())
+			break;
+
+		Job job = pool->jobs.front();
+		pool->jobs.pop_front();
+		pool->active++;
+		pthread_mutex_unlock(&pool->lock);
+
+		job.task(job.arg);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->active--;
+		if (pool->jobs.empty() && pool->active == 0)
+			pthread_cond_broadcast(&pool->all_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/*
+ * state shared by the jobs of one ParallelFor
+ */
+struct ParallelForState {
+	ThreadPool::RangeTask task;
+	void *arg;
+	int count;
+	int grain;
+	int next;
+	pthread_mutex_t lock;
+};
+
+static void parallel_for_job(void *arg) {
+	ParallelForState *state = (ParallelForState*)arg;
+	while (true) {
+		pthread_mutex_lock(&state->lock);
+		int begin = state->next;
+		state->next += state->grain;
+		pthread_mutex_unlock(&state->lock);
+
+		if (begin >= state->count)
+			break;
+		state->task(begin, std::min(begin + state->grain, state->count), state->arg);
+	}
+}
+
+void ThreadPool::ParallelFor(int count, int grain, RangeTask task, void *arg) {
+	grain = std::max(1, grain);
+	// not worth waking the workers
+	if (count <= grain) {
+		if (count > 0) task(0, count, arg);
+		return;
+	}
+
+	ParallelForState state;
+	state.task = task;
+	state.arg = arg;
+	state.count = count;
+	state.grain = grain;
+	state.next = 0;
+	pthread_mutex_init(&state.lock, NULL);
+
+	int numJobs = std::min(getThreadCount(), (count + grain - 1) / grain);
+	for (int i = 0; i < numJobs; i++)
+		Submit(parallel_for_job, &state);
+	Wait();
+
+	pthread_mutex_destroy(&state.lock);
+}
+
+int default_thread_count() {
+	const char *env = getenv("RAYTRACER_THREADS");
+	if (env && atoi(env) > 0)
+		return atoi(env);
+	int hardware = (int)std::thread::hardware_concurrency();
+	return hardware > 0 ? hardware : 4;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+/*
+ * Thread Pool
+ * worker threads created once and kept waiting for tasks, so that frames and
+ * other parallel jobs do not pay for creating threads every time
+ */
+class ThreadPool {
+public:
+	typedef void (*Task)(void *arg);
+	// processes indices [begin, end)
+	typedef void (*RangeTask)(int begin, int end, void *arg);
+
+	ThreadPool(int numThreads);
+	~ThreadPool();
+
+	// queues a task, it runs on the first idle worker
+	void Submit(Task task, void *arg);
+	// blocks until every submitted task has finished (call from outside the pool)
+	void Wait();
+	/*
+	 * splits [0, count) in chunks of grain indices that the workers pick up in turn,
+	 * returns when all of them are done
+	 */
+	void ParallelFor(int count, int grain, RangeTask task, void *arg);
+
+	int getThreadCount() const { return (int)threads.size(); }
+
+private:
+	static void *WorkerMain(void *arg);
+
+	struct Job {
+		Task task;
+		void *arg;
+	};
+
+	std::vector<pthread_t> threads;
+	std::deque<Job> jobs;
+	// jobs taken by workers but not finished yet
+	int active;
+	bool quit;
+	pthread_mutex_t lock;
+	pthread_cond_t job_available;
+	pthread_cond_t all_done;
+};
+
+/*
+ * thread count from the RAYTRACER_THREADS environment variable, or the number of hardware threads
+ */
+int default_thread_count();
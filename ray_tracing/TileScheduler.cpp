@@ -0,0 +1,92 @@
+#include "TileScheduler.h"
+#include <algorithm>
+
+TileScheduler::TileScheduler(int width, int height, int numWorkers, int tileSize):
+	steals(0)
+{
+	// tiles in scanline order, so that a band of them is a compact region of the image
+	for (int y = 0; y < height; y += tileSize)
+		for (int x = 0; x < width; x += tileSize) {
+			Tile tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = std::min(x + tileSize, width);
+			tile.y1 = std::min(y + tileSize, height);
+			tiles.push_back(tile);
+		}
+
+	for (int i = 0; i < numWorkers; i++) {
+		WorkQueue *queue = new WorkQueue();
+		pthread_mutex_init(&queue->lock, NULL);
+		queues.push_back(queue);
+	}
+	pthread_mutex_init(&stats_lock, NULL);
+}
+
+TileScheduler::~TileScheduler() {
+	for (unsigned int i = 0; i < queues.size(); i++) {
+		pthread_mutex_destroy(&queues[i]->lock);
+		delete queues[i];
+	}
+	pthread_mutex_destroy(&stats_lock);
+}
+
+void TileScheduler::Reset() {
+	int numWorkers = (int)queues.size();
+	int numTiles = (int)tiles.size();
+	for (int w = 0; w < numWorkers; w++) {
+		pthread_mutex_lock(&queues[w]->lock);
+		queues[w]->tiles.clear();
+		// contiguous band of tiles for this worker
+		for (int i = numTiles * w / numWorkers; i < numTiles * (w + 1) / numWorkers; i++)
+			queues[w]->tiles.push_back(tiles[i]);
+		pthread_mutex_unlock(&queues[w]->lock);
+	}
+	steals = 0;
+}
+
+bool TileScheduler::NextTile(int worker, Tile &tile) {
+	if (Pop(worker, tile))
+		return true;
+
+	// own queue is empty, look for work in the others starting from the next worker
+	int numWorkers = (int)queues.size();
+	for (int i = 1; i < numWorkers; i++)
+		if (Steal((worker + i) % numWorkers, tile)) {
+			pthread_mutex_lock(&stats_lock);
+			steals++;
+			pthread_mutex_unlock(&stats_lock);
+			return true;
+		}
+	return false;
+}
+
+/*
+ * owner takes from the front, walking its band in order
+ */
+bool TileScheduler::Pop(int worker, Tile &tile) {
+	WorkQueue *queue = queues[worker];
+	pthread_mutex_lock(&queue->lock);
+	bool found = !queue->tiles.empty();
+	if (found) {
+		tile = queue->tiles.front();
+		queue->tiles.pop_front();
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
+
+/*
+ * thieves take from the back, furthest away from where the owner is working
+ */
+bool TileScheduler::Steal(int victim, Tile &tile) {
+	WorkQueue *queue = queues[victim];
+	pthread_mutex_lock(&queue->lock);
+	bool found = !queue->tiles.empty();
+	if (found) {
+		tile = queue->tiles.back();
+		queue->tiles.pop_back();
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+// tile edge in pixels
+#define TILE_SIZE 16
+
+/*
+ * Tile
+ * rectangle of pixels [x0, x1) x [y0, y1) rendered as one unit of work
+ */
+struct Tile {
+	int x0, y0;
+	int x1, y1;
+};
+
+/*
+ * Tile Scheduler
+ * splits the image in tiles and hands each worker a contiguous band of them.
+ * workers take tiles from the front of their own queue and, once it is empty,
+ * steal from the back of the other queues so that expensive regions get shared
+ */
+class TileScheduler {
+public:
+	TileScheduler(int width, int height, int numWorkers, int tileSize = TILE_SIZE);
+	~TileScheduler();
+
+	// refills the queues, call before every frame
+	void Reset();
+	// next tile for the worker, false once the whole image has been handed out
+	bool NextTile(int worker, Tile &tile);
+
+	int getTileCount() const { return (int)tiles.size(); }
+	int getStealCount() const { return steals; }
+
+private:
+	bool Pop(int worker, Tile &tile);
+	bool Steal(int victim, Tile &tile);
+
+	// one per worker, each with its own lock
+	struct WorkQueue {
+		pthread_mutex_t lock;
+		std::deque<Tile> tiles;
+	};
+
+	std::vector<Tile> tiles;
+	std::vector<WorkQueue*> queues;
+	pthread_mutex_t stats_lock;
+	int steals;
+};
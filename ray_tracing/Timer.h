@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+
+/*
+ * Wall clock timer
+ * std::clock measures cpu time on some platforms, which is meaningless with threads
+ */
+class Timer {
+public:
+	Timer() { Reset(); }
+
+	void Reset() { start = std::chrono::high_resolution_clock::now(); }
+
+	double Seconds() const {
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	double Milliseconds() const { return Seconds() * 1000.0; }
+
+private:
+	std::chrono::high_resolution_clock::time_point start;
+};
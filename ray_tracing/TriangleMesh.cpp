@@ -0,0 +1,265 @@
+#include "TriangleMesh.h"
+
+TriangleMesh::TriangleMesh(MaterialID material):
+Object(material)
+{
+	centroid = glm::vec3(0.f);
+	radius = 0.f;
+}
+
+struct MeshItemsJob {
+	const TriangleMesh *mesh;
+	BVHBuildItem *items;
+};
+
+static void mesh_items_job(int begin, int end, void *arg) {
+	MeshItemsJob &job = *(MeshItemsJob*)arg;
+	const TriangleMesh &mesh = *job.mesh;
+	for (int i = begin; i < end; i++) {
+		// same padding as Triangle::getBounds
+		AABB box;
+		for (int k = 0; k < 3; k++)
+			box.Extend(mesh.positions[mesh.indices[3 * i + k]]);
+		box.min -= glm::vec3(1e-4f);
+		box.max += glm::vec3(1e-4f);
+		job.items[i].bounds = box;
+		job.items[i].centroid = box.Centroid();
+		job.items[i].index = i;
+	}
+}
+
+static AABB mesh_clip_item(int index, const AABB &box, void *arg) {
+	const TriangleMesh &mesh = *(const TriangleMesh*)arg;
+	glm::vec3 vertices[3];
+	for (int k = 0; k < 3; k++)
+		vertices[k] = mesh.positions[mesh.indices[3 * index + k]];
+	return ClipPolygon(vertices, 3, box);
+}
+
+void TriangleMesh::Build(ThreadPool *pool) {
+	int count = getTriangleCount();
+	nodes.clear();
+	references.clear();
+	bounds = AABB();
+	if (count == 0) return;
+
+	std::vector<BVHBuildItem> items(count);
+	MeshItemsJob job = { this, &items[0] };
+	if (pool)
+		pool->ParallelFor(count, 16384, mesh_items_job, &job);
+	else
+		mesh_items_job(0, count, &job);
+	BuildBVH(items, SIMD_BLOCK_SIZE, nodes, pool, mesh_clip_item, this);
+	nodes.shrink_to_fit();
+
+	/*
+	 * the triangles are put in the order of the leaves (of their first reference), so that without
+	 * spatial splits a leaf's range of items is its range of triangles and nothing but the index buffer
+	 * is needed to find them. split triangles are referenced from several leaves, the items then keep
+	 * their triangle in references
+	 */
+	int itemCount = (int)items.size();
+	std::vector<int> place(count, -1);
+	int placed = 0;
+	Buffer<unsigned int> ordered;
+	ordered.resize(indices.size());
+	for (int i = 0; i < itemCount; i++) {
+		int triangle = items[i].index;
+		if (place[triangle] >= 0) continue;
+		place[triangle] = placed++;
+		for (int k = 0; k < 3; k++)
+			ordered[3 * place[triangle] + k] = indices[3 * triangle + k];
+	}
+	indices.swap(ordered);
+	if (itemCount != count) {
+		references.resize(itemCount);
+		for (int i = 0; i < itemCount; i++)
+			references[i] = (unsigned int)place[items[i].index];
+	}
+
+	bounds = nodes[0].bounds;
+	centroid = bounds.Centroid();
+	radius = glm::length(bounds.Extent()) * .5f;
+}
+
+/*
+ * items [first, first + count) of a leaf as a block for the SIMD kernels, first vertex and the two
+ * edges leaving it gathered from the shared buffers. the lanes after count stay degenerate (never hit)
+ */
+void TriangleMesh::GatherBlock(int first, int count, PrimitiveBlock &block) const {
+	block.kind = PrimitiveBlock::TRIANGLES;
+	block.count = count;
+	for (int lane = 0; lane < SIMD_BLOCK_SIZE; lane++) {
+		glm::vec3 v0(0.f), e1(0.f), e2(0.f);
+		if (lane < count) {
+			const unsigned int *triangle = &indices[3 * getTriangle(first + lane)];
+			v0 = positions[triangle[0]];
+			e1 = positions[triangle[1]] - v0;
+			e2 = positions[triangle[2]] - v0;
+		}
+		for (int c = 0; c < 3; c++) {
+			block.data[c][lane] = v0[c];
+			block.data[3 + c][lane] = e1[c];
+			block.data[6 + c][lane] = e2[c];
+		}
+	}
+}
+
+/*
+ * Front-to-back traversal of the mesh BVH, the leaves' triangles are gathered into a block that
+ * only reports the closest one, and the hit is filled in once at the end
+ */
+bool TriangleMesh::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float tmax = info.time;
+	if (MAX != std::numeric_limits<float>::infinity())
+		tmax = std::min(tmax, MAX / glm::length(ray.direction));
+
+	struct StackEntry {
+		int node;
+		float tnear;
+	} stack[BVH_MAX_DEPTH];
+	int sp = 0;
+
+	float tnear;
+	if (!nodes[0].bounds.Intersect(ray, invDir, tmax, tnear))
+		return false;
+	stack[sp].node = 0;
+	stack[sp++].tnear = tnear;
+
+	int hit = -1;
+	PrimitiveBlock block;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		if (entry.tnear > tmax) continue;
+
+		const BVHNode &node = nodes[entry.node];
+		if (node.isLeaf()) {
+			for (int first = node.offset; first < node.offset + node.count; first += SIMD_BLOCK_SIZE) {
+				GatherBlock(first, std::min(SIMD_BLOCK_SIZE, node.offset + node.count - first), block);
+				float t;
+				int lane = ClosestInBlock(block, ray, tmax, t);
+				if (lane >= 0) {
+					tmax = t;
+					hit = getTriangle(first + lane);
+				}
+			}
+			continue;
+		}
+
+		int near = entry.node + 1, far = node.offset;
+		float tNear, tFar;
+		bool hitNear = nodes[near].bounds.Intersect(ray, invDir, tmax, tNear);
+		bool hitFar = nodes[far].bounds.Intersect(ray, invDir, tmax, tFar);
+		if (hitNear && hitFar && tFar < tNear) {
+			std::swap(near, far);
+			std::swap(tNear, tFar);
+		}
+		if (hitFar) {
+			stack[sp].node = far;
+			stack[sp++].tnear = tFar;
+		}
+		if (hitNear) {
+			stack[sp].node = near;
+			stack[sp++].tnear = tNear;
+		}
+	}
+
+	if (hit < 0) return false;
+	setHit(hit, ray, tmax, info);
+	return true;
+}
+
+bool TriangleMesh::Occluded(const Ray &ray, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float limit = std::numeric_limits<float>::infinity();
+	if (MAX != limit)
+		limit = MAX / glm::length(ray.direction);
+
+	int stack[BVH_MAX_DEPTH];
+	int sp = 0;
+	stack[sp++] = 0;
+	PrimitiveBlock block;
+
+	while (sp > 0) {
+		int index = stack[--sp];
+		const BVHNode &node = nodes[index];
+		float tnear;
+		if (!node.bounds.Intersect(ray, invDir, limit, tnear)) continue;
+
+		if (node.isLeaf()) {
+			float t;
+			for (int first = node.offset; first < node.offset + node.count; first += SIMD_BLOCK_SIZE) {
+				GatherBlock(first, std::min(SIMD_BLOCK_SIZE, node.offset + node.count - first), block);
+				if (ClosestInBlock(block, ray, limit, t) >= 0)
+					return true;
+			}
+			continue;
+		}
+		stack[sp++] = node.offset;
+		stack[sp++] = index + 1;
+	}
+	return false;
+}
+
+void TriangleMesh::setHit(int triangle, const Ray &ray, float t, IntersectInfo &info) const {
+	unsigned int i0 = indices[3 * triangle], i1 = indices[3 * triangle + 1], i2 = indices[3 * triangle + 2];
+	const glm::vec3 &p0 = positions[i0];
+	glm::vec3 e1 = positions[i1] - p0, e2 = positions[i2] - p0;
+
+	// barycentrics of the hit (the kernel only reports the time)
+	float tt, u = 0.f, v = 0.f;
+	MollerTrumbore(ray, p0, e1, e2, tt, u, v);
+	float w = 1.f - u - v;
+
+	info.time = t;
+	info.hitPoint = ray(t);
+	info.material = material;
+	if (normals.empty())
+		info.normal = glm::normalize(glm::cross(e1, e2));
+	else
+		info.normal = glm::normalize(normals[i0] * w + normals[i1] * u + normals[i2] * v);
+	if (uvs.empty()) {
+		info.u = u;
+		info.v = v;
+	}
+	else {
+		glm::vec2 uv = uvs[i0] * w + uvs[i1] * u + uvs[i2] * v;
+		info.u = uv.x;
+		info.v = uv.y;
+	}
+}
+
+size_t TriangleMesh::getMemoryUsage() const {
+	return positions.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+		uvs.capacity() * sizeof(glm::vec2) + indices.capacity() * sizeof(unsigned int) +
+		nodes.capacity() * sizeof(BVHNode) + references.capacity() * sizeof(unsigned int);
+}
+
+void TriangleMesh::Transform(const glm::mat4 &matrix) {
+	for (unsigned int i = 0; i < positions.size(); i++)
+		positions[i] = glm::vec3(matrix * glm::vec4(positions[i], 1.f));
+	// normals go through the inverse transpose so that they stay perpendicular under non-uniform scales
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+	for (unsigned int i = 0; i < normals.size(); i++)
+		normals[i] = glm::normalize(normalMatrix * normals[i]);
+	nodes.clear();
+	references.clear();
+}
+
+void TriangleMesh::Swap(TriangleMesh &mesh) {
+	std::swap(centroid, mesh.centroid);
+	std::swap(material, mesh.material);
+	std::swap(radius, mesh.radius);
+	std::swap(bounds, mesh.bounds);
+	positions.swap(mesh.positions);
+	normals.swap(mesh.normals);
+	uvs.swap(mesh.uvs);
+	indices.swap(mesh.indices);
+	nodes.swap(mesh.nodes);
+	references.swap(mesh.references);
+}
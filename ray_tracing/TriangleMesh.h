@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Object.h"
+#include "BVHBuilder.h"
+
+/*
+ * Triangle Mesh Object
+ * triangles sharing one vertex buffer through an index buffer, with optional per-vertex
+ * normals (smooth shading) and texture coordinates.
+ * the triangles are found through a BVH of their own whose leaves refer to them in the index buffer
+ * and gather them into SIMD blocks when tested, so the whole mesh is a single primitive to the scene
+ */
+class TriangleMesh : public Object {
+public:
+	TriangleMesh(MaterialID material = 0);
+
+	/*
+	 * builds the internal BVH, call after filling the buffers. the pool, if given,
+	 * shares out the build (NULL when called from one of its tasks)
+	 */
+	void Build(ThreadPool *pool = NULL);
+	bool isBuilt() const { return !nodes.empty(); }
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	// any triangle closer than MAX
+	bool Occluded(const Ray &ray, float MAX) const;
+	// box enclosing the object, used to build the acceleration structures
+	AABB getBounds() const { return bounds; }
+
+	int getTriangleCount() const { return (int)indices.size() / 3; }
+	// bytes held by the buffers and the BVH
+	size_t getMemoryUsage() const;
+	/*
+	 * moves the vertices and normals by an affine transform, the BVH has to be built again afterwards
+	 */
+	void Transform(const glm::mat4 &matrix);
+	// exchanges the contents of two meshes without copying the buffers
+	void Swap(TriangleMesh &mesh);
+
+	// vertex buffers, normals and uvs are either empty or hold one entry per position
+	Buffer<glm::vec3> positions;
+	Buffer<glm::vec3> normals;
+	Buffer<glm::vec2> uvs;
+	// three vertex indices per triangle
+	Buffer<unsigned int> indices;
+
+private:
+	friend class SceneCache;
+
+	/*
+	 * fills in the hit on triangle at time t
+	 */
+	void setHit(int triangle, const Ray &ray, float t, IntersectInfo &info) const;
+	// triangle of a leaf item
+	int getTriangle(int item) const { return references.empty() ? item : (int)references[item]; }
+	// the triangles of items [first, first + count) as a block for the SIMD kernels
+	void GatherBlock(int first, int count, PrimitiveBlock &block) const;
+
+	AABB bounds;
+	// the leaves cover ranges of items, Build puts the triangles in the order of the leaves
+	Buffer<BVHNode> nodes;
+	// triangle of every item when spatial splits referenced some from several leaves, empty otherwise
+	Buffer<unsigned int> references;
+};
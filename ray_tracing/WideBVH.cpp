@@ -0,0 +1,395 @@
+#include "WideBVH.h"
+#include <cstring>
+
+template <int N, class Node>
+WideBVH<N, Node>::WideBVH(ThreadPool *pool):
+	pool(pool),
+	primitives(NULL)
+{}
+
+struct WideItemsJob {
+	const PrimitiveList *primitives;
+	BVHBuildItem *items;
+};
+
+static void wide_items_job(int begin, int end, void *arg) {
+	WideItemsJob &job = *(WideItemsJob*)arg;
+	for (int i = begin; i < end; i++) {
+		job.items[i].bounds = job.primitives->getBounds((*job.primitives)[i]);
+		job.items[i].centroid = job.items[i].bounds.Centroid();
+		job.items[i].index = i;
+	}
+}
+
+static AABB wide_clip_item(int index, const AABB &box, void *arg) {
+	const PrimitiveList &primitives = *(const PrimitiveList*)arg;
+	return primitives.getClippedBounds(primitives[index], box);
+}
+
+template <int N, class Node>
+void WideBVH<N, Node>::Build(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	nodes.clear();
+	blocks.clear();
+	bounds = AABB();
+	if (primitives.empty()) return;
+
+	std::vector<BVHBuildItem> items(primitives.size());
+	WideItemsJob job = { &primitives, &items[0] };
+	if (pool)
+		pool->ParallelFor(primitives.size(), 16384, wide_items_job, &job);
+	else
+		wide_items_job(0, primitives.size(), &job);
+
+	Buffer<BVHNode> binary;
+	BuildBVH(items, SIMD_BLOCK_SIZE, binary, pool, wide_clip_item, (void*)&primitives);
+	std::vector<PrimitiveRef> refs(items.size());
+	for (unsigned int i = 0; i < items.size(); i++)
+		refs[i] = primitives[items[i].index];
+
+	// every wide node takes the place of at least one binary interior node
+	nodes.reserve(binary.size() / 2 + 1);
+	Collapse(binary, refs, 0);
+	nodes.shrink_to_fit();
+	bounds = binary[0].bounds;
+}
+
+template <int N, class Node>
+int WideBVH<N, Node>::Collapse(const Buffer<BVHNode> &binary, const std::vector<PrimitiveRef> &refs, int index) {
+	// the children of the binary node, then the largest interior ones opened until there are N
+	int children[N];
+	int count = 0;
+	if (binary[index].isLeaf())
+		children[count++] = index;
+	else {
+		children[count++] = index + 1;
+		children[count++] = binary[index].offset;
+	}
+	while (count < N) {
+		int largest = -1;
+		float largestArea = 0.f;
+		for (int k = 0; k < count; k++) {
+			const BVHNode &child = binary[children[k]];
+			if (child.isLeaf()) continue;
+			float area = child.bounds.SurfaceArea();
+			if (largest < 0 || area > largestArea) {
+				largest = k;
+				largestArea = area;
+			}
+		}
+		if (largest < 0) break;
+		int open = children[largest];
+		children[largest] = open + 1;
+		children[count++] = binary[open].offset;
+	}
+
+	int nodeIndex = (int)nodes.size();
+	Node node;
+	memset(&node, 0, sizeof(node));
+	for (int k = 0; k < N; k++)
+		node.count[k] = -1;
+	// the children together fill the binary node's box
+	node.setFrame(binary[index].bounds);
+	nodes.push_back(node);
+
+	// the recursion appends nodes, so the new one is only reached through its index
+	for (int k = 0; k < count; k++) {
+		const BVHNode &child = binary[children[k]];
+		nodes[nodeIndex].setBounds(k, child.bounds);
+		if (child.isLeaf()) {
+			int first = (int)blocks.size();
+			PackBlocks(*primitives, &refs[child.offset], child.count, blocks);
+			nodes[nodeIndex].child[k] = first;
+			nodes[nodeIndex].count[k] = (int)blocks.size() - first;
+		}
+		else {
+			int grandchild = Collapse(binary, refs, children[k]);
+			nodes[nodeIndex].child[k] = grandchild;
+			nodes[nodeIndex].count[k] = 0;
+		}
+	}
+	return nodeIndex;
+}
+
+template <int N, class Node>
+void WideBVH<N, Node>::Refit(const PrimitiveList &primitives) {
+	this->primitives = &primitives;
+	bounds = AABB();
+	if (nodes.empty()) return;
+	// exact box of every node, the stored ones may have been rounded outwards
+	std::vector<AABB> exact(nodes.size());
+	// children always come after their parent
+	for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+		Node &node = nodes[i];
+		AABB boxes[N];
+		for (int k = 0; k < N && node.count[k] >= 0; k++) {
+			if (node.count[k] > 0)
+				for (int b = node.child[k]; b < node.child[k] + node.count[k]; b++) {
+					UpdateBlock(primitives, blocks[b]);
+					for (int lane = 0; lane < blocks[b].count; lane++)
+						boxes[k].Extend(primitives.getBounds(blocks[b].refs[lane]));
+				}
+			else
+				boxes[k] = exact[node.child[k]];
+			exact[i].Extend(boxes[k]);
+		}
+		node.setFrame(exact[i]);
+		for (int k = 0; k < N && node.count[k] >= 0; k++)
+			node.setBounds(k, boxes[k]);
+	}
+	bounds = exact[0];
+}
+
+/*
+ * Front-to-back traversal
+ * all the children of a node are tested at once, the ones hit are pushed furthest first
+ * so that the nearest is visited next; entries further than the closest hit so far are skipped
+ */
+template <int N, class Node>
+bool WideBVH<N, Node>::Intersect(const Ray &ray, IntersectInfo &info, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float limit = DistanceToTime(ray, MAX);
+
+	// a child or a leaf: node index or first block, and the block count (0 for nodes)
+	struct StackEntry {
+		int child;
+		int count;
+		float tnear;
+	} stack[BVH_MAX_DEPTH * (N - 1) + 1];
+	int sp = 0;
+
+	float tnear;
+	if (!bounds.Intersect(ray, invDir, std::min(info.time, limit), tnear))
+		return false;
+	stack[sp].child = 0;
+	stack[sp].count = 0;
+	stack[sp++].tnear = tnear;
+
+	bool flag = false;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		// a closer hit was found after this entry was pushed
+		if (entry.tnear > info.time) continue;
+
+		if (entry.count > 0) {
+			for (int i = entry.child; i < entry.child + entry.count; i++)
+				if (IntersectBlock(*primitives, blocks[i], ray, info, MAX))
+					flag = true;
+			continue;
+		}
+
+		const Node &node = nodes[entry.child];
+		float times[N];
+		unsigned int hits = node.Intersect(ray.origin, invDir, std::min(info.time, limit), times);
+
+		// the hit children by decreasing entry time
+		int order[N];
+		int count = 0;
+		for (int k = 0; k < N && node.count[k] >= 0; k++) {
+			if (!(hits & (1u << k))) continue;
+			int j = count++;
+			while (j > 0 && times[order[j - 1]] < times[k]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = k;
+		}
+		for (int j = 0; j < count; j++) {
+			stack[sp].child = node.child[order[j]];
+			stack[sp].count = node.count[order[j]];
+			stack[sp++].tnear = times[order[j]];
+		}
+	}
+	return flag;
+}
+
+/*
+ * Any-hit traversal
+ * no ordering of the children, stops at the first object found within MAX
+ */
+template <int N, class Node>
+bool WideBVH<N, Node>::Occluded(const Ray &ray, float MAX) const {
+	if (nodes.empty()) return false;
+
+	glm::vec3 invDir = 1.f / ray.direction;
+	float limit = DistanceToTime(ray, MAX);
+
+	float tnear;
+	if (!bounds.Intersect(ray, invDir, limit, tnear))
+		return false;
+
+	struct StackEntry {
+		int child;
+		int count;
+	} stack[BVH_MAX_DEPTH * (N - 1) + 1];
+	int sp = 0;
+	stack[sp].child = 0;
+	stack[sp++].count = 0;
+
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		if (entry.count > 0) {
+			for (int i = entry.child; i < entry.child + entry.count; i++)
+				if (OccludedBlock(*primitives, blocks[i], ray, MAX))
+					return true;
+			continue;
+		}
+
+		const Node &node = nodes[entry.child];
+		float times[N];
+		unsigned int hits = node.Intersect(ray.origin, invDir, limit, times);
+		for (int k = 0; k < N && node.count[k] >= 0; k++) {
+			if (!(hits & (1u << k))) continue;
+			stack[sp].child = node.child[k];
+			stack[sp++].count = node.count[k];
+		}
+	}
+	return false;
+}
+
+/*
+ * Packet traversal
+ * every child box is tested against the rays that reached its node, the children any ray hits
+ * are visited in the order of their centres along the first active ray
+ */
+template <int N, class Node>
+RayMask WideBVH<N, Node>::IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const {
+	if (nodes.empty()) return 0;
+
+	float limit[PACKET_SIZE], tmax[PACKET_SIZE];
+	for (int i = 0; i < packet.count; i++)
+		limit[i] = DistanceToTime(packet.rays[i], MAX);
+
+	struct StackEntry {
+		int child;
+		int count;
+		RayMask active;
+	} stack[BVH_MAX_DEPTH * (N - 1) + 1];
+	int sp = 0;
+	for (int i = 0; i < packet.count; i++)
+		tmax[i] = std::min(infos[i].time, limit[i]);
+	stack[sp].child = 0;
+	stack[sp].count = 0;
+	stack[sp++].active = IntersectBoxPacket(bounds, packet, packet.getMask(), tmax);
+	if (!stack[0].active) return 0;
+
+	RayMask hits = 0;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		if (entry.count > 0) {
+			for (int r = 0; r < packet.count; r++) {
+				if (!(entry.active & (1u << r))) continue;
+				for (int i = entry.child; i < entry.child + entry.count; i++)
+					if (IntersectBlock(*primitives, blocks[i], packet.rays[r], infos[r], MAX))
+						hits |= 1u << r;
+			}
+			continue;
+		}
+
+		// rays that found a closer hit since the node was pushed drop out here
+		for (int i = 0; i < packet.count; i++)
+			tmax[i] = std::min(infos[i].time, limit[i]);
+		int first = 0;
+		while (!(entry.active & (1u << first))) first++;
+		const glm::vec3 &direction = packet.rays[first].direction;
+
+		const Node &node = nodes[entry.child];
+		RayMask active[N];
+		float distance[N];
+		int order[N];
+		int count = 0;
+		for (int k = 0; k < N && node.count[k] >= 0; k++) {
+			AABB box = node.getBounds(k);
+			active[k] = IntersectBoxPacket(box, packet, entry.active, tmax);
+			if (!active[k]) continue;
+			distance[k] = glm::dot(box.Centroid(), direction);
+			int j = count++;
+			while (j > 0 && distance[order[j - 1]] < distance[k]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = k;
+		}
+		for (int j = 0; j < count; j++) {
+			stack[sp].child = node.child[order[j]];
+			stack[sp].count = node.count[order[j]];
+			stack[sp++].active = active[order[j]];
+		}
+	}
+	return hits;
+}
+
+/*
+ * Packet any-hit traversal
+ * rays leave the packet as soon as they are blocked, stops when all of them are
+ */
+template <int N, class Node>
+RayMask WideBVH<N, Node>::OccludedPacket(const RayPacket &packet, const float *MAX) const {
+	if (nodes.empty()) return 0;
+
+	float limit[PACKET_SIZE];
+	for (int i = 0; i < packet.count; i++)
+		limit[i] = DistanceToTime(packet.rays[i], MAX[i]);
+
+	struct StackEntry {
+		int child;
+		int count;
+		RayMask active;
+	} stack[BVH_MAX_DEPTH * (N - 1) + 1];
+	int sp = 0;
+	stack[sp].child = 0;
+	stack[sp].count = 0;
+	stack[sp++].active = IntersectBoxPacket(bounds, packet, packet.getMask(), limit);
+	if (!stack[0].active) return 0;
+
+	RayMask occluded = 0;
+	while (sp > 0) {
+		StackEntry entry = stack[--sp];
+		RayMask active = entry.active & ~occluded;
+		if (!active) continue;
+
+		if (entry.count > 0) {
+			for (int r = 0; r < packet.count; r++) {
+				if (!(active & (1u << r))) continue;
+				for (int i = entry.child; i < entry.child + entry.count; i++)
+					if (OccludedBlock(*primitives, blocks[i], packet.rays[r], MAX[r])) {
+						occluded |= 1u << r;
+						break;
+					}
+			}
+			if (occluded == packet.getMask()) break;
+			continue;
+		}
+
+		const Node &node = nodes[entry.child];
+		for (int k = 0; k < N && node.count[k] >= 0; k++) {
+			RayMask hit = IntersectBoxPacket(node.getBounds(k), packet, active, limit);
+			if (!hit) continue;
+			stack[sp].child = node.child[k];
+			stack[sp].count = node.count[k];
+			stack[sp++].active = hit;
+		}
+	}
+	return occluded;
+}
+
+template <int N, class Node>
+float WideBVH<N, Node>::getSAHCost() const {
+	if (nodes.empty()) return 0.f;
+	float rootArea = bounds.SurfaceArea();
+	// the root node is always visited
+	float cost = SAH_TRAVERSAL_COST;
+	for (unsigned int i = 0; i < nodes.size(); i++)
+		for (int k = 0; k < N && nodes[i].count[k] >= 0; k++) {
+			float p = nodes[i].getBounds(k).SurfaceArea() / rootArea;
+			cost += p * (nodes[i].count[k] > 0 ? SAH_BLOCK_COST * nodes[i].count[k] : SAH_TRAVERSAL_COST);
+		}
+	return cost;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+template class WideBVH<4, QuantizedWideBVHNode<4> >;
+template class WideBVH<8, QuantizedWideBVHNode<8> >;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Accelerator.h"
+#include "BVHBuilder.h"
+
+/*
+ * Wide BVH node
+ * up to N children whose boxes are kept in SoA form, so that a ray is tested against all of them
+ * with one SIMD slab test (see IntersectChildBoxes)
+ */
+template <int N>
+struct WideBVHNode {
+	static const bool QUANTIZED = false;
+
+	// bounds[component][lane], components min x, y, z, max x, y, z
+	float bounds[6][N];
+	// interior lanes: index of the child node, leaf lanes: first primitive block
+	int child[N];
+	// leaf lanes: number of primitive blocks, 0 for interior lanes, -1 for unused lanes
+	int count[N];
+
+	AABB getBounds(int lane) const {
+		AABB box;
+		for (int a = 0; a < 3; a++) {
+			box.min[a] = bounds[a][lane];
+			box.max[a] = bounds[3 + a][lane];
+		}
+		return box;
+	}
+	// the boxes are stored as they are, there is no frame to set up
+	void setFrame(const AABB &/*box*/) {}
+	void setBounds(int lane, const AABB &box) {
+		for (int a = 0; a < 3; a++) {
+			bounds[a][lane] = box.min[a];
+			bounds[3 + a][lane] = box.max[a];
+		}
+	}
+	unsigned int Intersect(const glm::vec3 &origin, const glm::vec3 &invDir, float tmax, float *tnear) const {
+		return IntersectChildBoxes(&bounds[0][0], N, origin, invDir, tmax, tnear);
+	}
+};
+
+/*
+ * Quantized wide BVH node
+ * the children's boxes as 8 bit steps across a frame, the box of the node itself: a box is stored
+ * as origin + bounds * step, with the minimum rounded down and the maximum up so that it always
+ * encloses the child. a bit more than half the size of WideBVHNode; the boxes grow by up to
+ * 1/255 of the node's size, which costs some extra visits
+ */
+template <int N>
+struct QuantizedWideBVHNode {
+	static const bool QUANTIZED = true;
+
+	// corner and size of one step of the frame along each axis
+	float origin[3];
+	float step[3];
+	// bounds[component][lane] in steps from the origin, components min x, y, z, max x, y, z
+	unsigned char bounds[6][N];
+	// as in WideBVHNode
+	int child[N];
+	int count[N];
+
+	AABB getBounds(int lane) const {
+		AABB box;
+		for (int a = 0; a < 3; a++) {
+			box.min[a] = origin[a] + bounds[a][lane] * step[a];
+			box.max[a] = origin[a] + bounds[3 + a][lane] * step[a];
+		}
+		return box;
+	}
+	// call before setting the children, box has to enclose them all
+	void setFrame(const AABB &box) {
+		glm::vec3 extent = box.Extent();
+		for (int a = 0; a < 3; a++) {
+			origin[a] = box.min[a];
+			step[a] = extent[a] / 255.f;
+		}
+	}
+	void setBounds(int lane, const AABB &box) {
+		for (int a = 0; a < 3; a++) {
+			int low = 0, high = 255;
+			if (step[a] > 0.f) {
+				low = std::max(0, std::min(255, (int)floor((box.min[a] - origin[a]) / step[a])));
+				high = std::max(0, std::min(255, (int)ceil((box.max[a] - origin[a]) / step[a])));
+				// the division may round the wrong way
+				while (low > 0 && origin[a] + low * step[a] > box.min[a]) low--;
+				while (high < 255 && origin[a] + high * step[a] < box.max[a]) high++;
+			}
+			bounds[a][lane] = (unsigned char)low;
+			bounds[3 + a][lane] = (unsigned char)high;
+		}
+	}
+	unsigned int Intersect(const glm::vec3 &rayOrigin, const glm::vec3 &invDir, float tmax, float *tnear) const {
+		return IntersectQuantizedChildBoxes(&bounds[0][0], N, origin, step, rayOrigin, invDir, tmax, tnear);
+	}
+};
+
+/*
+ * Wide Bounding Volume Hierarchy (QBVH for N = 4, OBVH for N = 8)
+ * built as a binary BVH (with the selected BuildBVH method) and collapsed into nodes of up to N children,
+ * opening the largest child until the node is full. a ray visits a node once for all of its children
+ * and goes on to the ones it hit nearest first, so fewer and larger nodes are read than in the binary tree.
+ * packets test the child boxes one by one against all their rays. leaves keep their primitives in SIMD blocks.
+ * Node is WideBVHNode<N> or the smaller QuantizedWideBVHNode<N>
+ */
+template <int N, class Node = WideBVHNode<N> >
+class WideBVH : public Accelerator {
+public:
+	// with a pool the builds run on its threads (see BuildBVH)
+	WideBVH(ThreadPool *pool = NULL);
+	void Build(const PrimitiveList &primitives);
+	// keeps the tree and recomputes the boxes bottom-up, as BVH::Refit
+	void Refit(const PrimitiveList &primitives);
+	bool Intersect(const Ray &ray, IntersectInfo &info, float MAX) const;
+	bool Occluded(const Ray &ray, float MAX) const;
+	RayMask IntersectPacket(const RayPacket &packet, IntersectInfo *infos, float MAX) const;
+	RayMask OccludedPacket(const RayPacket &packet, const float *MAX) const;
+	const char *getName() const { return Node::QUANTIZED ? (N == 4 ? "bvh4q" : "bvh8q") : (N == 4 ? "bvh4" : "bvh8"); }
+
+	void setThreadPool(ThreadPool *pool) { this->pool = pool; }
+
+	int getNodeCount() const { return (int)nodes.size(); }
+	size_t getMemoryUsage() const { return getNodeMemoryUsage() + blocks.capacity() * sizeof(PrimitiveBlock); }
+	// bytes held by the nodes alone
+	size_t getNodeMemoryUsage() const { return nodes.capacity() * sizeof(Node); }
+	// SAH estimate as BVH::getSAHCost, a wide node costs one traversal step
+	float getSAHCost() const;
+
+private:
+	// builds the wide node over a binary node's subtree, returns its index
+	int Collapse(const Buffer<BVHNode> &binary, const std::vector<PrimitiveRef> &refs, int index);
+
+	ThreadPool *pool;
+	const PrimitiveList *primitives;
+	Buffer<Node> nodes;
+	// box of the root node's children
+	AABB bounds;
+	Buffer<PrimitiveBlock> blocks;
+};
+
+typedef WideBVH<4> BVH4;
+typedef WideBVH<8> BVH8;
+typedef WideBVH<4, QuantizedWideBVHNode<4> > BVH4Q;
+typedef WideBVH<8, QuantizedWideBVHNode<8> > BVH8Q;